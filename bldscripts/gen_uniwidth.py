@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+# ------------------------------------------------------------------------------------------------------------
+# Generate the two stage display width lookup table used by xmb_width() and
+# xmb_dispoffset() in libunitbl from the Unicode database shipped with Python.
+#
+# Usage: bldscripts/gen_uniwidth.py > src/libunitbl/uniwidth_tbl.c
+#
+# Each code point is given a display width of 0, 1 or 2 terminal columns:
+#   0 - Combining and enclosing marks (Mn, Me), format characters (Cf) except
+#       the soft hyphen, C1 control characters, surrogates and the Hangul
+#       medial vowels and final consonants (U+1160-U+11FF)
+#   2 - East Asian Wide (W) and Fullwidth (F) characters and the unassigned
+#       code points in the CJK planes 2 and 3
+#   1 - Everything else
+# The widths are packed 2 bits per code point in blocks of 256 code points and
+# identical blocks are shared.
+# ------------------------------------------------------------------------------------------------------------
+import sys
+import unicodedata
+
+MAXCP = 0x110000
+BLOCK = 256
+
+
+def width(cp):
+    if 0x1160 <= cp <= 0x11FF:
+        return 0
+    if 0x20000 <= cp <= 0x2FFFD or 0x30000 <= cp <= 0x3FFFD:
+        return 2
+    ch = chr(cp)
+    cat = unicodedata.category(ch)
+    if cp == 0x00AD:
+        return 1
+    if cat in ('Mn', 'Me', 'Cf', 'Cs') or (cat == 'Cc' and cp >= 0x80):
+        return 0
+    if unicodedata.east_asian_width(ch) in ('W', 'F'):
+        return 2
+    return 1
+
+
+blocks = []
+index = {}
+stage1 = []
+for b in range(MAXCP // BLOCK):
+    packed = bytearray(BLOCK // 4)
+    for i in range(BLOCK):
+        packed[i >> 2] |= width(b * BLOCK + i) << ((i & 3) * 2)
+    key = bytes(packed)
+    if key not in index:
+        index[key] = len(blocks)
+        blocks.append(key)
+    stage1.append(index[key])
+
+assert len(blocks) < 256
+
+out = sys.stdout
+out.write('''/* =========================================================================
+ * File:        uniwidth_tbl.c
+ * Description: Display width lookup table for Unicode code points.
+ *              GENERATED by bldscripts/gen_uniwidth.py from Unicode %s
+ *              DO NOT EDIT.
+ * Author:      Johan Persson (johan162@gmail.com)
+ *
+ * Copyright (C) 2021 Johan Persson
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>
+ * =========================================================================
+ */
+
+// Stage 1: Block number for each 256 code point page
+const unsigned char uw_stage1[%d] = {
+''' % (unicodedata.unidata_version, len(stage1)))
+for i in range(0, len(stage1), 16):
+    out.write('    ' + ', '.join('%3d' % v for v in stage1[i:i + 16]) + ',\n')
+out.write('};\n\n')
+out.write('// Stage 2: Widths packed 2 bits per code point, 4 code points per byte\n')
+out.write('const unsigned char uw_stage2[%d][%d] = {\n' % (len(blocks), BLOCK // 4))
+for blk in blocks:
+    out.write('    {\n')
+    for i in range(0, len(blk), 16):
+        out.write('        ' + ', '.join('0x%02x' % v for v in blk[i:i + 16]) + ',\n')
+    out.write('    },\n')
+out.write('};\n\n/* EOF */\n')
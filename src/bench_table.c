@@ -0,0 +1,512 @@
+// We want the full POSIX and C99 standard
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "config.h"
+#include "libunitbl/unicode_tbl.h"
+#include "libunitbl/xstr.h"
+
+/*
+ * Benchmark for building and stroking tables. Each workload builds a table
+ * with a given shape and content, strokes it repeatedly into a string
+ * buffer and reports the time per cell, the output throughput and the
+ * number of heap allocations done by the library.
+ *
+ * Run with "-c" to get CSV output that can be stored and compared between
+ * versions, e.g.
+ *   ./bench_table -c > bench-1.0.0.csv
+ */
+
+#define STROKEBUFF (64 * 1024 * 1024)
+
+/* ---------------------------------------------------------------------------
+ * Allocation counting. On Linux the bench is linked with --wrap for the
+ * allocation functions so every allocation made by the library passes
+ * through the wrappers below.
+ * ---------------------------------------------------------------------------
+ */
+static size_t nallocs = 0;
+
+#ifdef HAVE_LD_WRAP
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+char *__real_strdup(const char *s);
+
+void *__wrap_malloc(size_t size);
+void *__wrap_calloc(size_t n, size_t size);
+void *__wrap_realloc(void *p, size_t size);
+char *__wrap_strdup(const char *s);
+
+void *
+__wrap_malloc(size_t size) {
+  nallocs++;
+  return __real_malloc(size);
+}
+
+void *
+__wrap_calloc(size_t n, size_t size) {
+  nallocs++;
+  return __real_calloc(n, size);
+}
+
+void *
+__wrap_realloc(void *p, size_t size) {
+  nallocs++;
+  return __real_realloc(p, size);
+}
+
+char *
+__wrap_strdup(const char *s) {
+  nallocs++;
+  return __real_strdup(s);
+}
+#define ALLOCS() ((long)nallocs)
+#else
+#define ALLOCS() (-1L)
+#endif
+
+/* ---------------------------------------------------------------------------
+ * Workload definitions
+ * ---------------------------------------------------------------------------
+ */
+typedef enum {
+  TXT_ASCII, TXT_LATIN1, TXT_CJK
+} txtkind_t;
+
+typedef struct {
+  char *group;          // Which dimension this workload varies
+  size_t rows, cols;    // Table shape
+  size_t celllen;       // Number of characters in each cell
+  txtkind_t txt;        // Kind of text
+  tblstyle_t style;     // Table style
+  _Bool iv, ih;         // Interior lines
+  _Bool spans;          // Every other row has a cell spanning two columns
+  _Bool callback;       // Cell text set by table callback
+  _Bool cutpad;         // Padding policy
+  size_t pad;           // Left and right padding
+  _Bool generic;        // Stroke without the specialized row kernel
+  _Bool bulk;           // Build with one call to utable_set_n()
+} workload_t;
+
+static const char *txtkind_names[] = {"ascii", "latin1", "cjk"};
+
+static const char *style_names[] = {
+  "SIMPLE_V1", "SIMPLE_V2", "SIMPLE_V3", "SIMPLE_V4", "SIMPLE_V5", "SIMPLE_V6",
+  "ASCII_V0", "ASCII_V4", "ASCII_V1", "ASCII_V2", "ASCII_V3",
+  "DOUBLE_V1", "DOUBLE_V2", "DOUBLE_V3", "DOUBLE_V4",
+  "SINGLE_V1", "SINGLE_V2",
+  "HEAVY_V1", "HEAVY_V2", "HEAVY_V3"
+};
+
+#define BASE(_g) {_g, 1000, 8, 16, TXT_ASCII, TSTYLE_SINGLE_V2, TRUE, FALSE, FALSE, FALSE, FALSE, 1, FALSE, FALSE}
+
+static workload_t *workloads = NULL;
+static size_t nworkloads = 0;
+
+static void
+add_workload(workload_t w) {
+  workloads = realloc(workloads, (nworkloads + 1) * sizeof(workload_t));
+  if (NULL == workloads) {
+    fprintf(stderr, "Out of memory\n");
+    exit(EXIT_FAILURE);
+  }
+  workloads[nworkloads++] = w;
+}
+
+static void
+setup_workloads(void) {
+  const size_t rows[] = {10, 100, 1000, 2000};
+  const size_t cols[] = {2, 8, 32, 64};
+  const size_t lens[] = {4, 16, 64, 200};
+
+  for (size_t i = 0; i < sizeof(rows) / sizeof(rows[0]); i++) {
+    workload_t w = BASE("rows");
+    w.rows = rows[i];
+    add_workload(w);
+  }
+  for (size_t i = 0; i < sizeof(cols) / sizeof(cols[0]); i++) {
+    workload_t w = BASE("cols");
+    w.cols = cols[i];
+    w.rows = 8000 / cols[i];
+    add_workload(w);
+  }
+  for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+    workload_t w = BASE("celllen");
+    w.celllen = lens[i];
+    add_workload(w);
+  }
+  for (txtkind_t k = TXT_ASCII; k <= TXT_CJK; k++) {
+    workload_t w = BASE("text");
+    w.txt = k;
+    add_workload(w);
+  }
+  for (size_t s = 0; s < NBR_TSTYLES; s++) {
+    workload_t w = BASE("style");
+    w.style = table_styles[s];
+    add_workload(w);
+  }
+  for (int i = 0; i < 4; i++) {
+    workload_t w = BASE("interior");
+    w.iv = i & 1;
+    w.ih = (i >> 1) & 1;
+    add_workload(w);
+  }
+  {
+    workload_t w = BASE("spans");
+    w.spans = TRUE;
+    add_workload(w);
+  }
+  {
+    workload_t w = BASE("callback");
+    w.callback = TRUE;
+    add_workload(w);
+  }
+  for (int i = 0; i < 2; i++) {
+    workload_t w = BASE("padding");
+    w.pad = 3;
+    w.cutpad = i;
+    add_workload(w);
+  }
+  for (int i = 0; i < 4; i++) {
+    workload_t w = BASE("kernel");
+    w.ih = i & 1;
+    w.generic = (i >> 1) & 1;
+    add_workload(w);
+  }
+  for (int i = 0; i < 4; i++) {
+    workload_t w = BASE("build");
+    w.bulk = i & 1;
+    if (i >= 2) {
+      w.rows = 100000;
+      w.cols = 10;
+    }
+    add_workload(w);
+  }
+}
+
+/* ---------------------------------------------------------------------------
+ * Helpers
+ * ---------------------------------------------------------------------------
+ */
+static double
+now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * Create a cell text with "len" characters of the specified kind
+ */
+static void
+make_text(char *buff, size_t bufflen, txtkind_t kind, size_t len, size_t seed) {
+  static const char *latin1[] = {"Å", "Ä", "Ö", "å", "ä", "ö", "é", "ü"};
+  static const char *cjk[] = {"中", "文", "表", "格", "日", "本", "語", "字"};
+  size_t n = 0;
+  *buff = '\0';
+  for (size_t i = 0; i < len; i++) {
+    const size_t k = (i + seed) % 8;
+    if (kind == TXT_ASCII) {
+      if (n + 2 > bufflen) break;
+      buff[n++] = 'a' + (i + seed) % 26;
+      buff[n] = '\0';
+    } else {
+      const char *ch = kind == TXT_LATIN1 ? latin1[k] : cjk[k];
+      const size_t l = strlen(ch);
+      if (n + l + 1 > bufflen) break;
+      memcpy(buff + n, ch, l + 1);
+      n += l;
+    }
+  }
+}
+
+static size_t cb_len = 16;
+
+static char *
+bench_cb(int r, int c, void *tag) {
+  static char buff[1024];
+  (void)tag;
+  make_text(buff, sizeof(buff), TXT_ASCII, cb_len, r * 31 + c);
+  return buff;
+}
+
+/**
+ * Build the table with all texts set in one call. The texts are made into
+ * an array first, which adds two allocations to the build.
+ */
+static int
+build_bulk(table_t *t, const workload_t *w) {
+  const size_t n = w->rows * w->cols;
+  const size_t tl = w->celllen * 3 + 1;
+  const char **data = calloc(n + 1, sizeof(char *));
+  char *txt = malloc(n * tl + 1);
+  if (NULL == data || NULL == txt) {
+    free(data);
+    free(txt);
+    return -1;
+  }
+  for (size_t r = 0; r < w->rows; r++) {
+    for (size_t c = 0; c < w->cols; c++) {
+      if (w->spans && (r & 1) && c == 1) continue;
+      if (!w->callback || r == 0) {
+        char *p = txt + (r * w->cols + c) * tl;
+        make_text(p, tl, w->txt, w->celllen, r * 31 + c);
+        data[r * w->cols + c] = p;
+      }
+    }
+  }
+  const int ret = utable_set_n(t, data, NULL, ROW_MAJOR);
+  free(data);
+  free(txt);
+  return ret;
+}
+
+static table_t *
+build_table(const workload_t *w) {
+  char buff[1024];
+  table_t *t = utable_create(w->rows, w->cols);
+  if (NULL == t) return NULL;
+  if (w->bulk && build_bulk(t, w)) {
+    utable_free(t);
+    return NULL;
+  }
+  for (size_t r = 0; r < w->rows; r++) {
+    for (size_t c = 0; c < w->cols; c++) {
+      if (w->bulk || (w->spans && (r & 1) && c == 1)) continue;
+      if (!w->callback || r == 0) {
+        make_text(buff, sizeof(buff), w->txt, w->celllen, r * 31 + c);
+        utable_set_cell(t, r, c, buff);
+      }
+    }
+    if (w->spans && (r & 1) && w->cols > 1)
+      utable_set_cell_colspan(t, r, 0, 2);
+  }
+  if (w->callback) {
+    cb_len = w->celllen;
+    utable_set_table_cellcallback(t, bench_cb);
+  }
+  utable_set_table_cellpadding(t, w->pad, w->pad);
+  utable_set_interior(t, w->iv, w->ih);
+  utable_set_title(t, "Benchmark table", TITLESTYLE_LINE);
+  return t;
+}
+
+typedef struct {
+  double build_ns;      // Time to build the table
+  double stroke_ns;     // Mean time for one stroke
+  size_t bytes;         // Output size of one stroke
+  long build_allocs;    // Allocations while building
+  long stroke_allocs;   // Allocations in one stroke
+  int reps;             // Number of strokes timed
+} result_t;
+
+static int
+run_workload(const workload_t *w, char *out, double mintime, result_t *res) {
+  long a0 = ALLOCS();
+  double t0 = now_ns();
+  table_t *t = build_table(w);
+  res->build_ns = now_ns() - t0;
+  res->build_allocs = ALLOCS() - a0;
+  if (NULL == t) return -1;
+
+  utable_set_padding_policy(w->cutpad);
+  utable_set_fast_render(t, !w->generic);
+
+  // One untimed stroke to fix the column widths
+  if (-1 == utable_strstroke(t, out, STROKEBUFF, w->style)) {
+    utable_free(t);
+    utable_set_padding_policy(FALSE);
+    return -1;
+  }
+  res->bytes = strlen(out);
+
+  res->reps = 0;
+  a0 = ALLOCS();
+  t0 = now_ns();
+  double elapsed = 0;
+  do {
+    utable_strstroke(t, out, STROKEBUFF, w->style);
+    res->reps++;
+    elapsed = now_ns() - t0;
+  } while (elapsed < mintime * 1e9 || res->reps < 3);
+  res->stroke_ns = elapsed / res->reps;
+  res->stroke_allocs = (ALLOCS() - a0) / res->reps;
+
+  utable_free(t);
+  utable_set_padding_policy(FALSE);
+  return 0;
+}
+
+/* ---------------------------------------------------------------------------
+ * Display width micro benchmark, utf8len() versus xmb_width()
+ * ---------------------------------------------------------------------------
+ */
+static void
+run_width(int csv, double mintime, table_t *rt, size_t *rtrow) {
+  char buff[4096];
+  for (txtkind_t k = TXT_ASCII; k <= TXT_CJK; k++) {
+    make_text(buff, sizeof(buff), k, 64, 0);
+    const size_t len = strlen(buff);
+    for (int f = 0; f < 2; f++) {
+      volatile size_t acc = 0;
+      long reps = 0;
+      double t0 = now_ns(), elapsed;
+      do {
+        for (int i = 0; i < 1000; i++)
+          acc += f == 0 ? utf8len(buff) : xmb_width(buff);
+        reps += 1000;
+        elapsed = now_ns() - t0;
+      } while (elapsed < mintime * 1e9);
+      const double ns = elapsed / reps;
+      const char *fn = f == 0 ? "utf8len" : "xmb_width";
+      if (csv) {
+        printf("%s,width,%s/%s,0,0,64,%s,-,0,0,0,0,0,0,0,0,%.3f,%.3f,%.2f,0,0\n",
+               PACKAGE_VERSION, fn, txtkind_names[k], txtkind_names[k],
+               ns, ns, len / ns * 1e9 / 1e6);
+      } else if (rt) {
+        char cbuff[64];
+        snprintf(cbuff, sizeof(cbuff), "%s/%s", fn, txtkind_names[k]);
+        utable_set_cell(rt, *rtrow, 0, "width");
+        utable_set_cell(rt, *rtrow, 1, cbuff);
+        for (int c = 2; c < 8; c++) utable_set_cell(rt, *rtrow, c, "-");
+        snprintf(cbuff, sizeof(cbuff), "%.2f", ns);
+        utable_set_cell(rt, *rtrow, 3, cbuff);
+        snprintf(cbuff, sizeof(cbuff), "%.1f", len / ns * 1e9 / 1e6);
+        utable_set_cell(rt, *rtrow, 4, cbuff);
+        (*rtrow)++;
+      }
+    }
+  }
+}
+
+static void
+usage(void) {
+  fprintf(stderr,
+          "Usage: bench_table [-c] [-g group] [-t mintime]\n"
+          "  -c          Output CSV (machine readable)\n"
+          "  -g group    Only run workloads in this group\n"
+          "  -t mintime  Minimum time in seconds to run each workload (0.2)\n");
+}
+
+int
+main(int argc, char **argv) {
+  int csv = 0, opt;
+  char *group = NULL;
+  double mintime = 0.2;
+
+  while ((opt = getopt(argc, argv, "cg:t:h")) != -1) {
+    switch (opt) {
+      case 'c':
+        csv = 1;
+        break;
+      case 'g':
+        group = optarg;
+        break;
+      case 't':
+        mintime = atof(optarg);
+        break;
+      default:
+        usage();
+        exit(EXIT_FAILURE);
+    }
+  }
+
+  setup_workloads();
+  char *out = malloc(STROKEBUFF);
+  if (NULL == out) {
+    fprintf(stderr, "Out of memory\n");
+    exit(EXIT_FAILURE);
+  }
+
+  // Human readable results are collected in a table of their own
+  char *hdr[] = {"Group", "Workload", "Cells", "ns/cell", "MB/s",
+                 "Build ns/cell", "Build allocs", "Stroke allocs"};
+  table_t *rt = NULL;
+  size_t rtrow = 1;
+  if (csv) {
+    printf("version,group,workload,rows,cols,celllen,text,style,iv,ih,spans,"
+           "callback,cutpad,pad,generic,bulk,ns_per_cell,build_ns_per_cell,mb_per_s,"
+           "build_allocs,stroke_allocs\n");
+  } else {
+    size_t nrows = 1;
+    for (size_t i = 0; i < nworkloads; i++)
+      if (NULL == group || 0 == strcmp(group, workloads[i].group)) nrows++;
+    if (NULL == group || 0 == strcmp(group, "width")) nrows += 6;
+    rt = utable_create(nrows, 8);
+    utable_set_coltitles(rt, hdr);
+    for (int c = 2; c < 8; c++) utable_set_col_halign(rt, c, RIGHTALIGN);
+    utable_set_row_halign(rt, 0, CENTERALIGN);
+    utable_set_table_cellpadding(rt, 1, 1);
+    utable_set_interior(rt, TRUE, FALSE);
+    char title[128];
+    snprintf(title, sizeof(title), "libunitbl %s benchmark", PACKAGE_VERSION);
+    utable_set_title(rt, title, TITLESTYLE_LINE);
+  }
+
+  for (size_t i = 0; i < nworkloads; i++) {
+    const workload_t *w = &workloads[i];
+    if (group && strcmp(group, w->group)) continue;
+
+    result_t res;
+    if (run_workload(w, out, mintime, &res)) {
+      fprintf(stderr, "Workload %zu failed\n", i);
+      continue;
+    }
+    const double cells = (double)w->rows * w->cols;
+    char name[128];
+    snprintf(name, sizeof(name), "%zux%zu/%zu/%s/%s%s%s%s%s%s%s%s",
+             w->rows, w->cols, w->celllen, txtkind_names[w->txt],
+             style_names[w->style], w->iv ? "/iv" : "", w->ih ? "/ih" : "",
+             w->spans ? "/spans" : "", w->callback ? "/cb" : "",
+             w->pad > 1 ? (w->cutpad ? "/cutpad" : "/keeppad") : "",
+             w->generic ? "/generic" : "", w->bulk ? "/bulk" : "");
+
+    if (csv) {
+      printf("%s,%s,%s,%zu,%zu,%zu,%s,%s,%d,%d,%d,%d,%d,%zu,%d,%d,%.3f,%.3f,%.2f,"
+             "%ld,%ld\n",
+             PACKAGE_VERSION, w->group, name, w->rows, w->cols, w->celllen,
+             txtkind_names[w->txt], style_names[w->style], w->iv, w->ih,
+             w->spans, w->callback, w->cutpad, w->pad, w->generic, w->bulk,
+             res.stroke_ns / cells, res.build_ns / cells,
+             res.bytes / res.stroke_ns * 1e9 / 1e6,
+             res.build_allocs, res.stroke_allocs);
+      fflush(stdout);
+    } else {
+      char cbuff[64];
+      utable_set_cell(rt, rtrow, 0, w->group);
+      utable_set_cell(rt, rtrow, 1, name);
+      snprintf(cbuff, sizeof(cbuff), "%.0f", cells);
+      utable_set_cell(rt, rtrow, 2, cbuff);
+      snprintf(cbuff, sizeof(cbuff), "%.1f", res.stroke_ns / cells);
+      utable_set_cell(rt, rtrow, 3, cbuff);
+      snprintf(cbuff, sizeof(cbuff), "%.1f", res.bytes / res.stroke_ns * 1e9 / 1e6);
+      utable_set_cell(rt, rtrow, 4, cbuff);
+      snprintf(cbuff, sizeof(cbuff), "%.1f", res.build_ns / cells);
+      utable_set_cell(rt, rtrow, 5, cbuff);
+      snprintf(cbuff, sizeof(cbuff), "%ld", res.build_allocs);
+      utable_set_cell(rt, rtrow, 6, cbuff);
+      snprintf(cbuff, sizeof(cbuff), "%ld", res.stroke_allocs);
+      utable_set_cell(rt, rtrow, 7, cbuff);
+      rtrow++;
+    }
+  }
+
+  if (NULL == group || 0 == strcmp(group, "width"))
+    run_width(csv, mintime, rt, &rtrow);
+
+  if (rt) {
+    utable_stroke(rt, STDOUT_FILENO, TSTYLE_SINGLE_V2);
+    utable_free(rt);
+  }
+
+  free(out);
+  free(workloads);
+  exit(EXIT_SUCCESS);
+}
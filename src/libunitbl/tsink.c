@@ -0,0 +1,318 @@
+/* =========================================================================
+ * File:        tsink.c
+ * Description: Output sink used when stroking a table
+ * Author:      Johan Persson (johan162@gmail.com)
+ *
+ * Copyright (C) 2021 Johan Persson
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>
+ * =========================================================================
+ */
+
+// We want the full POSIX and C99 standard
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tsink.h"
+
+// Size of the buffer used when writing to a file descriptor
+#define TSINK_FDBUFF (64 * 1024)
+
+// Initial size of a growing buffer
+#define TSINK_GROWBUFF 4096
+
+/**
+ * Initialize a sink that writes to a fixed buffer. The output is always kept
+ * NULL terminated so one byte of the buffer is reserved for the terminator.
+ * @param s Sink
+ * @param buf Buffer
+ * @param size Size of buffer in bytes, must be at least 1
+ */
+void
+tsink_init_buf(tsink_t *s, char *buf, size_t size) {
+    memset(s, 0, sizeof(*s));
+    s->buf = buf;
+    s->size = size - 1;
+    s->fd = -1;
+    s->term = 1;
+    *buf = '\0';
+}
+
+/**
+ * Initialize a sink that writes to a fixed area of memory, e.g. a mapped
+ * file. The output is not NULL terminated so all of the area can be used.
+ * @param s Sink
+ * @param buf Start of memory
+ * @param size Size of memory in bytes
+ */
+void
+tsink_init_mem(tsink_t *s, char *buf, size_t size) {
+    memset(s, 0, sizeof(*s));
+    s->buf = buf;
+    s->size = size;
+    s->fd = -1;
+}
+
+/**
+ * Initialize a sink that only counts the number of bytes written. The
+ * output goes to a small buffer that is emptied when full, so the common
+ * case is as fast as for the other sinks.
+ * @param s Sink
+ * @return 0 on success, -1 on failure
+ */
+int
+tsink_init_count(tsink_t *s) {
+    memset(s, 0, sizeof(*s));
+    s->fd = -1;
+    s->discard = 1;
+    s->buf = malloc(TSINK_FDBUFF);
+    if (NULL == s->buf) return -1;
+    s->size = TSINK_FDBUFF;
+    return 0;
+}
+
+/**
+ * Initialize a sink that keeps all output in a buffer that grows when it is
+ * full. The buffer is released by tsink_close().
+ * @param s Sink
+ * @return 0 on success, -1 on failure
+ */
+int
+tsink_init_grow(tsink_t *s) {
+    memset(s, 0, sizeof(*s));
+    s->fd = -1;
+    s->grow = 1;
+    s->buf = malloc(TSINK_GROWBUFF);
+    if (NULL == s->buf) return -1;
+    s->size = TSINK_GROWBUFF;
+    return 0;
+}
+
+/**
+ * Initialize a sink that gives the output to a function through a buffer.
+ * The function is called with the bytes and the context and returns 0 on
+ * success. A non zero return value fails the sink.
+ * @param s Sink
+ * @param cb Function to give the output to
+ * @param ctx Context given to the function
+ * @return 0 on success, -1 on failure
+ */
+int
+tsink_init_cb(tsink_t *s, int (*cb)(const char *, size_t, void *),
+              void *ctx) {
+    memset(s, 0, sizeof(*s));
+    s->fd = -1;
+    s->cb = cb;
+    s->ctx = ctx;
+    s->buf = malloc(TSINK_FDBUFF);
+    if (NULL == s->buf) return -1;
+    s->size = TSINK_FDBUFF;
+    return 0;
+}
+
+/**
+ * Initialize a sink that writes to a file descriptor through a buffer
+ * @param s Sink
+ * @param fd File descriptor
+ * @return 0 on success, -1 on failure
+ */
+int
+tsink_init_fd(tsink_t *s, int fd) {
+    memset(s, 0, sizeof(*s));
+    s->fd = fd;
+    s->buf = malloc(TSINK_FDBUFF);
+    if (NULL == s->buf) return -1;
+    s->size = TSINK_FDBUFF;
+    return 0;
+}
+
+/**
+ * Internal helper to write all bytes to the file descriptor or function. For
+ * a non-blocking sink the writing stops when the descriptor is not writable.
+ * @param s Sink
+ * @param p Bytes to write
+ * @param n Number of bytes
+ * @return Number of bytes written
+ */
+static size_t
+_tsink_writefd(tsink_t *s, const char *p, size_t n) {
+    struct timespec t0, t1;
+    size_t done = 0;
+    if (s->cb) {
+        if (n && s->cb(p, n, s->ctx)) {
+            s->err = 1;
+            return 0;
+        }
+        s->flushed += n;
+        return n;
+    }
+    if (s->timed) clock_gettime(CLOCK_MONOTONIC, &t0);
+    s->blocked = 0;
+    while (done < n && !s->err) {
+        const ssize_t ret = write(s->fd, p + done, n - done);
+        if (ret < 0) {
+            if (s->nonblock && (EAGAIN == errno || EWOULDBLOCK == errno)) {
+                s->blocked = 1;
+                break;
+            }
+            if (EINTR != errno) s->err = 1;
+            continue;
+        }
+        done += ret;
+        s->flushed += ret;
+    }
+    if (s->timed) {
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        s->ns_write += (t1.tv_sec - t0.tv_sec) * 1000000000ULL +
+                       t1.tv_nsec - t0.tv_nsec;
+    }
+    return done;
+}
+
+/**
+ * Internal helper to grow the buffer so that more bytes fit
+ * @param s Sink
+ * @param n Number of bytes that must fit after the current length
+ * @return 0 on success, -1 on failure
+ */
+static int
+_tsink_grow(tsink_t *s, size_t n) {
+    size_t size = 2 * s->size;
+    while (size < s->len + n) size *= 2;
+    char *buf = realloc(s->buf, size);
+    if (NULL == buf) {
+        s->err = 1;
+        return -1;
+    }
+    s->buf = buf;
+    s->size = size;
+    return 0;
+}
+
+/**
+ * Append bytes that do not fit in the buffer. Called from tsink_write()
+ * @param s Sink
+ * @param p Bytes to append
+ * @param n Number of bytes
+ */
+void
+tsink_write_slow(tsink_t *s, const char *p, size_t n) {
+    if (s->err) return;
+    if (s->discard) {
+        // Count what is in the buffer and start over
+        s->flushed += s->len;
+        s->len = 0;
+        if (n > s->size) {
+            s->flushed += n;
+        } else {
+            memcpy(s->buf, p, n);
+            s->len = n;
+        }
+        return;
+    }
+    if (s->grow) {
+        if (_tsink_grow(s, n)) return;
+        memcpy(s->buf + s->len, p, n);
+        s->len += n;
+        return;
+    }
+    if (s->fd < 0 && NULL == s->cb) {
+        // A fixed buffer that is full, keep what fits
+        const size_t fit = s->size - s->len;
+        memcpy(s->buf + s->len, p, fit);
+        s->len += fit;
+        s->err = 1;
+        return;
+    }
+    // A blocked sink does not try to write again until it is flushed
+    if (!s->blocked) tsink_flush(s);
+    if (s->err) return;
+    if (n > s->size - s->len) {
+        if (!s->nonblock) {
+            // The buffer is empty after the flush
+            _tsink_writefd(s, p, n);
+            return;
+        }
+        // Keep the output that could not be written
+        if (_tsink_grow(s, n)) return;
+    }
+    memcpy(s->buf + s->len, p, n);
+    s->len += n;
+}
+
+/**
+ * Append a character repeated a number of times
+ * @param s Sink
+ * @param c Character
+ * @param n Number of times
+ */
+void
+tsink_fill(tsink_t *s, char c, size_t n) {
+    while (n > 0 && !s->err) {
+        if (s->len == s->size) {
+            tsink_write_slow(s, &c, 1);
+            n--;
+            continue;
+        }
+        const size_t k = n < s->size - s->len ? n : s->size - s->len;
+        memset(s->buf + s->len, c, k);
+        s->len += k;
+        n -= k;
+    }
+}
+
+/**
+ * Flush the buffer. For a file descriptor sink the buffer is written and
+ * emptied, for a fixed buffer the output is NULL terminated and a counting
+ * sink counts and empties the buffer.
+ * @param s Sink
+ * @return 0 on success, -1 if the sink has failed
+ */
+int
+tsink_flush(tsink_t *s) {
+    if (s->discard) {
+        s->flushed += s->len;
+        s->len = 0;
+    } else if (s->fd < 0 && NULL == s->cb) {
+        if (s->term) s->buf[s->len] = '\0';
+    } else if (!s->err) {
+        const size_t done = _tsink_writefd(s, s->buf, s->len);
+        // Only a non-blocking sink can have output left
+        if (done < s->len && !s->err)
+            memmove(s->buf, s->buf + done, s->len - done);
+        s->len -= done;
+    }
+    return s->err ? -1 : 0;
+}
+
+/**
+ * Flush and release the resources used by the sink
+ * @param s Sink
+ * @return 0 on success, -1 if the sink has failed
+ */
+int
+tsink_close(tsink_t *s) {
+    const int ret = tsink_flush(s);
+    if (s->fd >= 0 || s->cb || s->discard || s->grow) {
+        free(s->buf);
+        s->buf = NULL;
+    }
+    return ret;
+}
+
+/* EOF */
@@ -0,0 +1,125 @@
+/* =========================================================================
+ * File:        tsink.h
+ * Description: Output sink used when stroking a table. Output is appended
+ *              to a buffer that is either fixed or flushed to a file
+ *              descriptor when full.
+ * Author:      Johan Persson (johan162@gmail.com)
+ *
+ * Copyright (C) 2021 Johan Persson
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>
+ * =========================================================================
+ */
+
+#ifndef TSINK_H
+#define	TSINK_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <string.h>
+
+/**
+ * Output sink. All output functions append at the end of the buffer in
+ * constant time per byte. When the buffer is full it is either flushed to
+ * the file descriptor or function or, for a fixed buffer, the sink is
+ * marked as failed.
+ * Once failed all further output is discarded. A sink for a non-blocking
+ * file descriptor instead keeps the output that could not be written and
+ * grows the buffer until it is flushed again. A counting sink discards
+ * the output and only keeps the number of bytes and a growing sink keeps
+ * all output in memory.
+ */
+typedef struct {
+    char *buf;          //!< Output buffer
+    size_t size;        //!< Usable size of the buffer
+    size_t len;         //!< Number of bytes in the buffer
+    size_t flushed;     //!< Number of bytes already flushed to the file descriptor
+    int fd;             //!< File descriptor to flush to, -1 for a fixed buffer
+    int (*cb)(const char *, size_t, void *);    //!< Function to flush to instead of a file descriptor
+    void *ctx;          //!< Argument to the flush function
+    _Bool err;          //!< The sink ran out of space or a write failed
+    _Bool term;         //!< Keep the fixed buffer NULL terminated
+    _Bool discard;      //!< Only count the output, the buffer is reused
+    _Bool grow;         //!< Grow the buffer instead of failing when it is full
+    _Bool nonblock;     //!< Keep the output when the file descriptor is not writable
+    _Bool blocked;      //!< The last write would have blocked
+    _Bool timed;        //!< Measure the time spent in write()
+    unsigned long long ns_write;    //!< Time spent in write() if timed
+} tsink_t;
+
+void tsink_init_buf(tsink_t *s, char *buf, size_t size);
+
+void tsink_init_mem(tsink_t *s, char *buf, size_t size);
+
+int tsink_init_count(tsink_t *s);
+
+int tsink_init_grow(tsink_t *s);
+
+int tsink_init_cb(tsink_t *s, int (*cb)(const char *, size_t, void *),
+                  void *ctx);
+
+int tsink_init_fd(tsink_t *s, int fd);
+
+void tsink_write_slow(tsink_t *s, const char *p, size_t n);
+
+void tsink_fill(tsink_t *s, char c, size_t n);
+
+int tsink_flush(tsink_t *s);
+
+int tsink_close(tsink_t *s);
+
+/**
+ * Append bytes to the sink
+ * @param s Sink
+ * @param p Bytes to append
+ * @param n Number of bytes
+ */
+static inline void
+tsink_write(tsink_t *s, const char *p, size_t n) {
+    if (n <= s->size - s->len) {
+        // The text of an empty cell is NULL which memcpy() must not be given
+        if (n) memcpy(s->buf + s->len, p, n);
+        s->len += n;
+    } else {
+        tsink_write_slow(s, p, n);
+    }
+}
+
+/**
+ * Append a NULL terminated string to the sink
+ * @param s Sink
+ * @param str String to append
+ */
+static inline void
+tsink_puts(tsink_t *s, const char *str) {
+    tsink_write(s, str, strlen(str));
+}
+
+/**
+ * Get the total number of bytes written to the sink
+ * @param s Sink
+ * @return Number of bytes
+ */
+static inline size_t
+tsink_total(const tsink_t *s) {
+    return s->flushed + s->len;
+}
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* TSINK_H */
@@ -26,7 +26,15 @@
 #define _GNU_SOURCE
 
 #include <stdio.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/mman.h>
 #include <sys/param.h>  // To get MIN/MAX
+#include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
 //#include <stdlib.h>
@@ -34,15 +42,71 @@
 //#include <syslog.h>
 
 #include "unicode_tbl.h"
+#include "tsink.h"
 #include "xstr.h"
 
 // Always nice to have
 #define FALSE 0
 #define TRUE 1
 
-// Utility macro to index table matrix
+// Utility macro to number the cells in row order, used as the key of a
+// cell in the override map
 #define TIDX(_r, _c) ((_r)*t->nCol + (_c))
 
+// Utility macro to get a cell
+#define TCELL(_r, _c) (t->row[_r][_c])
+
+// Utility macro to get the row drawn at a position after the table has been
+// sorted
+#define TROW(_r) (t->rowmap ? t->rowmap[_r] : (_r))
+
+// Cell state flags
+#define CELL_MERGED 0x01    // Cell is covered by a column span
+#define CELL_OVR 0x02       // Cell has an entry in the override map
+#define CELL_CBTXT 0x04     // Cell text was produced by a callback
+#define CELL_EXTERN 0x08    // Cell text references memory not owned by the
+                            // table and is not NULL terminated
+#define CELL_SHARED 0x10    // Cell text is owned by a snapshot chunk
+#define CELL_BLOCK 0x20     // Cell text is in the text block of the table
+
+// Cells with a text that is not freed with the cell
+#define CELL_BORROWED (CELL_EXTERN | CELL_SHARED | CELL_BLOCK)
+
+// Mark in a line for a position inside a cell that spans the rows on both
+// sides of the line
+#define EVAL_GAP 4
+
+// Number of rows in each chunk of cells that is shared between snapshots
+#define SNAP_ROWS 64
+
+// Size of the buffer for the formatted footer text of one column
+#define AGG_TEXT_SIZE 64
+
+// Stroke statistics helpers. The clock is only read and the counters only
+// updated when statistics have been enabled with utable_enable_stats()
+#define STATS_START(_t, _ts) \
+    unsigned long long _ts = (_t)->stats ? _utable_now_ns() : 0
+#define STATS_LAP(_t, _field, _ts)                              \
+    do {                                                        \
+        if ((_t)->stats) {                                      \
+            const unsigned long long _now = _utable_now_ns();   \
+            (_t)->stats->_field += _now - (_ts);                \
+            (_ts) = _now;                                       \
+        }                                                       \
+    } while (0)
+#define STATS_COUNT(_t, _field, _n)                     \
+    do {                                                \
+        if ((_t)->stats) (_t)->stats->_field += (_n);   \
+    } while (0)
+
+// Process wide memory accounting for all live tables. Tables may be created
+// and destroyed concurrently in different threads so the counters are only
+// updated atomically.
+static size_t _live_tables = 0;
+static size_t _live_bytes = 0;
+#define MEM_ADD(_n) __atomic_add_fetch(&_live_bytes, (_n), __ATOMIC_RELAXED)
+#define MEM_SUB(_n) __atomic_sub_fetch(&_live_bytes, (_n), __ATOMIC_RELAXED)
+
 #define LOGPREFIXSIZE 80
 #define LOGBUFFERSIZE 256
 
@@ -79,6 +143,17 @@ logmsg(char *msg) {
     }
 }
 
+/**
+ * Read the monotonic clock
+ * @return Current time in nanoseconds
+ */
+static unsigned long long
+_utable_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
 /**
  * Check that row and col arguments are within valid range before accessing
  * cells
@@ -90,9 +165,9 @@ logmsg(char *msg) {
 static int
 _utable_rc_chk(table_t *t, size_t row, size_t col) {
     if (row >= t->nRow || col >= t->nCol) {
-        char buffer[80];
-        snprintf(buffer, 79, "Table cell specified is out of range [%zu, %zu]",
-                 row, col);
+        char buffer[128];
+        snprintf(buffer, sizeof(buffer),
+                 "Table cell specified is out of range [%zu, %zu]", row, col);
         logmsg(buffer);
         return -1;
     }
@@ -100,973 +175,5557 @@ _utable_rc_chk(table_t *t, size_t row, size_t col) {
 }
 
 /**
- * Initialize a new cell
+ * Check that the column argument is within valid range
  * @param t Table pointer
- * @param row Row of cell
- * @param col Column of cell
+ * @param col Column
+ * @return 0 on valid range, -1 otherwise
  */
-static void
-_utable_init_cell(table_t *t, size_t row, size_t col) {
-    tcell_t *c = &t->c[TIDX(row, col)];
-    c->t = NULL;
-    c->halign = LEFTALIGN;
-    c->pRow = row;
-    c->pCol = col;
-    c->merged = FALSE;
-    c->cspan = 1;
-    c->rspan = 1;
+static int
+_utable_col_chk(table_t *t, size_t col) {
+    if (col >= t->nCol) {
+        char buffer[128];
+        snprintf(buffer, sizeof(buffer),
+                 "Table column specified is out of range [%zu]", col);
+        logmsg(buffer);
+        return -1;
+    }
+    return 0;
 }
 
 /**
- * Create a new table of the specified size
- * @param nRow Number of rows
- * @param nCol Number of cols
- * @return NULL on error , pointer to the newly created table otherwise
+ * A block of SNAP_ROWS rows copied from a table when a snapshot is made. The
+ * chunk is shared by all snapshots made while none of its rows changed, and
+ * by the table itself so the next snapshot can reuse it.
  */
-table_t *
-utable_create(size_t nRow, size_t nCol) {
-    table_t *t = calloc(1, sizeof(table_t));
-    if (NULL == t) return NULL;
-    t->nRow = nRow;
-    t->nCol = nCol++;
-    t->headerLine = TRUE;
-
-    ++nRow;
-    // We allocate one extra row in case a title should be displayed
-    t->c = calloc(nRow * nCol, sizeof(tcell_t));
-    t->colwidth = calloc(nCol, sizeof(size_t));
-    t->mincolwidth = calloc(nCol, sizeof(size_t));
-    if (t->c == NULL || t->colwidth == NULL || t->mincolwidth == NULL) {
-        logmsg("CRITICAL : Failed to create table. Out of memory.");
-        free(t->c);
-        free(t->colwidth);
-        free(t->mincolwidth);
-        free(t);
-        return NULL;
-    }
-
-    for (size_t r = 0; r < nRow; r++) {
-        for (size_t c = 0; c < nCol; c++) {
-            _utable_init_cell(t, r, c);
-        }
-    }
-
-    return t;
-}
+typedef struct tchunk {
+    size_t refs;        // Number of tables that hold the chunk
+    size_t size;        // Allocated size in bytes
+    size_t *w;          // Widest cell including padding in each column
+    tcell_t c[];        // Cells of the rows in the chunk, followed by the
+                        // widths and the texts
+} tchunk_t;
 
 /**
- * Initialize the table with string from a matrix. It is the calling routines
- * responsibility that the size of the data matrix matches that of the table.
+ * Internal helper to note that a row has changed so that its chunk is copied
+ * again by the next snapshot
  * @param t Table pointer
- * @param data A matrix of data to be used as initialization
- * @return 0 on success, -1 on failure
+ * @param row Row that has changed
  */
-int
-utable_set(table_t *t, char *data[]) {
-    for (size_t r = 0; r < t->nRow; r++) {
-        for (size_t c = 0; c < t->nCol; c++) {
-            if (utable_set_cell(t, r, c, data[TIDX(r, c)])) return -1;
-        }
-    }
-    return 0;
+static inline void
+_utable_snap_touch(table_t *t, size_t row) {
+    if (t->chunkDirty) t->chunkDirty[row / SNAP_ROWS] = TRUE;
 }
 
 /**
- * Combine table creation and initialization with error check
+ * Internal helper to note that the widths of all rows may have changed
  * @param t Table pointer
- * @param nRow Number of rows
- * @param nCol Number of cols
- * @param data A matrix of data to be used as initialization
- * @return NULL on failure, pointer to new table otherwise
  */
-table_t *
-utable_create_set(size_t nRow, size_t nCol, char *data[]) {
-    table_t *t = utable_create(nRow, nCol);
-    if (NULL == t) {
-        return NULL;
-    }
-    if (-1 == utable_set(t, data)) {
-        utable_free(t);
-        return NULL;
-    }
-    return t;
+static void
+_utable_snap_touch_all(table_t *t) {
+    if (t->chunkDirty) memset(t->chunkDirty, TRUE, t->nRow / SNAP_ROWS + 1);
 }
 
 /**
- * Set the title row
- * @param t Table pointer
- * @param nRow Number of rows
- * @param nCol Number of cols
- * @param data A matrix of data to be used as initialization
- * @return NULL on failure, pointer to new table otherwise
+ * Internal helper to drop a reference to a chunk and free it when it was
+ * the last one. This can be called from any thread.
+ * @param k Chunk, may be NULL
  */
-int
-utable_set_coltitles(table_t *t, char *titles[]) {
-    int row = 0;
-    if (t->titleCopied) row = 1;
-    for (size_t c = 0; c < t->nCol; c++) {
-        if (utable_set_cell(t, row, c, titles[c])) return -1;
+static void
+_utable_chunk_release(tchunk_t *k) {
+    if (k && 0 == __atomic_sub_fetch(&k->refs, 1, __ATOMIC_ACQ_REL)) {
+        MEM_SUB(k->size);
+        free(k);
     }
-    return 0;
 }
 
 /**
- * Free (destroy) a previously created table
+ * Hash a cell key to a slot in the override map. The map size is always
+ * a power of two.
  * @param t Table pointer
+ * @param key Cell key
+ * @return Slot index
  */
-void
-utable_free(table_t *t) {
-    for (size_t r = 0; r < t->nRow; r++) {
-        for (size_t c = 0; c < t->nCol; c++) {
-            if (t->c[TIDX(r, c)].t) {
-                free(t->c[TIDX(r, c)].t);
-            }
-        }
-    }
-    free(t->c);
-    free(t->colwidth);
-    free(t->mincolwidth);
-    free(t->title);
-    free(t);
+static inline size_t
+_utable_ovr_slot(table_t *t, size_t key) {
+    // Fibonacci hashing spreads row-major neighbours over the map
+    return (key * (size_t) 0x9E3779B97F4A7C15ULL) & (t->ovrSize - 1);
 }
 
 /**
- * Set a title to the table. How the title is displayed is determined
- * by the table style.
+ * Insert an already populated entry in the override map. There must be
+ * room in the map.
  * @param t Table pointer
- * @param title
+ * @param e Entry to insert
+ * @return Pointer to the entry in the map
  */
-void
-utable_set_title(table_t *t, char *title, titlestyle_t style) {
-    if (t->title) free(t->title);
-    t->title = strdup(title);
-    t->titleStyle = style;
+static tovr_t *
+_utable_ovr_put(table_t *t, const tovr_t *e) {
+    size_t i = _utable_ovr_slot(t, e->key);
+    while (t->ovr[i].key && t->ovr[i].key != e->key) {
+        i = (i + 1) & (t->ovrSize - 1);
+    }
+    if (0 == t->ovr[i].key) t->ovrUsed++;
+    t->ovr[i] = *e;
+    return &t->ovr[i];
 }
 
 /**
- * Enable or disable the extra line below the header row (the first row in the
- * data). The style of the line is determined by the table style. The hedaer
- * line is by default enabled when the table is created.
+ * Rebuild the override map into a new map of the specified size. The
+ * key of every entry is moved by "shift" cells.
  * @param t Table pointer
- * @param headerLine Flag to disable/enable header
+ * @param size New number of slots (power of two)
+ * @param shift Number of cells to move each entry
+ * @return 0 on success, -1 on failure
  */
-void
-utable_set_headerline(table_t *t, _Bool headerLine) {
-    t->headerLine = headerLine;
+static int
+_utable_ovr_rehash(table_t *t, size_t size, size_t shift) {
+    tovr_t *old = t->ovr;
+    const size_t oldsize = t->ovrSize;
+    tovr_t *n = calloc(size, sizeof(tovr_t));
+    if (NULL == n) {
+        logmsg("CRITICAL : Failed to grow cell override map. Out of memory.");
+        return -1;
+    }
+    MEM_ADD(size * sizeof(tovr_t));
+    MEM_SUB(oldsize * sizeof(tovr_t));
+    t->ovr = n;
+    t->ovrSize = size;
+    t->ovrUsed = 0;
+    for (size_t i = 0; i < oldsize; i++) {
+        if (old[i].key) {
+            old[i].key += shift;
+            _utable_ovr_put(t, &old[i]);
+        }
+    }
+    free(old);
+    return 0;
 }
 
 /**
- * Get a reference to the specified cell
+ * Find the override entry for the specified cell
  * @param t Table pointer
  * @param row Row of cell
  * @param col Column of cell
- * @return NULL if row/col is out of range, the cell otherwise
+ * @return NULL if the cell has no overrides, the entry otherwise
  */
-static tcell_t *
-_utable_get_cell(table_t *t, int row, int col) {
-    if (_utable_rc_chk(t, row, col)) return NULL;
-    return &t->c[TIDX(row, col)];
+static tovr_t *
+_utable_ovr_find(table_t *t, size_t row, size_t col) {
+    if (!(TCELL(row, col).flags & CELL_OVR)) return NULL;
+    const size_t key = TIDX(row, col) + 1;
+    size_t i = _utable_ovr_slot(t, key);
+    while (t->ovr[i].key) {
+        if (t->ovr[i].key == key) return &t->ovr[i];
+        i = (i + 1) & (t->ovrSize - 1);
+    }
+    return NULL;
 }
 
 /**
- * Return the text in the specified table cell
+ * Get the override entry for the specified cell and create a new
+ * empty entry if the cell does not have one already.
  * @param t Table pointer
  * @param row Row of cell
  * @param col Column of cell
- * @return Pointer to text, NULL if out of range or no text
+ * @return NULL on failure, the entry otherwise
  */
-char *
-utable_get_cell(table_t *t, int row, int col) {
-    if (_utable_rc_chk(t, row, col)) return NULL;
-    return t->c[TIDX(row, col)].t;
+static tovr_t *
+_utable_ovr_get(table_t *t, size_t row, size_t col) {
+    tovr_t *o = _utable_ovr_find(t, row, col);
+    if (o) return o;
+
+    // Keep the load factor below 3/4
+    if (4 * (t->ovrUsed + 1) > 3 * t->ovrSize) {
+        if (_utable_ovr_rehash(t, t->ovrSize ? 2 * t->ovrSize : 16, 0))
+            return NULL;
+    }
+    tovr_t e = {.key = TIDX(row, col) + 1, .cspan = 1, .rspan = 1};
+    TCELL(row, col).flags |= CELL_OVR;
+    _utable_snap_touch(t, row);
+    return _utable_ovr_put(t, &e);
 }
 
 /**
- * Set the number of columns this cell spans
- * @param t Table pointer
- * @param row Row of cell
- * @param col Column of cell
- * @param cspan Column span to set
- * @return 0 on success, -1 on failure
+ * Merge the attributes in "o" into "f" for all attributes where "o" has
+ * been set more recently.
+ * @param f Format to update
+ * @param o Format to merge from
  */
-int
-utable_set_cell_colspan(table_t *t, size_t row, size_t col, size_t cspan) {
-    if (_utable_rc_chk(t, row, col) || col + cspan - 1 >= t->nCol) return -1;
-    tcell_t *cell = _utable_get_cell(t, row, col);
-    cell->cspan = cspan;
-    cell->merged = FALSE;
-    cell->pRow = row;
-    cell->pCol = col;
-
-    for (size_t c = col + 1; c < col + cspan; c++) {
-        cell = _utable_get_cell(t, row, c);
-        cell->merged = TRUE;
-        cell->pRow = row;
-        cell->pCol = col;
+static inline void
+_utable_merge_fmt(tfmt_t *f, const tfmt_t *o) {
+    if (o->seq_halign > f->seq_halign) {
+        f->halign = o->halign;
+        f->seq_halign = o->seq_halign;
+    }
+    if (o->seq_pad > f->seq_pad) {
+        f->lpad = o->lpad;
+        f->rpad = o->rpad;
+        f->seq_pad = o->seq_pad;
+    }
+    if (o->seq_cb > f->seq_cb) {
+        f->cb = o->cb;
+        f->seq_cb = o->seq_cb;
     }
-    return 0;
 }
 
 /**
- * Set the horizontal text alignment for this cell
- * @param t Table pointer
- * @param row Row of cell
- * @param col Column of cell
- * @param halign Horizontal align to use
- * @return 0 on success, -1 on failure
+ * Internal helper to order the entries of the span index by row and column
+ * @param a First entry
+ * @param b Second entry
+ * @return Negative, zero or positive as for qsort()
  */
-int
-utable_set_cell_halign(table_t *t, int row, int col, halign_t halign) {
-    if (_utable_rc_chk(t, row, col)) return -1;
-    t->c[TIDX(row, col)].halign = halign;
-    return 0;
+static int
+_utable_span_cmp(const void *a, const void *b) {
+    const tspan_t *x = a, *y = b;
+    if (x->row != y->row) return x->row < y->row ? -1 : 1;
+    return x->col < y->col ? -1 : x->col > y->col;
 }
 
 /**
- * Set the horizontal text alignment for this cell
+ * Internal helper to build the span index from the override map. The index
+ * is built the first time it is needed after a span has changed, except for
+ * a snapshot that gets its index when it is made since nothing may be
+ * written to a snapshot when it is stroked.
  * @param t Table pointer
- * @param row Row of cell
- * @param col Column of cell
- * @return halign_t on success, -1 on failure
+ * @return 0 on success, -1 on failure
  */
-int
-utable_get_cell_halign(table_t *t, int row, int col) {
-    if (_utable_rc_chk(t, row, col)) return -1;
-    return (int) t->c[TIDX(row, col)].halign;
+static int
+_utable_span_index(table_t *t) {
+    if (t->span) return 0;
+    size_t n = 0;
+    for (size_t i = 0; i < t->ovrSize; i++) {
+        const tovr_t *o = &t->ovr[i];
+        if (o->key && (o->cspan > 1 || o->rspan > 1)) n += o->rspan;
+    }
+    tspan_t *sp = malloc((n + 1) * sizeof(tspan_t));
+    if (NULL == sp) {
+        logmsg("CRITICAL : Failed to index spans. Out of memory.");
+        return -1;
+    }
+    MEM_ADD((n + 1) * sizeof(tspan_t));
+    size_t k = 0;
+    for (size_t i = 0; i < t->ovrSize; i++) {
+        const tovr_t *o = &t->ovr[i];
+        if (0 == o->key || (1 == o->cspan && 1 == o->rspan)) continue;
+        const size_t row = (o->key - 1) / t->nCol, col = (o->key - 1) % t->nCol;
+        for (size_t r = row; r < row + o->rspan; r++)
+            sp[k++] = (tspan_t) {r, col, o->cspan, row};
+    }
+    qsort(sp, n, sizeof(tspan_t), _utable_span_cmp);
+    t->span = sp;
+    t->nSpan = n;
+    return 0;
 }
 
 /**
- * Set the horizontal text alignment for specified row
+ * Internal helper to drop the span index after a span or the rows have
+ * changed
  * @param t Table pointer
- * @param row Row to set
- * @param halign Horizontal align to use
- * @return 0 on success, -1 on failure
  */
-int
-utable_set_row_halign(table_t *t, int row, halign_t halign) {
-    for (size_t c = 0; c < t->nCol; c++) {
-        if (utable_set_cell_halign(t, row, c, halign)) return -1;
-    }
-    return 0;
+static void
+_utable_span_drop(table_t *t) {
+    if (NULL == t->span) return;
+    MEM_SUB((t->nSpan + 1) * sizeof(tspan_t));
+    free(t->span);
+    t->span = NULL;
+    t->nSpan = 0;
 }
 
 /**
- * Set horizontal alignment for the entire table
+ * Internal helper to find the spans that cover cells in a row. A table
+ * where no cell has been set to span never looks at the index.
  * @param t Table pointer
- * @param halign Horizontal align to use
- * @return 0 on success, -1 on failure
+ * @param row Row
+ * @param n Number of spans in the row
+ * @return The first span in the row ordered by column, NULL if none
  */
-int
-utable_set_table_halign(table_t *t, halign_t halign) {
-    for (size_t r = 0; r < t->nRow; r++) {
-        if (-1 == utable_set_row_halign(t, r, halign)) return -1;
+static const tspan_t *
+_utable_span_row(table_t *t, size_t row, size_t *n) {
+    *n = 0;
+    if (!t->haveSpan || _utable_span_index(t)) return NULL;
+    size_t lo = 0, hi = t->nSpan;
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (t->span[mid].row < row)
+            lo = mid + 1;
+        else
+            hi = mid;
     }
-    return 0;
+    for (hi = lo; hi < t->nSpan && t->span[hi].row == row; hi++);
+    *n = hi - lo;
+    return *n ? &t->span[lo] : NULL;
 }
 
 /**
- * Set the horizontal text alignment for specified column
+ * Internal helper to find the span that covers a cell
  * @param t Table pointer
- * @param col Column to set
- * @param halign Horizontal align to use
- * @return 0 on success, -1 on failure
+ * @param row Row of cell
+ * @param col Column of cell
+ * @return NULL if the cell is not covered by a span, the span otherwise
  */
-int
-utable_set_col_halign(table_t *t, int col, halign_t halign) {
-    for (size_t r = 0; r < t->nRow; r++) {
-        if (utable_set_cell_halign(t, r, col, halign)) return -1;
+static const tspan_t *
+_utable_span_at(table_t *t, size_t row, size_t col) {
+    size_t n;
+    const tspan_t *sp = _utable_span_row(t, row, &n);
+    size_t lo = 0, hi = n;
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (sp[mid].col <= col)
+            lo = mid + 1;
+        else
+            hi = mid;
     }
-    return 0;
+    if (0 == lo || col >= sp[lo - 1].col + sp[lo - 1].cspan) return NULL;
+    return &sp[lo - 1];
 }
 
 /**
- * Set the text value for the specified cell. The value stored in the cell will
- * be a newly allocated space for this string.
+ * Internal helper to set or clear the mark on a block of cells covered by
+ * a span
  * @param t Table pointer
- * @param row
- * @param col
- * @param val
- * @return 0 on success, -1 on failure
+ * @param row First row
+ * @param nrow Number of rows
+ * @param col First column
+ * @param ncol Number of columns
+ * @param mark TRUE to mark the cells, FALSE to clear the mark
  */
-int
-utable_set_cell(table_t *t, size_t row, size_t col, char *val) {
-    if (_utable_rc_chk(t, row, col) || t->c[TIDX(row, col)].merged) return -1;
-    if (t->c[TIDX(row, col)].t) {
-        free(t->c[TIDX(row, col)].t);
+static void
+_utable_span_cover(table_t *t, size_t row, size_t nrow, size_t col,
+                   size_t ncol, _Bool mark) {
+    for (size_t r = row; r < row + nrow; r++) {
+        for (size_t c = col; c < col + ncol; c++) {
+            if (mark)
+                TCELL(r, c).flags |= CELL_MERGED;
+            else
+                TCELL(r, c).flags &= ~CELL_MERGED;
+        }
     }
-    t->c[TIDX(row, col)].t = strdup(val);
-    return 0;
 }
 
 /**
- * Set the cell left and right padding
+ * Resolve the effective format for a cell from the table, column and cell
+ * level. Merged cells use the format of the cell that spans them.
  * @param t Table pointer
- * @param lpad
- * @param rpad
- * @return 0 on success, -1 on failure
+ * @param row Row of cell
+ * @param col Column of cell
+ * @param f Resolved format
+ * @return The override entry for the cell, NULL if the cell has none
  */
-void
-utable_set_table_cellpadding(table_t *t, size_t lpad, size_t rpad) {
-    for (size_t r = 0; r < t->nRow; r++) {
-        for (size_t c = 0; c < t->nCol; c++) {
-            (void) utable_set_cellpadding(t, r, c, lpad, rpad);
+static tovr_t *
+_utable_get_fmt(table_t *t, size_t row, size_t col, tfmt_t *f) {
+    if (TCELL(row, col).flags & CELL_MERGED) {
+        const tspan_t *sp = _utable_span_at(t, row, col);
+        if (sp) {
+            row = sp->owner;
+            col = sp->col;
         }
     }
+    *f = t->deffmt;
+    _utable_merge_fmt(f, &t->colfmt[col]);
+    tovr_t *o = _utable_ovr_find(t, row, col);
+    if (o) _utable_merge_fmt(f, &o->fmt);
+    return o;
 }
 
 /**
- * Set callback function for cell used to populate the cell with text
+ * Get the column span for the specified cell
  * @param t Table pointer
- * @param r row
- * @param c column
- * @param cb Callback function
+ * @param row Row of cell
+ * @param col Column of cell
+ * @return Number of columns spanned
  */
-int
-utable_set_cellcallback(table_t *t, int row, int col, t_cell_cb cb) {
-    if (_utable_rc_chk(t, row, col) || t->c[TIDX(row, col)].merged) return -1;
-    // Only set callback if there is not already any text set
-    if (!t->c[TIDX(row, col)].t) t->c[TIDX(row, col)].cb = cb;
-    return 0;
+static inline size_t
+_utable_get_cspan(table_t *t, size_t row, size_t col) {
+    tovr_t *o = _utable_ovr_find(t, row, col);
+    return o ? o->cspan : 1;
 }
 
 /**
- * Set callback function for all cells in the table used to populate the cell
- * with text. If the callback returns NULL then no change to the cells
- * current text will be made.
+ * Make a view that draws the whole table in its current row order
  * @param t Table pointer
- * @param cb Callback function
+ * @param v View to fill in
  */
-void
-utable_set_table_cellcallback(table_t *t, t_cell_cb cb) {
-    for (size_t r = 0; r < t->nRow; r++) {
-        for (size_t c = 0; c < t->nCol; c++) {
-            utable_set_cellcallback(t, r, c, cb);
-        }
-    }
+static void
+_utable_table_view(table_t *t, tview_t *v) {
+    memset(v, 0, sizeof(tview_t));
+    v->base = t;
+    v->nRow = t->nRow;
+    v->nCol = t->nCol;
+    v->rows = t->rowmap;
+    v->setwidth = v->colwidth = t->colwidth;
+    v->gen = t->editGen;
 }
 
 /**
- * Set the cell left and right padding
- * @param t Table pointer
- * @param row
- * @param col
- * @param lpad
- * @param rpad
- * @return 0 on success, -1 on failure
+ * Check that a view was made after the last time rows or columns were
+ * inserted in or deleted from its base table, the row and column indices of
+ * an older view may be out of range
+ * @param v View
+ * @return 0 if the view is current, -1 otherwise
  */
-int
-utable_set_cellpadding(table_t *t, size_t row, size_t col, size_t lpad,
-                       size_t rpad) {
-    if (_utable_rc_chk(t, row, col) || t->c[TIDX(row, col)].merged) return -1;
-    t->c[TIDX(row, col)].lpad = lpad;
-    t->c[TIDX(row, col)].rpad = rpad;
+static int
+_utable_view_chk(const tview_t *v) {
+    if (v->gen != v->base->editGen) {
+        logmsg("View is older than the last row or column edit of the table");
+        return -1;
+    }
     return 0;
 }
 
 /**
- * Set the cell left and right padding
- * @param t Table pointer
- * @param lpad
- * @param rpad
- * @return 0 on success, -1 on failure
+ * Get the cell in the base table drawn at a position in a view
+ * @param v View
+ * @param i Row in the view
+ * @param j Column in the view
+ * @param row Row in the base table
+ * @param col Column in the base table
  */
-void
-utable_set_col_cellpadding(table_t *t, size_t col, size_t lpad,
-                           size_t rpad) {
-    for (size_t r = 0; r < t->nRow; r++) {
-        utable_set_cellpadding(t, r, col, lpad, rpad);
-    }
+static inline void
+_utable_view_rc(const tview_t *v, size_t i, size_t j, size_t *row,
+                size_t *col) {
+    const size_t a = v->rows ? v->rows[i] : i;
+    const size_t b = v->cols ? v->cols[j] : j;
+    *row = v->transposed ? b : a;
+    *col = v->transposed ? a : b;
 }
 
-static void
+/**
+ * Get the number of view columns a cell spans. A span is only kept for the
+ * columns that follow the cell in the same order in the view. A cell that is
+ * covered by a span is only drawn when its parent cell is not in the view
+ * and is then drawn on its own.
+ * @param v View
+ * @param j Column in the view
+ * @param row Row of the cell in the base table
+ * @param col Column of the cell in the base table
+ * @param cspan Column span of the cell in the base table
+ * @return Number of view columns spanned
+ */
+static inline size_t
+_utable_view_cspan(const tview_t *v, size_t j, size_t row, size_t col,
+                   size_t cspan) {
+    const table_t *t = v->base;
+    if (1 == cspan) return 1;
+    if (v->transposed || (TCELL(row, col).flags & CELL_MERGED)) return 1;
+    if (NULL == v->cols) return cspan;
+    size_t n = 1;
+    while (n < cspan && j + n < v->nCol && v->cols[j + n] == col + n) n++;
+    return n;
+}
+
+/**
+ * Initialize a format with the default values
+ * @param f Format to initialize
+ */
+static void
+_utable_init_fmt(tfmt_t *f) {
+    memset(f, 0, sizeof(tfmt_t));
+    f->halign = LEFTALIGN;
+}
+
+/**
+ * Internal helper to check if a row has been allocated on its own, i.e. it
+ * is not in the block of cells. The rows of a snapshot are in the chunks it
+ * shares and are never loose.
+ * @param t Table pointer
+ * @param row Row
+ * @return TRUE if the row is allocated on its own
+ */
+static inline _Bool
+_utable_row_loose(table_t *t, size_t row) {
+    if (0 == t->looseRows) return FALSE;
+    // The block has one cell more than its rows so no other allocation can
+    // start right after the last row
+    const uintptr_t p = (uintptr_t) t->row[row], c = (uintptr_t) t->c;
+    return p < c || p > c + t->blockRows * t->nCol * sizeof(tcell_t);
+}
+
+/**
+ * Create a new table of the specified size
+ * @param nRow Number of rows
+ * @param nCol Number of cols
+ * @return NULL on error , pointer to the newly created table otherwise
+ */
+table_t *
+utable_create(size_t nRow, size_t nCol) {
+    table_t *t = calloc(1, sizeof(table_t));
+    if (NULL == t) return NULL;
+    t->nRow = nRow;
+    t->nCol = nCol;
+    t->headerLine = TRUE;
+    _utable_init_fmt(&t->deffmt);
+
+    t->c = calloc(nRow * nCol + 1, sizeof(tcell_t));
+    t->row = malloc((nRow + 1) * sizeof(tcell_t *));
+    t->colwidth = calloc(nCol + 1, sizeof(size_t));
+    t->mincolwidth = calloc(nCol + 1, sizeof(size_t));
+    t->colfmt = calloc(nCol + 1, sizeof(tfmt_t));
+    if (t->c == NULL || t->row == NULL || t->colwidth == NULL ||
+        t->mincolwidth == NULL || t->colfmt == NULL) {
+        logmsg("CRITICAL : Failed to create table. Out of memory.");
+        free(t->c);
+        free(t->row);
+        free(t->colwidth);
+        free(t->mincolwidth);
+        free(t->colfmt);
+        free(t);
+        return NULL;
+    }
+
+    // All rows start out in one block. Rows that are inserted later are
+    // allocated on their own so that only the row directory is moved.
+    for (size_t r = 0; r < nRow; r++) {
+        t->row[r] = &t->c[r * nCol];
+    }
+    t->rowCap = t->blockRows = nRow;
+    for (size_t c = 0; c < nCol; c++) {
+        _utable_init_fmt(&t->colfmt[c]);
+    }
+
+    utable_mem_t mem;
+    utable_memory_usage(t, &mem);
+    MEM_ADD(mem.total);
+    __atomic_add_fetch(&_live_tables, 1, __ATOMIC_RELAXED);
+
+    return t;
+}
+
+/**
+ * Set the text of all cells in the table from an array of texts. All texts
+ * are measured first and then copied into one block of memory, so the whole
+ * table is set with a single allocation. The block is kept until the table
+ * is set again or freed, also when some of the cells are given new texts.
+ * It is the calling routines responsibility that the size of the array
+ * matches that of the table. Cells that are covered by a column span must
+ * have a NULL text.
+ * @param t Table pointer
+ * @param data Text of each cell, NULL for an empty cell
+ * @param len Length of each text in bytes, NULL if the texts are NULL
+ *            terminated. The texts do not need to be NULL terminated when
+ *            the lengths are given.
+ * @param order Order of the cells in the arrays
+ * @return 0 on success, -1 on failure in which case the table is unchanged
+ */
+int
+utable_set_n(table_t *t, const char *const data[], const size_t len[],
+             dataorder_t order) {
+    const size_t n = t->nRow * t->nCol;
+    size_t size = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (data[i]) size += (len ? len[i] : strlen(data[i])) + 1;
+    }
+    if (t->haveSpan) {
+        for (size_t i = 0; i < n; i++) {
+            const size_t r = ROW_MAJOR == order ? i / t->nCol : i % t->nRow;
+            const size_t c = ROW_MAJOR == order ? i % t->nCol : i / t->nRow;
+            if (data[i] && (TCELL(r, c).flags & CELL_MERGED)) return -1;
+        }
+    }
+    char *block = size ? malloc(size) : NULL;
+    if (size && NULL == block) {
+        logmsg("CRITICAL : Failed to set table. Out of memory.");
+        return -1;
+    }
+
+    // The texts are copied in the order they are given so that the block
+    // is written from start to end
+    char *p = block;
+    for (size_t i = 0, r = 0, c = 0; i < n; i++) {
+        tcell_t *cell = &TCELL(r, c);
+        if (ROW_MAJOR == order && ++c == t->nCol) {
+            c = 0;
+            r++;
+        } else if (COL_MAJOR == order && ++r == t->nRow) {
+            r = 0;
+            c++;
+        }
+        if (!(cell->flags & CELL_BORROWED) && cell->t) {
+            t->textBytes -= cell->len + 1;
+            MEM_SUB(cell->len + 1);
+            free(cell->t);
+        }
+        cell->flags &= ~(CELL_BORROWED | CELL_CBTXT);
+        cell->t = NULL;
+        cell->len = 0;
+        if (NULL == data[i]) continue;
+        if (len) {
+            memcpy(p, data[i], len[i]);
+            p[len[i]] = '\0';
+            cell->len = len[i];
+        } else {
+            cell->len = (char *) memccpy(p, data[i], '\0', block + size - p) - p - 1;
+        }
+        cell->t = p;
+        cell->flags |= CELL_BLOCK;
+        p += cell->len + 1;
+    }
+
+    // No cell is left in the previous block since all cells have been set
+    if (t->block) {
+        t->textBytes -= t->blockLen;
+        MEM_SUB(t->blockLen);
+        free(t->block);
+    }
+    t->block = block;
+    t->blockLen = size;
+    t->textBytes += size;
+    MEM_ADD(size);
+    if (t->agg) {
+        for (size_t c = 0; c < t->nCol; c++) t->agg[c].dirty = TRUE;
+    }
+    _utable_snap_touch_all(t);
+    return 0;
+}
+
+/**
+ * Initialize the table with string from a matrix. It is the calling routines
+ * responsibility that the size of the data matrix matches that of the table.
+ * @param t Table pointer
+ * @param data A matrix of data to be used as initialization
+ * @return 0 on success, -1 on failure
+ */
+int
+utable_set(table_t *t, char *data[]) {
+    return utable_set_n(t, (const char *const *) data, NULL, ROW_MAJOR);
+}
+
+/**
+ * Combine table creation and initialization with error check
+ * @param t Table pointer
+ * @param nRow Number of rows
+ * @param nCol Number of cols
+ * @param data A matrix of data to be used as initialization
+ * @return NULL on failure, pointer to new table otherwise
+ */
+table_t *
+utable_create_set(size_t nRow, size_t nCol, char *data[]) {
+    table_t *t = utable_create(nRow, nCol);
+    if (NULL == t) {
+        return NULL;
+    }
+    if (-1 == utable_set(t, data)) {
+        utable_free(t);
+        return NULL;
+    }
+    return t;
+}
+
+/**
+ * Combine table creation and initialization from an array of texts, see
+ * utable_set_n()
+ * @param nRow Number of rows
+ * @param nCol Number of cols
+ * @param data Text of each cell, NULL for an empty cell
+ * @param len Length of each text in bytes, NULL if the texts are NULL
+ *            terminated
+ * @param order Order of the cells in the arrays
+ * @return NULL on failure, pointer to new table otherwise
+ */
+table_t *
+utable_create_set_n(size_t nRow, size_t nCol, const char *const data[],
+                    const size_t len[], dataorder_t order) {
+    table_t *t = utable_create(nRow, nCol);
+    if (NULL == t) {
+        return NULL;
+    }
+    if (-1 == utable_set_n(t, data, len, order)) {
+        utable_free(t);
+        return NULL;
+    }
+    return t;
+}
+
+/**
+ * Set the column titles, i.e. the text in the header row (row 0)
+ * @param t Table pointer
+ * @param titles A vector with one title per column
+ * @return 0 on success, -1 on failure
+ */
+int
+utable_set_coltitles(table_t *t, char *titles[]) {
+    for (size_t c = 0; c < t->nCol; c++) {
+        if (utable_set_cell(t, 0, c, titles[c])) return -1;
+    }
+    return 0;
+}
+
+/**
+ * Free (destroy) a previously created table
+ * @param t Table pointer
+ */
+void
+utable_free(table_t *t) {
+    utable_mem_t mem;
+    utable_memory_usage(t, &mem);
+    MEM_SUB(mem.total);
+    __atomic_sub_fetch(&_live_tables, 1, __ATOMIC_RELAXED);
+
+    for (size_t r = 0; r < t->nRow; r++) {
+        for (size_t c = 0; c < t->nCol; c++) {
+            if (!(TCELL(r, c).flags & CELL_BORROWED)) {
+                free(TCELL(r, c).t);
+            }
+        }
+        if (_utable_row_loose(t, r)) free(t->row[r]);
+    }
+    if (t->chunks) {
+        for (size_t k = 0; k * SNAP_ROWS < t->nRow; k++)
+            _utable_chunk_release(t->chunks[k]);
+    }
+    free(t->chunks);
+    free(t->chunkDirty);
+    free(t->c);
+    free(t->row);
+    free(t->colwidth);
+    free(t->mincolwidth);
+    free(t->colfmt);
+    free(t->ovr);
+    free(t->span);
+    free(t->stats);
+    free(t->title);
+    free(t->rowmap);
+    if (t->agg) {
+        for (size_t c = 0; c < t->nCol; c++) {
+            free(t->agg[c].fmt);
+            free(t->agg[c].label);
+            free(t->agg[c].val);
+        }
+        free(t->agg);
+    }
+    if (t->extmem) munmap(t->extmem, t->extlen);
+    free(t->block);
+    free(t);
+}
+
+/**
+ * Internal helper to update the process wide memory accounting after the
+ * layout of a table has changed
+ * @param t Table pointer
+ * @param before Memory used by the table before the change
+ */
+static void
+_utable_mem_sync(table_t *t, const utable_mem_t *before) {
+    utable_mem_t after;
+    utable_memory_usage(t, &after);
+    MEM_ADD(after.total);
+    MEM_SUB(before->total);
+}
+
+/**
+ * Internal helper to get the position of a row or column after rows or
+ * columns have been inserted or deleted
+ * @param i Position before the change
+ * @param at First row or column inserted or deleted
+ * @param n Number of rows or columns
+ * @param del TRUE if they were deleted, FALSE if they were inserted
+ * @return New position, SIZE_MAX if it was deleted
+ */
+static inline size_t
+_utable_edit_pos(size_t i, size_t at, size_t n, _Bool del) {
+    if (i < at) return i;
+    if (!del) return i + n;
+    return i < at + n ? SIZE_MAX : i - n;
+}
+
+/**
+ * Internal helper to move the entries in the override map when rows or
+ * columns are inserted or deleted. The entries of deleted cells are dropped.
+ * A span grows by the rows or columns inserted inside it and shrinks by the
+ * rows or columns deleted from it. When the first row of a row span is
+ * deleted the cells it covered below are drawn on their own. This is called
+ * before the size of the table is changed and the map keeps its size.
+ * @param t Table pointer
+ * @param cols TRUE for columns, FALSE for rows
+ * @param at First row or column inserted or deleted
+ * @param n Number of rows or columns
+ * @param del TRUE if they are deleted, FALSE if they are inserted
+ * @return 0 on success, -1 on failure in which case the map is unchanged
+ */
+static int
+_utable_ovr_edit(table_t *t, _Bool cols, size_t at, size_t n, _Bool del) {
+    if (0 == t->ovrUsed) return 0;
+    tovr_t *old = t->ovr;
+    tovr_t *m = calloc(t->ovrSize, sizeof(tovr_t));
+    if (NULL == m) return -1;
+    const size_t nCol = !cols ? t->nCol : del ? t->nCol - n : t->nCol + n;
+    t->ovr = m;
+    t->ovrUsed = 0;
+    for (size_t i = 0; i < t->ovrSize; i++) {
+        if (0 == old[i].key) continue;
+        tovr_t e = old[i];
+        size_t row = (e.key - 1) / t->nCol, col = (e.key - 1) % t->nCol;
+        size_t *pos = cols ? &col : &row;
+        size_t *span = cols ? &e.cspan : &e.rspan;
+        const size_t end = *pos + *span;
+        *pos = _utable_edit_pos(*pos, at, n, del);
+        if (*pos < at && end > at)
+            *span = del ? *span - (MIN(end, at + n) - at) : *span + n;
+        if (SIZE_MAX == *pos) {
+            if (!cols && end > at + n)
+                _utable_span_cover(t, at + n, end - at - n, col, e.cspan, FALSE);
+            continue;
+        }
+        e.key = row * nCol + col + 1;
+        _utable_ovr_put(t, &e);
+    }
+    free(old);
+    return 0;
+}
+
+/**
+ * Internal helper to drop the state that is kept for each row when rows or
+ * columns are inserted or deleted. The footer values are parsed again when
+ * they are needed and the next snapshot copies all rows. This is called
+ * before the size of the table is changed.
+ * @param t Table pointer
+ */
+static void
+_utable_rows_changed(table_t *t) {
+    if (t->agg) {
+        for (size_t c = 0; c < t->nCol; c++) {
+            free(t->agg[c].val);
+            t->agg[c].val = NULL;
+            t->agg[c].dirty = TRUE;
+        }
+    }
+    if (t->chunks) {
+        for (size_t k = 0; k * SNAP_ROWS < t->nRow; k++)
+            _utable_chunk_release(t->chunks[k]);
+    }
+    free(t->chunks);
+    free(t->chunkDirty);
+    t->chunks = NULL;
+    t->chunkDirty = NULL;
+}
+
+/**
+ * Internal helper to free the texts the table owns in a row
+ * @param t Table pointer
+ * @param row Row
+ * @param col First column
+ * @param n Number of columns
+ */
+static void
+_utable_free_texts(table_t *t, size_t row, size_t col, size_t n) {
+    for (size_t c = col; c < col + n; c++) {
+        tcell_t *cell = &TCELL(row, c);
+        if (!(cell->flags & CELL_BORROWED) && cell->t) {
+            t->textBytes -= cell->len + 1;
+            free(cell->t);
+        }
+    }
+}
+
+/**
+ * Insert empty rows. Each row of cells is reached through a row directory
+ * so only the directory entries below the new rows are moved, the cells
+ * stay where they are. The directory grows geometrically which makes
+ * adding rows at the end amortized constant time. The rows below keep
+ * their formats and spans. In a sorted table the new rows are drawn before
+ * the row that was at the position. Views made before the edit can not be
+ * stroked and must be made again.
+ * @param t Table pointer
+ * @param at Row the first new row is inserted at, the number of rows to
+ *           add rows at the end
+ * @param n Number of rows to insert
+ * @return 0 on success, -1 on failure in which case the table is unchanged
+ */
+int
+utable_insert_rows(table_t *t, size_t at, size_t n) {
+    if (t->snapRefs || at > t->nRow) return -1;
+    if (0 == n) return 0;
+    _utable_span_drop(t);
+    utable_mem_t before;
+    utable_memory_usage(t, &before);
+
+    // The directory also has room for the new rows after its end, where they
+    // are kept until the entries below them have been moved
+    if (t->nRow + 2 * n > t->rowCap) {
+        const size_t cap = MAX(t->nRow + 2 * n, 2 * t->rowCap);
+        tcell_t **row = realloc(t->row, (cap + 1) * sizeof(tcell_t *));
+        if (NULL == row) {
+            logmsg("CRITICAL : Failed to insert rows. Out of memory.");
+            return -1;
+        }
+        t->row = row;
+        t->rowCap = cap;
+    }
+    if (t->rowmap) {
+        size_t *rowmap = realloc(t->rowmap, (t->nRow + n) * sizeof(size_t) + 1);
+        if (NULL == rowmap) {
+            logmsg("CRITICAL : Failed to insert rows. Out of memory.");
+            _utable_mem_sync(t, &before);
+            return -1;
+        }
+        t->rowmap = rowmap;
+    }
+
+    tcell_t **added = &t->row[t->nRow + n];
+    size_t k = 0;
+    while (k < n && NULL != (added[k] = calloc(t->nCol + 1, sizeof(tcell_t))))
+        k++;
+    if (k < n || _utable_ovr_edit(t, FALSE, at, n, FALSE)) {
+        logmsg("CRITICAL : Failed to insert rows. Out of memory.");
+        while (k-- > 0) free(added[k]);
+        _utable_mem_sync(t, &before);
+        return -1;
+    }
+    _utable_rows_changed(t);
+    memmove(&t->row[at + n], &t->row[at], (t->nRow - at) * sizeof(tcell_t *));
+    memcpy(&t->row[at], added, n * sizeof(tcell_t *));
+    t->looseRows += n;
+
+    if (t->rowmap) {
+        size_t pos = t->nRow;
+        for (size_t i = 0; i < t->nRow; i++) {
+            if (t->rowmap[i] == at) pos = i;
+            t->rowmap[i] = _utable_edit_pos(t->rowmap[i], at, n, FALSE);
+        }
+        memmove(&t->rowmap[pos + n], &t->rowmap[pos],
+                (t->nRow - pos) * sizeof(size_t));
+        for (size_t i = 0; i < n; i++) t->rowmap[pos + i] = at + i;
+    }
+    t->nRow += n;
+    t->editGen++;
+
+    // A row span across the position also covers the new rows
+    for (size_t i = 0; t->haveSpan && i < t->ovrSize; i++) {
+        const tovr_t *o = &t->ovr[i];
+        if (0 == o->key) continue;
+        const size_t row = (o->key - 1) / t->nCol, col = (o->key - 1) % t->nCol;
+        if (row < at && row + o->rspan > at + n)
+            _utable_span_cover(t, at, n, col, o->cspan, TRUE);
+    }
+    _utable_mem_sync(t, &before);
+    return 0;
+}
+
+/**
+ * Delete rows. Only the directory entries below the deleted rows are moved,
+ * see utable_insert_rows(). Views made before the edit can not be stroked
+ * and must be made again.
+ * @param t Table pointer
+ * @param at First row to delete
+ * @param n Number of rows to delete
+ * @return 0 on success, -1 on failure in which case the table is unchanged
+ */
+int
+utable_delete_rows(table_t *t, size_t at, size_t n) {
+    if (t->snapRefs || at > t->nRow || n > t->nRow - at) return -1;
+    if (0 == n) return 0;
+    _utable_span_drop(t);
+    if (_utable_ovr_edit(t, FALSE, at, n, TRUE)) {
+        logmsg("CRITICAL : Failed to delete rows. Out of memory.");
+        return -1;
+    }
+    utable_mem_t before;
+    utable_memory_usage(t, &before);
+    _utable_rows_changed(t);
+
+    // Rows in the block leave a hole that is given back when the columns
+    // are changed or the table is freed
+    for (size_t r = at; r < at + n; r++) {
+        _utable_free_texts(t, r, 0, t->nCol);
+        if (_utable_row_loose(t, r)) {
+            free(t->row[r]);
+            t->looseRows--;
+        }
+    }
+    memmove(&t->row[at], &t->row[at + n],
+            (t->nRow - at - n) * sizeof(tcell_t *));
+
+    if (t->rowmap) {
+        size_t j = 0;
+        for (size_t i = 0; i < t->nRow; i++) {
+            const size_t r = _utable_edit_pos(t->rowmap[i], at, n, TRUE);
+            if (SIZE_MAX != r) t->rowmap[j++] = r;
+        }
+    }
+    t->nRow -= n;
+    t->editGen++;
+    _utable_mem_sync(t, &before);
+    return 0;
+}
+
+/**
+ * Internal helper to insert or delete columns. Every row is copied into a
+ * new block of cells, which also gives back the holes left by deleted rows.
+ * The column widths, formats and footers move with their columns and the
+ * cells covered by column spans are marked again.
+ * @param t Table pointer
+ * @param at First column inserted or deleted
+ * @param n Number of columns
+ * @param del TRUE to delete, FALSE to insert
+ * @return 0 on success, -1 on failure in which case the table is unchanged
+ */
+static int
+_utable_edit_cols(table_t *t, size_t at, size_t n, _Bool del) {
+    const size_t nCol = del ? t->nCol - n : t->nCol + n;
+    tcell_t *c = calloc(t->nRow * nCol + 1, sizeof(tcell_t));
+    size_t *colwidth = calloc(nCol + 1, sizeof(size_t));
+    size_t *mincolwidth = calloc(nCol + 1, sizeof(size_t));
+    tfmt_t *colfmt = calloc(nCol + 1, sizeof(tfmt_t));
+    tagg_t *agg = t->agg ? calloc(nCol + 1, sizeof(tagg_t)) : NULL;
+    if (NULL == c || NULL == colwidth || NULL == mincolwidth ||
+        NULL == colfmt || (t->agg && NULL == agg) ||
+        _utable_ovr_edit(t, TRUE, at, n, del)) {
+        logmsg("CRITICAL : Failed to change columns. Out of memory.");
+        free(c);
+        free(colwidth);
+        free(mincolwidth);
+        free(colfmt);
+        free(agg);
+        return -1;
+    }
+    _utable_span_drop(t);
+    utable_mem_t before;
+    utable_memory_usage(t, &before);
+    _utable_rows_changed(t);
+
+    for (size_t j = 0; j < nCol; j++) _utable_init_fmt(&colfmt[j]);
+    for (size_t j = 0; j < t->nCol; j++) {
+        const size_t k = _utable_edit_pos(j, at, n, del);
+        if (SIZE_MAX == k) {
+            if (t->agg) {
+                free(t->agg[j].fmt);
+                free(t->agg[j].label);
+            }
+            continue;
+        }
+        colwidth[k] = t->colwidth[j];
+        mincolwidth[k] = t->mincolwidth[j];
+        colfmt[k] = t->colfmt[j];
+        if (t->agg) agg[k] = t->agg[j];
+    }
+
+    for (size_t r = 0; r < t->nRow; r++) {
+        if (del) _utable_free_texts(t, r, at, n);
+        for (size_t j = 0; j < t->nCol; j++) {
+            const size_t k = _utable_edit_pos(j, at, n, del);
+            if (SIZE_MAX == k) continue;
+            c[r * nCol + k] = TCELL(r, j);
+            c[r * nCol + k].flags &= ~CELL_MERGED;
+        }
+        if (_utable_row_loose(t, r)) free(t->row[r]);
+        t->row[r] = &c[r * nCol];
+    }
+
+    free(t->c);
+    free(t->colwidth);
+    free(t->mincolwidth);
+    free(t->colfmt);
+    free(t->agg);
+    t->c = c;
+    t->colwidth = colwidth;
+    t->mincolwidth = mincolwidth;
+    t->colfmt = colfmt;
+    t->agg = agg;
+    t->blockRows = t->nRow;
+    t->looseRows = 0;
+    t->nCol = nCol;
+    t->editGen++;
+
+    for (size_t i = 0; i < t->ovrSize; i++) {
+        const tovr_t *o = &t->ovr[i];
+        if (0 == o->key || (1 == o->rspan && 1 == o->cspan)) continue;
+        const size_t row = (o->key - 1) / t->nCol, col = (o->key - 1) % t->nCol;
+        _utable_span_cover(t, row, o->rspan, col, o->cspan, TRUE);
+        TCELL(row, col).flags &= ~CELL_MERGED;
+    }
+    _utable_mem_sync(t, &before);
+    return 0;
+}
+
+/**
+ * Insert empty columns. All cells are moved, so this takes time
+ * proportional to the size of the table. The new columns have the table
+ * default format and a column span that covers the position grows to also
+ * cover the new columns. Views made before the edit can not be stroked and
+ * must be made again.
+ * @param t Table pointer
+ * @param at Column the first new column is inserted at, the number of
+ *           columns to add columns at the right
+ * @param n Number of columns to insert
+ * @return 0 on success, -1 on failure in which case the table is unchanged
+ */
+int
+utable_insert_cols(table_t *t, size_t at, size_t n) {
+    if (t->snapRefs || at > t->nCol) return -1;
+    if (0 == n) return 0;
+    return _utable_edit_cols(t, at, n, FALSE);
+}
+
+/**
+ * Delete columns. All cells are moved, see utable_insert_cols(). A column
+ * span shrinks by the columns that are deleted from it and when the first
+ * column of a span is deleted the other cells it covered are drawn on their
+ * own. Views made before the edit can not be stroked and must be made
+ * again.
+ * @param t Table pointer
+ * @param at First column to delete
+ * @param n Number of columns to delete
+ * @return 0 on success, -1 on failure in which case the table is unchanged
+ */
+int
+utable_delete_cols(table_t *t, size_t at, size_t n) {
+    if (t->snapRefs || at > t->nCol || n > t->nCol - at) return -1;
+    if (0 == n) return 0;
+    return _utable_edit_cols(t, at, n, TRUE);
+}
+
+/**
+ * Set a title to the table. How the title is displayed is determined
+ * by the table style.
+ * @param t Table pointer
+ * @param title
+ */
+void
+utable_set_title(table_t *t, char *title, titlestyle_t style) {
+    if (t->title) {
+        MEM_SUB(strlen(t->title) + 1);
+        free(t->title);
+    }
+    t->title = strdup(title);
+    if (t->title) MEM_ADD(strlen(t->title) + 1);
+    t->titleStyle = style;
+}
+
+/**
+ * Enable or disable the extra line below the header row (the first row in the
+ * data). The style of the line is determined by the table style. The hedaer
+ * line is by default enabled when the table is created.
+ * @param t Table pointer
+ * @param headerLine Flag to disable/enable header
+ */
+void
+utable_set_headerline(table_t *t, _Bool headerLine) {
+    t->headerLine = headerLine;
+}
+
+/**
+ * Internal helper to get the value of a cell as a number
+ * @param cell Cell
+ * @param v Value
+ * @return 0 if the cell holds a number, -1 otherwise
+ */
+static int
+_utable_cell_double(const tcell_t *cell, double *v) {
+    char buff[64];
+    if (NULL == cell->t || 0 == cell->len || cell->len >= sizeof(buff))
+        return -1;
+    memcpy(buff, cell->t, cell->len);
+    buff[cell->len] = '\0';
+    char *end;
+    *v = strtod(buff, &end);
+    while (' ' == *end) end++;
+    return end == buff || *end || *v != *v ? -1 : 0;
+}
+
+/**
+ * Internal helper to replace the text in a cell with a copy of the new text
+ * @param t Table pointer
+ * @param row Row of cell
+ * @param col Column of cell
+ * @param val New text, does not need to be NULL terminated
+ * @param len Length of new text in bytes
+ * @return 0 on success, -1 on failure
+ */
+static int
+_utable_cell_settext(table_t *t, size_t row, size_t col, const char *val,
+                     size_t len) {
+    tcell_t *cell = &TCELL(row, col);
+    char *txt = malloc(len + 1);
+    if (NULL == txt) {
+        logmsg("CRITICAL : Failed to set cell text. Out of memory.");
+        return -1;
+    }
+    if (len) memcpy(txt, val, len);
+    txt[len] = '\0';
+    if (cell->flags & CELL_BORROWED) {
+        cell->flags &= ~CELL_BORROWED;
+    } else if (cell->t) {
+        t->textBytes -= cell->len + 1;
+        MEM_SUB(cell->len + 1);
+        free(cell->t);
+    }
+    cell->t = txt;
+    cell->len = len;
+    t->textBytes += cell->len + 1;
+    MEM_ADD(cell->len + 1);
+    if (t->agg) t->agg[col].dirty = TRUE;
+    _utable_snap_touch(t, row);
+    return 0;
+}
+
+/**
+ * Internal helper to make a cell reference a text that the table does not
+ * own
+ * @param t Table pointer
+ * @param row Row of cell
+ * @param col Column of cell
+ * @param val New text, does not need to be NULL terminated
+ * @param len Length of new text in bytes
+ */
+static void
+_utable_cell_reftext(table_t *t, size_t row, size_t col, const char *val,
+                     size_t len) {
+    tcell_t *cell = &TCELL(row, col);
+    if (!(cell->flags & CELL_BORROWED) && cell->t) {
+        t->textBytes -= cell->len + 1;
+        MEM_SUB(cell->len + 1);
+        free(cell->t);
+    }
+    cell->flags = (cell->flags & ~CELL_BORROWED) | CELL_EXTERN;
+    cell->t = (char *) val;
+    cell->len = len;
+    if (t->agg) t->agg[col].dirty = TRUE;
+    _utable_snap_touch(t, row);
+}
+
+/**
+ * Return the text in the specified table cell
+ * @param t Table pointer
+ * @param row Row of cell
+ * @param col Column of cell
+ * @return Pointer to text, NULL if out of range or no text
+ */
+char *
+utable_get_cell(table_t *t, int row, int col) {
+    if (_utable_rc_chk(t, row, col)) return NULL;
+    tcell_t *cell = &TCELL(row, col);
+    // Text that references a loaded file is not NULL terminated so the
+    // cell gets its own copy the first time it is asked for
+    if ((cell->flags & CELL_EXTERN) &&
+        _utable_cell_settext(t, row, col, cell->t, cell->len))
+        return NULL;
+    return cell->t;
+}
+
+/**
+ * Internal helper to set the number of rows and columns a cell spans. The
+ * cells covered by the previous span of the cell are released first and the
+ * new span must not cover a cell that is covered by or spans another span.
+ * @param t Table pointer
+ * @param row Row of cell
+ * @param col Column of cell
+ * @param rspan Row span to set
+ * @param cspan Column span to set
+ * @return 0 on success, -1 on failure in which case the span is unchanged
+ */
+static int
+_utable_set_span(table_t *t, size_t row, size_t col, size_t rspan,
+                 size_t cspan) {
+    if (0 == rspan || 0 == cspan || rspan > t->nRow - row ||
+        cspan > t->nCol - col || (TCELL(row, col).flags & CELL_MERGED))
+        return -1;
+    const tovr_t *o = _utable_ovr_find(t, row, col);
+    const size_t orspan = o ? o->rspan : 1, ocspan = o ? o->cspan : 1;
+    _utable_span_cover(t, row, orspan, col, ocspan, FALSE);
+
+    _Bool ok = TRUE;
+    for (size_t r = row; ok && r < row + rspan; r++) {
+        for (size_t c = col; ok && c < col + cspan; c++) {
+            const tovr_t *e = _utable_ovr_find(t, r, c);
+            if ((TCELL(r, c).flags & CELL_MERGED) ||
+                (e && (r != row || c != col) && (e->cspan > 1 || e->rspan > 1)))
+                ok = FALSE;
+        }
+    }
+    tovr_t *e = ok ? _utable_ovr_get(t, row, col) : NULL;
+    if (e) {
+        e->rspan = rspan;
+        e->cspan = cspan;
+        if (rspan > 1 || cspan > 1) t->haveSpan = TRUE;
+        for (size_t r = row; r < row + MAX(rspan, orspan); r++)
+            _utable_snap_touch(t, r);
+        _utable_span_drop(t);
+    }
+    _utable_span_cover(t, row, e ? rspan : orspan, col, e ? cspan : ocspan,
+                       TRUE);
+    TCELL(row, col).flags &= ~CELL_MERGED;
+    return e ? 0 : -1;
+}
+
+/**
+ * Set the number of columns this cell spans. The span must not overlap
+ * another span.
+ * @param t Table pointer
+ * @param row Row of cell
+ * @param col Column of cell
+ * @param cspan Column span to set
+ * @return 0 on success, -1 on failure
+ */
+int
+utable_set_cell_colspan(table_t *t, size_t row, size_t col, size_t cspan) {
+    if (_utable_rc_chk(t, row, col)) return -1;
+    const tovr_t *o = _utable_ovr_find(t, row, col);
+    return _utable_set_span(t, row, col, o ? o->rspan : 1, cspan);
+}
+
+/**
+ * Set the number of rows this cell spans. The cell is drawn over all the
+ * rows with its text in the first row and no lines between the rows. In a
+ * sorted table or a view the span is only drawn across the rows that are
+ * drawn next to each other in the order they are stored in. A transposed
+ * view or a view with the columns in another order draws the covered cells
+ * as empty cells on their own. The span must not overlap another span.
+ * @param t Table pointer
+ * @param row Row of cell
+ * @param col Column of cell
+ * @param rspan Row span to set
+ * @return 0 on success, -1 on failure
+ */
+int
+utable_set_cell_rowspan(table_t *t, size_t row, size_t col, size_t rspan) {
+    if (_utable_rc_chk(t, row, col)) return -1;
+    const tovr_t *o = _utable_ovr_find(t, row, col);
+    return _utable_set_span(t, row, col, rspan, o ? o->cspan : 1);
+}
+
+/**
+ * Set the horizontal text alignment for this cell
+ * @param t Table pointer
+ * @param row Row of cell
+ * @param col Column of cell
+ * @param halign Horizontal align to use
+ * @return 0 on success, -1 on failure
+ */
+int
+utable_set_cell_halign(table_t *t, int row, int col, halign_t halign) {
+    if (_utable_rc_chk(t, row, col)) return -1;
+    tovr_t *o = _utable_ovr_get(t, row, col);
+    if (NULL == o) return -1;
+    o->fmt.halign = halign;
+    o->fmt.seq_halign = ++t->fmtSeq;
+    return 0;
+}
+
+/**
+ * Get the horizontal text alignment for this cell
+ * @param t Table pointer
+ * @param row Row of cell
+ * @param col Column of cell
+ * @return halign_t on success, -1 on failure
+ */
+int
+utable_get_cell_halign(table_t *t, int row, int col) {
+    if (_utable_rc_chk(t, row, col)) return -1;
+    tfmt_t f;
+    _utable_get_fmt(t, row, col, &f);
+    return (int) f.halign;
+}
+
+/**
+ * Set the horizontal text alignment for specified row
+ * @param t Table pointer
+ * @param row Row to set
+ * @param halign Horizontal align to use
+ * @return 0 on success, -1 on failure
+ */
+int
+utable_set_row_halign(table_t *t, int row, halign_t halign) {
+    for (size_t c = 0; c < t->nCol; c++) {
+        if (utable_set_cell_halign(t, row, c, halign)) return -1;
+    }
+    return 0;
+}
+
+/**
+ * Set horizontal alignment for the entire table. This overrides any
+ * alignment previously set on column or cell level.
+ * @param t Table pointer
+ * @param halign Horizontal align to use
+ * @return 0 on success, -1 on failure
+ */
+int
+utable_set_table_halign(table_t *t, halign_t halign) {
+    t->deffmt.halign = halign;
+    t->deffmt.seq_halign = ++t->fmtSeq;
+    return 0;
+}
+
+/**
+ * Set the horizontal text alignment for specified column. This overrides any
+ * alignment previously set for individual cells in the column.
+ * @param t Table pointer
+ * @param col Column to set
+ * @param halign Horizontal align to use
+ * @return 0 on success, -1 on failure
+ */
+int
+utable_set_col_halign(table_t *t, int col, halign_t halign) {
+    if (_utable_col_chk(t, col)) return -1;
+    t->colfmt[col].halign = halign;
+    t->colfmt[col].seq_halign = ++t->fmtSeq;
+    return 0;
+}
+
+/**
+ * Set the text value for the specified cell. The value stored in the cell will
+ * be a newly allocated space for this string.
+ * @param t Table pointer
+ * @param row
+ * @param col
+ * @param val
+ * @return 0 on success, -1 on failure
+ */
+int
+utable_set_cell(table_t *t, size_t row, size_t col, char *val) {
+    return utable_set_cell_n(t, row, col, val, strlen(val));
+}
+
+/**
+ * Set the text in a cell from a text with a known length. The text is
+ * copied and does not need to be NULL terminated.
+ * @param t Table pointer
+ * @param row
+ * @param col
+ * @param val Text
+ * @param len Length of text in bytes
+ * @return 0 on success, -1 on failure
+ */
+int
+utable_set_cell_n(table_t *t, size_t row, size_t col, const char *val,
+                  size_t len) {
+    if (_utable_rc_chk(t, row, col) || (TCELL(row, col).flags & CELL_MERGED))
+        return -1;
+    if (_utable_cell_settext(t, row, col, val, len)) return -1;
+    TCELL(row, col).flags &= ~CELL_CBTXT;
+    return 0;
+}
+
+/**
+ * Set a cell to reference a text without copying it. The text does not
+ * need to be NULL terminated and it must be kept unchanged by the caller
+ * until the cell is given a new text or the table is freed. Snapshots of
+ * the table have their own copies of the texts.
+ * @param t Table pointer
+ * @param row
+ * @param col
+ * @param val Text
+ * @param len Length of text in bytes
+ * @return 0 on success, -1 on failure
+ */
+int
+utable_set_cell_ref(table_t *t, size_t row, size_t col, const char *val,
+                    size_t len) {
+    if (_utable_rc_chk(t, row, col) || (TCELL(row, col).flags & CELL_MERGED))
+        return -1;
+    _utable_cell_reftext(t, row, col, val, len);
+    TCELL(row, col).flags &= ~CELL_CBTXT;
+    return 0;
+}
+
+/**
+ * Set the cell left and right padding for all cells in the table. This
+ * overrides any padding previously set on column or cell level.
+ * @param t Table pointer
+ * @param lpad
+ * @param rpad
+ */
+void
+utable_set_table_cellpadding(table_t *t, size_t lpad, size_t rpad) {
+    t->deffmt.lpad = lpad;
+    t->deffmt.rpad = rpad;
+    t->deffmt.seq_pad = ++t->fmtSeq;
+    _utable_snap_touch_all(t);
+}
+
+/**
+ * Set callback function for cell used to populate the cell with text
+ * @param t Table pointer
+ * @param r row
+ * @param c column
+ * @param cb Callback function
+ */
+int
+utable_set_cellcallback(table_t *t, int row, int col, t_cell_cb cb) {
+    if (_utable_rc_chk(t, row, col) || (TCELL(row, col).flags & CELL_MERGED))
+        return -1;
+    // Only set callback if there is not already any text set
+    if (!TCELL(row, col).t) {
+        tovr_t *o = _utable_ovr_get(t, row, col);
+        if (NULL == o) return -1;
+        o->fmt.cb = cb;
+        o->fmt.seq_cb = ++t->fmtSeq;
+        t->haveCb |= NULL != cb;
+    }
+    return 0;
+}
+
+/**
+ * Set callback function for all cells in the column used to populate the
+ * cell with text. The callback is only used for cells that do not have any
+ * text set explicitly by utable_set_cell()
+ * @param t Table pointer
+ * @param col Column
+ * @param cb Callback function
+ * @return 0 on success, -1 on failure
+ */
+int
+utable_set_col_cellcallback(table_t *t, int col, t_cell_cb cb) {
+    if (_utable_col_chk(t, col)) return -1;
+    t->colfmt[col].cb = cb;
+    t->colfmt[col].seq_cb = ++t->fmtSeq;
+    t->haveCb |= NULL != cb;
+    return 0;
+}
+
+/**
+ * Set callback function for all cells in the table used to populate the cell
+ * with text. If the callback returns NULL then no change to the cells
+ * current text will be made. The callback is only used for cells that
+ * do not have any text set explicitly by utable_set_cell()
+ * @param t Table pointer
+ * @param cb Callback function
+ */
+void
+utable_set_table_cellcallback(table_t *t, t_cell_cb cb) {
+    t->deffmt.cb = cb;
+    t->deffmt.seq_cb = ++t->fmtSeq;
+    t->haveCb |= NULL != cb;
+}
+
+/**
+ * Get the callback function to use for the specified cell. A callback
+ * set on column or table level is only used if the cell does not have any
+ * text set by the user.
+ * @param t Table pointer
+ * @param row Row of cell
+ * @param col Column of cell
+ * @return Callback or NULL if the cell should not use a callback
+ */
+static t_cell_cb
+_utable_get_cb(table_t *t, size_t row, size_t col) {
+    tfmt_t f;
+    tovr_t *o = _utable_get_fmt(t, row, col, &f);
+    if (NULL == f.cb) return NULL;
+    if (o && o->fmt.seq_cb == f.seq_cb) return f.cb;
+    const tcell_t *cell = &TCELL(row, col);
+    return (NULL == cell->t || (cell->flags & CELL_CBTXT)) ? f.cb : NULL;
+}
+
+/**
+ * Internal helper to run the cell callbacks for all cells that have one and
+ * store the returned text in the cell. This is done before the column widths
+ * are computed so that the callback text is taken into account. Only the
+ * cells drawn in the view are updated.
+ * @param v View
+ */
+static void
+_utable_run_callbacks(tview_t *v) {
+    table_t *t = v->base;
+    if (!t->haveCb) return;
+    for (size_t i = 0; i < v->nRow; i++) {
+        for (size_t j = 0; j < v->nCol; j++) {
+            size_t r, c;
+            _utable_view_rc(v, i, j, &r, &c);
+            if (TCELL(r, c).flags & CELL_MERGED) continue;
+            const t_cell_cb cb = _utable_get_cb(t, r, c);
+            if (NULL == cb) continue;
+            char *cb_str = cb(r, c, t->tag);
+            STATS_COUNT(t, callbacks, 1);
+            if (NULL != cb_str &&
+                0 == _utable_cell_settext(t, r, c, cb_str, strlen(cb_str))) {
+                TCELL(r, c).flags |= CELL_CBTXT;
+                STATS_COUNT(t, allocs, 1);
+            }
+        }
+    }
+}
+
+/**
+ * Set the cell left and right padding
+ * @param t Table pointer
+ * @param row
+ * @param col
+ * @param lpad
+ * @param rpad
+ * @return 0 on success, -1 on failure
+ */
+int
+utable_set_cellpadding(table_t *t, size_t row, size_t col, size_t lpad,
+                       size_t rpad) {
+    if (_utable_rc_chk(t, row, col) || (TCELL(row, col).flags & CELL_MERGED))
+        return -1;
+    tovr_t *o = _utable_ovr_get(t, row, col);
+    if (NULL == o) return -1;
+    o->fmt.lpad = lpad;
+    o->fmt.rpad = rpad;
+    o->fmt.seq_pad = ++t->fmtSeq;
+    _utable_snap_touch(t, row);
+    return 0;
+}
+
+/**
+ * Set the cell left and right padding for all cells in a column. This
+ * overrides any padding previously set on individual cells in the column.
+ * @param t Table pointer
+ * @param lpad
+ * @param rpad
+ */
+void
+utable_set_col_cellpadding(table_t *t, size_t col, size_t lpad,
+                           size_t rpad) {
+    if (_utable_col_chk(t, col)) return;
+    t->colfmt[col].lpad = lpad;
+    t->colfmt[col].rpad = rpad;
+    t->colfmt[col].seq_pad = ++t->fmtSeq;
+    _utable_snap_touch_all(t);
+}
+
+static void
 _utable_get_cp(table_t *t, size_t row, size_t col, size_t *lpad,
                size_t *rpad) {
-    if (t->c[TIDX(row, col)].merged) {
-        row = t->c[TIDX(row, col)].pRow;
-        col = t->c[TIDX(row, col)].pCol;
+    tfmt_t f;
+    _utable_get_fmt(t, row, col, &f);
+    *lpad = f.lpad;
+    *rpad = f.rpad;
+}
+
+/**
+ * Set the width for the specified column
+ * @param t Table pointer
+ * @param col Column to set
+ * @param width Width to set
+ * @return 0 on success, -1 on failure
+ */
+int
+utable_set_colwidth(table_t *t, size_t col, size_t width) {
+    if (col >= t->nCol) return -1;
+    t->colwidth[col] = width;
+    return 0;
+}
+
+/**
+ * Set the width for all columns in the table
+ * @param t Table pointer
+ * @param width Width to set
+ */
+void
+utable_set_table_colwidth(table_t *t, size_t width) {
+    for (size_t c = 0; c < t->nCol; c++) {
+        utable_set_colwidth(t, c, width);
+    }
+}
+
+/**
+ * Reset column widths for entire table to auto
+ * @param t Table pointer
+ */
+void
+utable_reset_table_colwidth(table_t *t) {
+    utable_set_table_colwidth(t, 0);
+}
+
+/**
+ * Set the min width for the specified column
+ * @param t Table pointer
+ * @param col Column to set
+ * @param width Width to set
+ */
+int
+utable_set_mincolwidth(table_t *t, size_t col, size_t width) {
+    if (col >= t->nCol) return -1;
+    t->mincolwidth[col] = width;
+    return 0;
+}
+
+/**
+ * Set the minimum width for all columns in the table
+ * @param t Table pointer
+ * @param width Width to set
+ */
+void
+utable_set_table_mincolwidth(table_t *t, size_t width) {
+    for (size_t c = 0; c < t->nCol; c++) {
+        utable_set_mincolwidth(t, c, width);
+    }
+}
+
+static _Bool cut_in_padding = FALSE;
+
+/**
+ * Determine policy when table width is set too small to fit everythign that is
+ * needed. If flag is set to true then the left padding will be kept as much as
+ * possible and the text and the right padding will be cut as needed.
+ * If false then the padding will be kept as much as possible (both left and
+ * right) and the text cut as needed. Default is false sp the padding will be
+ * kept as much as possible
+ * @param cutInPadding
+ */
+void
+utable_set_padding_policy(_Bool cutInPadding) {
+    cut_in_padding = cutInPadding;
+}
+
+/**
+ * Enable or disable the specialized row kernel that is used to stroke the
+ * rows without column spans. The output is the same with both, the kernel
+ * is on by default and it is only meant to be turned off to compare against
+ * the generic code, e.g. in benchmarks. The setting is kept in the table so
+ * other tables, also those stroked by other threads, are not affected.
+ * @param t Table pointer
+ * @param enable Flag to enable/disable the kernel
+ */
+void
+utable_set_fast_render(table_t *t, _Bool enable) {
+    t->noKernel = !enable;
+}
+
+/**
+ * Internal helper function to draw the text of one cell, preceded by the
+ * separator to its left, aligned and padded to the specified width. The
+ * text is given with its length so no copies of it are needed and the cost
+ * is linear in the length of the text.
+ * @param s Output sink
+ * @param sep The border or vertical separator to the left of the cell
+ * @param txt Text to draw, NULL is drawn as an empty text
+ * @param txtlen Length of text in bytes
+ * @param w Width of the cell in characters
+ * @param lpad Left padding
+ * @param rpad Right padding
+ * @param halign Horizontal alignment
+ * @return 1 if the text had to be truncated to fit, 0 otherwise
+ */
+static int
+_utable_draw_cell_text(tsink_t *s, const char *sep, const char *txt,
+                       size_t txtlen, int w, size_t lpad, size_t rpad,
+                       halign_t halign) {
+    // The visible content is the left padding, a prefix of the text and the
+    // right padding. Find how much of each fits in the cell.
+    size_t a = 0, b = 0, bw = 0, c = 0;
+    int cut;
+
+    // A choice in how to handle the case when the column width is smaller
+    // than what is needed. We can either include the padding chars in the
+    // limiting or try to maintain the padding and only limiting the actual
+    // content
+    if (cut_in_padding) {
+        // Cut the text so that even the right padding is cut
+        if (w > 0) {
+            a = MIN(lpad, (size_t) w);
+            if (a == lpad) b = xmb_dispoffset_n(txt, txtlen, w - a, &bw);
+            if (b == txtlen) c = MIN(rpad, w - a - bw);
+        }
+    } else {
+        // Keep the padding chars as much as possible
+        const int limit = w - (int) rpad;
+        if (limit > 0) {
+            a = MIN(lpad, (size_t) limit);
+            if (a == lpad) b = xmb_dispoffset_n(txt, txtlen, limit - a, &bw);
+        }
+        if (w > 0) c = MIN(rpad, w - a - bw);
+    }
+    cut = a + b < lpad + txtlen;
+
+    // Fill the cell to the assigned width in order to make the text left,
+    // right or center aligned
+    const int cw = a + bw + c;
+    const size_t fill = w > cw ? w - cw : 0;
+
+    tsink_puts(s, sep);
+    switch (halign) {
+        case RIGHTALIGN:
+            tsink_fill(s, ' ', fill + a);
+            tsink_write(s, txt, b);
+            tsink_fill(s, ' ', c);
+            break;
+        case LEFTALIGN:
+            tsink_fill(s, ' ', a);
+            tsink_write(s, txt, b);
+            tsink_fill(s, ' ', c + fill);
+            break;
+        case CENTERALIGN:
+        default: {
+            const int lfill = w / 2 - cw / 2;
+            tsink_fill(s, ' ', lfill + a);
+            tsink_write(s, txt, b);
+            tsink_fill(s, ' ', c + fill - lfill);
+            break;
+        }
+    }
+    return cut;
+}
+
+/**
+ * Internal helper function to draw a single line of table data
+ * @param s Output sink
+ * @param v View
+ * @param i Row in the view to draw
+ * @param midleft Left border
+ * @param midright Right border
+ * @param midvert Vertical separator between cells
+ */
+static void
+_utable_draw_cellcontent_row(tsink_t *s, tview_t *v, size_t i, char *midleft,
+                             char *midright, char *midvert) {
+    table_t *t = v->base;
+    size_t j = 0;
+
+    while (j < v->nCol) {
+        int w = 0;
+        size_t r, c;
+        _utable_view_rc(v, i, j, &r, &c);
+
+        // Determine the total width of this cell. This needs to take
+        // into account the fact that this could be a cell that is spanning
+        // multiple other cells.
+        tfmt_t f;
+        tovr_t *o = _utable_get_fmt(t, r, c, &f);
+        const size_t cspan = _utable_view_cspan(v, j, r, c, o ? o->cspan : 1);
+        for (size_t cs = 0; cs < cspan; cs++) {
+            w += v->colwidth[j + cs] + 1;
+        }
+        w -= 1;  // Don't include the last border since that remains
+
+        const tcell_t *cell = &TCELL(r, c);
+        const _Bool merged = cell->flags & CELL_MERGED;
+        const int cut = _utable_draw_cell_text(
+                s, j == 0 ? midleft : midvert, merged ? NULL : cell->t,
+                merged ? 0 : cell->len, w, f.lpad, f.rpad, f.halign);
+        STATS_COUNT(t, truncated, cut);
+        j += cspan;
+    }
+    tsink_puts(s, midright);
+    tsink_write(s, "\n", 1);
+}
+
+/**
+ * Internal helper function to draw the title line. The title is centered
+ * over the full width of the table.
+ * @param s Output sink
+ * @param t Table pointer
+ * @param totwidth Total width of the table including borders
+ * @param border Vertical border character
+ */
+static void
+_utable_draw_title_row(tsink_t *s, table_t *t, int totwidth, char *border) {
+    _utable_draw_cell_text(s, border, t->title, strlen(t->title),
+                           totwidth - 1, 0, 0, CENTERALIGN);
+    tsink_puts(s, border);
+    tsink_write(s, "\n", 1);
+}
+
+/**
+ * Internal helper to get the memory used by the column footers
+ * @param t Table pointer
+ * @return Size in bytes
+ */
+static size_t
+_utable_agg_size(table_t *t) {
+    if (NULL == t->agg) return 0;
+    size_t n = t->nCol * sizeof(tagg_t);
+    for (size_t c = 0; c < t->nCol; c++) {
+        const tagg_t *a = &t->agg[c];
+        if (a->fmt) n += strlen(a->fmt) + 1;
+        if (a->label) n += strlen(a->label) + 1;
+        if (a->val) n += t->nRow * sizeof(double);
+    }
+    return n;
+}
+
+/**
+ * Internal helper to get the footer of a column, creating the footers
+ * for all columns the first time
+ * @param t Table pointer
+ * @param col Column
+ * @return NULL on failure, the footer otherwise
+ */
+static tagg_t *
+_utable_agg_get(table_t *t, size_t col) {
+    if (_utable_col_chk(t, col)) return NULL;
+    if (NULL == t->agg) {
+        t->agg = calloc(t->nCol, sizeof(tagg_t));
+        if (NULL == t->agg) {
+            logmsg("CRITICAL : Failed to set footer. Out of memory.");
+            return NULL;
+        }
+        MEM_ADD(t->nCol * sizeof(tagg_t));
+    }
+    return &t->agg[col];
+}
+
+/**
+ * Internal helper to replace a footer string with a copy of the new string
+ * @param old String to replace
+ * @param str New string, may be NULL
+ * @return 0 on success, -1 on failure
+ */
+static int
+_utable_agg_setstr(char **old, const char *str) {
+    char *cpy = NULL;
+    if (str) {
+        cpy = strdup(str);
+        if (NULL == cpy) {
+            logmsg("CRITICAL : Failed to set footer. Out of memory.");
+            return -1;
+        }
+        MEM_ADD(strlen(cpy) + 1);
+    }
+    if (*old) MEM_SUB(strlen(*old) + 1);
+    free(*old);
+    *old = cpy;
+    return 0;
+}
+
+/**
+ * Set the aggregate that is drawn in the footer row below a column. The
+ * aggregate is computed when the table is stroked over the cells that hold
+ * a number, other cells are ignored. When a view is stroked only the rows
+ * in the view are included. The footer row is drawn below a line in the
+ * style of the interior lines as soon as any column has an aggregate or a
+ * footer label.
+ * @param t Table pointer
+ * @param col Column
+ * @param agg Aggregate, AGG_NONE to remove
+ * @param fmt printf() format for the value, e.g. "%.2f". The value is passed
+ *            as a double. NULL gives "%.15g".
+ * @return 0 on success, -1 on failure
+ */
+int
+utable_set_col_aggregate(table_t *t, size_t col, aggregate_t agg,
+                         const char *fmt) {
+    tagg_t *a = _utable_agg_get(t, col);
+    if (NULL == a || _utable_agg_setstr(&a->fmt, fmt)) return -1;
+    a->agg = agg;
+    return 0;
+}
+
+/**
+ * Set a text that is drawn in the footer row below a column that has no
+ * aggregate, typically a "Total" label in the first column.
+ * @param t Table pointer
+ * @param col Column
+ * @param label Text, NULL to remove
+ * @return 0 on success, -1 on failure
+ */
+int
+utable_set_footer_label(table_t *t, size_t col, const char *label) {
+    tagg_t *a = _utable_agg_get(t, col);
+    if (NULL == a) return -1;
+    return _utable_agg_setstr(&a->label, label);
+}
+
+/**
+ * Internal helper to check if any column has a footer
+ * @param t Table pointer
+ * @return TRUE if the footer row should be drawn
+ */
+static _Bool
+_utable_have_footer(table_t *t) {
+    if (NULL == t->agg) return FALSE;
+    for (size_t c = 0; c < t->nCol; c++) {
+        if (t->agg[c].agg != AGG_NONE || t->agg[c].label) return TRUE;
+    }
+    return FALSE;
+}
+
+/**
+ * Internal helper to parse the value of every cell in a column into the
+ * contiguous value vector. This is only done when a cell in the column has
+ * changed since the last time.
+ * @param t Table pointer
+ * @param col Column
+ * @return 0 on success, -1 on failure
+ */
+static int
+_utable_agg_parse(table_t *t, size_t col) {
+    tagg_t *a = &t->agg[col];
+    if (a->val && !a->dirty) return 0;
+    if (NULL == a->val) {
+        a->val = malloc(t->nRow * sizeof(double) + 1);
+        if (NULL == a->val) {
+            logmsg("CRITICAL : Failed to compute footer. Out of memory.");
+            return -1;
+        }
+        MEM_ADD(t->nRow * sizeof(double));
+    }
+    for (size_t r = 0; r < t->nRow; r++) {
+        const tcell_t *cell = &TCELL(r, col);
+        double v;
+        if ((cell->flags & CELL_MERGED) || _utable_cell_double(cell, &v))
+            v = NAN;
+        a->val[r] = v;
+    }
+    a->dirty = FALSE;
+    a->reduced = FALSE;
+    return 0;
+}
+
+/**
+ * Internal helper to reduce a vector of values to the sum, minimum, maximum
+ * and number of values that are not NaN. The loop keeps four independent
+ * lanes without branches so the compiler can keep it in vector registers.
+ * @param x Values
+ * @param n Number of values
+ * @param a Footer to add the totals to
+ */
+static void
+_utable_agg_reduce(const double *x, size_t n, tagg_t *a) {
+    double sum[4] = {0, 0, 0, 0};
+    double lo[4] = {INFINITY, INFINITY, INFINITY, INFINITY};
+    double hi[4] = {-INFINITY, -INFINITY, -INFINITY, -INFINITY};
+    size_t cnt[4] = {0, 0, 0, 0};
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        for (int l = 0; l < 4; l++) {
+            // NaN compares false so it never changes the minimum or maximum
+            const double v = x[i + l];
+            const _Bool ok = v == v;
+            sum[l] += ok ? v : 0.0;
+            cnt[l] += ok;
+            lo[l] = v < lo[l] ? v : lo[l];
+            hi[l] = v > hi[l] ? v : hi[l];
+        }
+    }
+    for (; i < n; i++) {
+        const double v = x[i];
+        const _Bool ok = v == v;
+        sum[0] += ok ? v : 0.0;
+        cnt[0] += ok;
+        lo[0] = v < lo[0] ? v : lo[0];
+        hi[0] = v > hi[0] ? v : hi[0];
+    }
+    for (int l = 0; l < 4; l++) {
+        a->sum += sum[l];
+        a->count += cnt[l];
+        a->min = MIN(a->min, lo[l]);
+        a->max = MAX(a->max, hi[l]);
+    }
+}
+
+/**
+ * Internal helper to compute the totals of a column over all rows. The
+ * totals are kept and reused as long as the column is not changed.
+ * @param t Table pointer
+ * @param col Column
+ * @return 0 on success, -1 on failure
+ */
+static int
+_utable_agg_totals(table_t *t, size_t col) {
+    tagg_t *a = &t->agg[col];
+    if (_utable_agg_parse(t, col)) return -1;
+    if (!a->reduced) {
+        a->sum = 0;
+        a->count = 0;
+        a->min = INFINITY;
+        a->max = -INFINITY;
+        _utable_agg_reduce(a->val, t->nRow, a);
+        a->reduced = TRUE;
+    }
+    return 0;
+}
+
+/**
+ * Internal helper to compute the footer text of a column over the rows in
+ * a view. For a view of a subset of the rows the values are gathered in
+ * blocks and reduced with the same loop as the totals.
+ * @param v View
+ * @param col Column in the base table
+ * @param buff Buffer of AGG_TEXT_SIZE bytes for the formatted value
+ * @return The footer text
+ */
+static const char *
+_utable_agg_text(tview_t *v, size_t col, char *buff) {
+    table_t *t = v->base;
+    tagg_t *a = &t->agg[col];
+    if (AGG_NONE == a->agg) return a->label ? a->label : "";
+
+    tagg_t res;
+    res.sum = 0;
+    res.count = 0;
+    res.min = INFINITY;
+    res.max = -INFINITY;
+    if (NULL == v->rows || v->rows == t->rowmap) {
+        // All rows of the table, in any order
+        if (_utable_agg_totals(t, col)) return "";
+        res = *a;
+    } else {
+        if (_utable_agg_parse(t, col)) return "";
+        double buff[256];
+        for (size_t i = 0; i < v->nRow; i += 256) {
+            const size_t n = MIN(256, v->nRow - i);
+            for (size_t k = 0; k < n; k++) buff[k] = a->val[v->rows[i + k]];
+            _utable_agg_reduce(buff, n, &res);
+        }
+    }
+
+    double val = 0;
+    switch (a->agg) {
+        case AGG_SUM:
+            val = res.sum;
+            break;
+        case AGG_MIN:
+            val = res.min;
+            break;
+        case AGG_MAX:
+            val = res.max;
+            break;
+        case AGG_MEAN:
+            val = res.count ? res.sum / res.count : 0;
+            break;
+        case AGG_COUNT:
+        default:
+            val = res.count;
+            break;
+    }
+    // Only the sum and the count are defined without any numeric cells
+    if (0 == res.count && AGG_SUM != a->agg && AGG_COUNT != a->agg) {
+        buff[0] = '\0';
+    } else {
+        snprintf(buff, AGG_TEXT_SIZE, a->fmt ? a->fmt : "%.15g", val);
+    }
+    return buff;
+}
+
+/**
+ * Internal helper to get the format of a column, which is the table and
+ * column format without any cell overrides
+ * @param t Table pointer
+ * @param col Column in the base table
+ * @param f Resolved format
+ */
+static void
+_utable_col_fmt(table_t *t, size_t col, tfmt_t *f) {
+    *f = t->deffmt;
+    _utable_merge_fmt(f, &t->colfmt[col]);
+}
+
+/**
+ * Internal helper to compute the footer text of every column in a view. The
+ * texts are formatted into memory owned by the caller so that a stroke does
+ * not change the table.
+ * @param v View
+ * @param ftxt Footer text for each column in the view, followed by room for
+ *             AGG_TEXT_SIZE bytes per column
+ */
+static void
+_utable_footer_texts(tview_t *v, const char *ftxt[]) {
+    char *buff = (char *) (ftxt + v->nCol);
+    for (size_t j = 0; j < v->nCol; j++)
+        ftxt[j] = _utable_agg_text(v, v->cols ? v->cols[j] : j,
+                                   buff + j * AGG_TEXT_SIZE);
+}
+
+/**
+ * Internal helper to allocate the footer texts for a view
+ * @param v View
+ * @return NULL on failure, the footer texts otherwise
+ */
+static const char **
+_utable_footer_alloc(tview_t *v) {
+    return malloc(v->nCol * (sizeof(char *) + AGG_TEXT_SIZE));
+}
+
+/**
+ * Internal helper function to draw the footer row
+ * @param s Output sink
+ * @param v View
+ * @param ftxt Footer text for each column in the view
+ * @param midleft Left border
+ * @param midright Right border
+ * @param midvert Vertical separator between cells
+ */
+static void
+_utable_draw_footer_row(tsink_t *s, tview_t *v, const char *ftxt[],
+                        char *midleft, char *midright, char *midvert) {
+    for (size_t j = 0; j < v->nCol; j++) {
+        tfmt_t f;
+        _utable_col_fmt(v->base, v->cols ? v->cols[j] : j, &f);
+        _utable_draw_cell_text(s, j == 0 ? midleft : midvert, ftxt[j],
+                               strlen(ftxt[j]), v->colwidth[j], f.lpad, f.rpad,
+                               f.halign);
+    }
+    tsink_puts(s, midright);
+    tsink_write(s, "\n", 1);
+}
+
+/**
+ * Internal helper to mark the vertical borders of a row where every column
+ * is a cell of its own, like the footer row or any row in a table without
+ * column spans
+ * @param v View
+ * @param eval
+ * @param mark
+ */
+static void
+_utable_mark_columns(tview_t *v, int eval[], int mark) {
+    size_t absw = 0;
+    for (size_t j = 0; j < v->nCol; j++) {
+        absw += v->colwidth[j] + 1;
+        eval[absw - 1] |= mark;
+    }
+}
+
+/**
+ * Set automatic column width for columns with no user specified width. Only
+ * the cells drawn in the view are taken into account.
+ * @param v View to set the column widths for
+ * @param ftxt Footer text for each column, NULL if there is no footer
+ */
+static void
+_utable_set_autocolwidth(tview_t *v, const char *ftxt[]) {
+    table_t *t = v->base;
+    for (size_t j = 0; j < v->nCol; j++) {
+        // A table is its own view and must not be written to when the
+        // widths are already known, since a snapshot may be stroked by
+        // several threads at once
+        if (v->colwidth != v->setwidth) v->colwidth[j] = v->setwidth[j];
+        if (v->colwidth[j] == 0) {
+            // User has not yet set column width so find the widest text.
+            // The table title is not part of the cells and never affects
+            // the column widths.
+            size_t r = 0, c = 0;
+            size_t n = v->nRow;
+            if (t->snapRefs && !v->transposed &&
+                (NULL == v->rows || v->rows == t->rowmap)) {
+                // The widest cell in each chunk of a snapshot is known
+                c = v->cols ? v->cols[j] : j;
+                for (size_t k = 0; k * SNAP_ROWS < t->nRow; k++)
+                    v->colwidth[j] = MAX(v->colwidth[j], t->chunks[k]->w[c]);
+                n = 0;
+            }
+            for (size_t i = 0; i < n; i++) {
+                _utable_view_rc(v, i, j, &r, &c);
+                size_t lpad, rpad;
+                _utable_get_cp(t, r, c, &lpad, &rpad);
+                const tcell_t *cell = &TCELL(r, c);
+                const size_t w = xmb_width_n(cell->t, cell->len) + lpad + rpad;
+                if (w > v->colwidth[j]) v->colwidth[j] = w;
+            }
+            if (ftxt) {
+                tfmt_t f;
+                _utable_col_fmt(t, v->cols ? v->cols[j] : j, &f);
+                const size_t w = xmb_width(ftxt[j]) + f.lpad + f.rpad;
+                if (w > v->colwidth[j]) v->colwidth[j] = w;
+            }
+            // The minimum width is set per column in the base table
+            if (!v->transposed)
+                v->colwidth[j] = MAX(v->colwidth[j],
+                                     t->mincolwidth[v->cols ? v->cols[j] : j]);
+            // Make sure the column width is at least 1 character wide
+            if (0 == v->colwidth[j]) v->colwidth[j] = 1;
+        }
+    }
+}
+
+/**
+ * Internal helper function. This functions builds a logic view of the border
+ * between two rows. Since the vertical borders up and down are not necessarily
+ * always on the same position since cell can have been merged (spans over
+ * several columns) this function sets a the logical map "eval" if it
+ * discovers the need for vertical border. The same logical map are used
+ * with both the "over" and "under" row of data. The value to logically or
+ * is specified in the "mark" argument. To find the top verticals
+ * we normally call this function with mark==1 and for the bottom verticals
+ * we call this with mark==2. If the logical map is initialized with 0 this will
+ * can the be interpretated as 0=only a horizontal, 1=horizontal with an "up"
+ * vertical, 2=horizontal with an "down" vertical and 2=horizontal with both up
+ * and down vertical
+ * @param v View
+ * @param eval
+ * @param mark
+ * @param i Row in the view
+ */
+static void
+_utable_mark_verticals(tview_t *v, int eval[], int mark, size_t i) {
+    size_t j = 0;
+    size_t absw = 0;
+    while (j < v->nCol) {
+        int w = 0;
+        size_t r, c;
+        _utable_view_rc(v, i, j, &r, &c);
+        const size_t cspan =
+                _utable_view_cspan(v, j, r, c, _utable_get_cspan(v->base, r, c));
+        for (size_t cs = 0; cs < cspan; cs++) {
+            w += v->colwidth[j + cs] + 1;
+        }
+
+        absw += w;
+        eval[absw - 1] |= mark;
+        j += cspan;
+    }
+}
+
+/**
+ * Internal helper functions to write out the border characters identified by
+ * the _mark_verticals
+ * @param s Output sink
+ * @param totwidth
+ * @param eval
+ * @param s0
+ * @param s1
+ * @param s2
+ * @param s3
+ */
+static void
+_utable_stroke_verticals(tsink_t *s, int totwidth, int eval[], char *s0,
+                         char *s1, char *s2, char *s3) {
+    // Look up the glyphs and their lengths once for the whole line
+    const char *g[4] = {s0, s1, s2, s3};
+    size_t glen[4];
+    for (int i = 0; i < 4; i++) {
+        if (NULL == g[i]) g[i] = "#ERR#";
+        glen[i] = strlen(g[i]);
+    }
+    for (int i = 0; i < totwidth - 1; i++) {
+        // 0=HORIZONTAL, 1=TOP DOWN, 2=BOTTOM UP, 3=CROSS
+        tsink_write(s, g[eval[i]], glen[eval[i]]);
+    }
+}
+
+/**
+ * Internal helper to write a horizontal line across the table with the
+ * specified left and right ends
+ * @param s Output sink
+ * @param totwidth
+ * @param eval
+ * @param left Left end of line
+ * @param right Right end of line
+ * @param s0
+ * @param s1
+ * @param s2
+ * @param s3
+ */
+static void
+_utable_stroke_line(tsink_t *s, int totwidth, int eval[], char *left,
+                    char *right, char *s0, char *s1, char *s2, char *s3) {
+    tsink_puts(s, left);
+    _utable_stroke_verticals(s, totwidth, eval, s0, s1, s2, s3);
+    tsink_puts(s, right);
+    tsink_write(s, "\n", 1);
+}
+
+/**
+ * Layout of one column for the specialized row kernel. It is computed once
+ * per stroke from the table and column formats.
+ */
+typedef struct {
+    const char *sep;    // Separator to the left of the column
+    size_t seplen;      // Length of the separator in bytes
+    size_t col;         // Column in the base table
+    size_t w;           // Column width
+    size_t lpad, rpad;  // Left and right padding
+    halign_t halign;    // Horizontal alignment
+} tkcol_t;
+
+/**
+ * Internal helper to set up the column layout for the specialized row kernel.
+ * The kernel is used for the rows without spans when the view is not
+ * transposed, since then these rows have the same cell borders and every
+ * cell in a column has the column format unless it has an override.
+ * @param v View
+ * @param sd Style
+ * @return NULL if the kernel can't be used, the column layout otherwise
+ */
+static tkcol_t *
+_utable_kernel_plan(tview_t *v, const style_t *sd) {
+    table_t *t = v->base;
+    if (t->noKernel || v->transposed || 0 == v->nRow) return NULL;
+    tkcol_t *k = malloc(v->nCol * sizeof(tkcol_t));
+    if (NULL == k) return NULL;
+    STATS_COUNT(t, allocs, 1);
+    for (size_t j = 0; j < v->nCol; j++) {
+        tfmt_t f;
+        k[j].col = v->cols ? v->cols[j] : j;
+        _utable_col_fmt(t, k[j].col, &f);
+        k[j].sep = j == 0 ? sd->border_vertical : sd->middle_vertical;
+        k[j].seplen = strlen(k[j].sep);
+        k[j].w = v->colwidth[j];
+        k[j].lpad = f.lpad;
+        k[j].rpad = f.rpad;
+        k[j].halign = f.halign;
+    }
+    return k;
+}
+
+/**
+ * Internal helper to draw a row with the specialized kernel. A cell whose
+ * text fits is drawn directly from the column layout. Cells that have an
+ * override or that need to be truncated are drawn by the generic code.
+ * @param s Output sink
+ * @param v View
+ * @param i Row in the view to draw
+ * @param k Column layout
+ * @param right Right border
+ * @param rightlen Length of the right border in bytes
+ */
+static void
+_utable_draw_row_kernel(tsink_t *s, tview_t *v, size_t i, const tkcol_t *k,
+                        const char *right, size_t rightlen) {
+    table_t *t = v->base;
+    const size_t r = v->rows ? v->rows[i] : i;
+    const tcell_t *row = t->row[r];
+    for (size_t j = 0; j < v->nCol; j++) {
+        const tkcol_t *kc = &k[j];
+        const tcell_t *cell = &row[kc->col];
+        tsink_write(s, kc->sep, kc->seplen);
+        const size_t tw = xmb_width_n(cell->t, cell->len);
+        if ((cell->flags & (CELL_OVR | CELL_MERGED)) ||
+            kc->lpad + tw + kc->rpad > kc->w) {
+            tfmt_t f;
+            _utable_get_fmt(t, r, kc->col, &f);
+            const _Bool merged = cell->flags & CELL_MERGED;
+            const int cut = _utable_draw_cell_text(
+                    s, "", merged ? NULL : cell->t, merged ? 0 : cell->len,
+                    kc->w, f.lpad, f.rpad, f.halign);
+            STATS_COUNT(t, truncated, cut);
+            continue;
+        }
+        // The text and both paddings fit, only the fill depends on the
+        // alignment
+        const size_t fill = kc->w - kc->lpad - tw - kc->rpad;
+        switch (kc->halign) {
+            case RIGHTALIGN:
+                tsink_fill(s, ' ', fill + kc->lpad);
+                tsink_write(s, cell->t, cell->len);
+                tsink_fill(s, ' ', kc->rpad);
+                break;
+            case LEFTALIGN:
+                tsink_fill(s, ' ', kc->lpad);
+                tsink_write(s, cell->t, cell->len);
+                tsink_fill(s, ' ', kc->rpad + fill);
+                break;
+            case CENTERALIGN:
+            default: {
+                const size_t lfill =
+                        kc->w / 2 - (kc->lpad + tw + kc->rpad) / 2;
+                tsink_fill(s, ' ', lfill + kc->lpad);
+                tsink_write(s, cell->t, cell->len);
+                tsink_fill(s, ' ', kc->rpad + fill - lfill);
+                break;
+            }
+        }
+    }
+    tsink_write(s, right, rightlen);
+    tsink_write(s, "\n", 1);
+}
+
+/**
+ * Internal helper to draw a horizontal line into a new buffer so that it can
+ * be written again for every row
+ * @param totwidth
+ * @param eval
+ * @param left Left end of line
+ * @param right Right end of line
+ * @param s0
+ * @param s1
+ * @param s2
+ * @param s3
+ * @param len Length of the line in bytes
+ * @return NULL on failure, the line otherwise
+ */
+static char *
+_utable_stroke_line_buf(int totwidth, int eval[], char *left, char *right,
+                        char *s0, char *s1, char *s2, char *s3, size_t *len) {
+    const char *g[4] = {s0, s1, s2, s3};
+    size_t glen = strlen("#ERR#");
+    for (int i = 0; i < 4; i++) {
+        if (g[i]) glen = MAX(glen, strlen(g[i]));
+    }
+    const size_t size = strlen(left) + strlen(right) + totwidth * glen + 2;
+    char *buff = malloc(size);
+    if (NULL == buff) return NULL;
+    tsink_t ls;
+    tsink_init_buf(&ls, buff, size);
+    _utable_stroke_line(&ls, totwidth, eval, left, right, s0, s1, s2, s3);
+    *len = ls.len;
+    return buff;
+}
+
+/**
+ * Set display of interior horizontal and vertical border
+ * @param t Table pointer
+ * @param v Flag to enable/disable vertical interior borders
+ * @param h Flag to enable/disable horizontal interior borders
+ */
+void
+utable_set_interior(table_t *t, _Bool v, _Bool h) {
+    t->interior_v = v;
+    t->interior_h = h;
+}
+
+/**
+ * State of a stroke. Everything that is computed before the first row is
+ * drawn is kept here so that the rows can also be drawn a few at a time by
+ * a resumable stroke.
+ */
+struct tstroke {
+    tview_t view;       // The table itself when a table is stroked
+    tview_t *v;         // View being stroked
+    tsink_t sink;       // Output sink of a resumable stroke
+    tsink_t *s;         // Output sink
+    style_t sd;         // Characters to use for the style
+    const char **ftxt;  // Footer texts, NULL if there is no footer
+    size_t totwidth;    // Total width of the table in characters
+    int *eval;          // Marks of the vertical borders in a line
+    tkcol_t *kc;        // Column layout for the row kernel, NULL if not used
+    char *hline;        // Interior line drawn by the row kernel
+    size_t hlen;        // Length of the interior line in bytes
+    size_t *xpos;       // Position of each column when spans are drawn from
+                        // the span index, NULL otherwise
+    int *cmarks;        // Marks of the borders of all columns
+    size_t c0;          // Column in the base table drawn first
+    size_t spanRow[2];  // View rows of the last two span lookups, a row and
+                        // the line below it look up the same two rows
+    const tspan_t *spanAt[2];   // Spans found by these lookups
+    size_t spanN[2];    // Number of spans found by these lookups
+    size_t row;         // Next row in the view to draw
+    enum { STROKE_HEAD, STROKE_ROWS, STROKE_DONE } phase;   // Next part to draw
+    unsigned long long ts;  // Time of the last statistics lap
+    tview_t sub;        // Columns drawn by a window stroke
+    tsink_t *out;       // Output of a window stroke, NULL otherwise
+    tsink_t clip;       // Lines of a window stroke before they are clipped
+    size_t lo;          // First column in the view that is drawn
+    size_t xlo;         // Position of the first drawn column in the table
+    size_t x0, width;   // Window in characters
+    size_t fullwidth;   // Total width of the table with all columns
+};
+
+/**
+ * Internal helper to release the memory used by a stroke state
+ * @param st Stroke state
+ */
+static void
+_utable_stroke_release(tstroke_t *st) {
+    free(st->ftxt);
+    free(st->eval);
+    free(st->kc);
+    free(st->hline);
+    free(st->xpos);
+    free(st->cmarks);
+    free(st->sub.cols);
+    if (st->out) tsink_close(&st->clip);
+}
+
+/**
+ * Internal helper to write the part of a line that is inside a window. A
+ * wide character that is only partly inside the window is drawn as blanks.
+ * The window is found from both ends of the line so that only the part of
+ * the line that is cut away is scanned.
+ * @param s Output sink
+ * @param line Line without the newline
+ * @param len Length of line in bytes
+ * @param lw Width of line in characters
+ * @param x0 First character of the line in the window
+ * @param width Width of the window in characters
+ */
+static void
+_utable_clip_line(tsink_t *s, const char *line, size_t len, size_t lw,
+                  size_t x0, size_t width) {
+    size_t w, lpad = 0, rpad = 0;
+    size_t b = xmb_dispoffset_n(line, len, x0, &w);
+    if (w < x0 && b < len) {
+        b = xmb_dispoffset_n(line, len, x0 + 1, &w);
+        lpad = MIN(w - x0, width);
+    }
+    // Step back over the characters to the right of the window. Zero width
+    // characters are dropped together with the character before them.
+    const size_t drop = lw > x0 + width ? lw - x0 - width : 0;
+    size_t e = len, dropped = 0;
+    while (dropped < drop && e > b) {
+        size_t k = e - 1;
+        while (k > b && 0x80 == (line[k] & 0xC0)) k--;
+        dropped += xmb_width_n(line + k, e - k);
+        e = k;
+    }
+    if (dropped > drop) rpad = MIN(dropped - drop, width - lpad);
+    tsink_fill(s, ' ', lpad);
+    tsink_write(s, line + b, e - b);
+    tsink_fill(s, ' ', rpad);
+    tsink_write(s, "\n", 1);
+}
+
+/**
+ * Internal helper to move the lines drawn by a window stroke to the output,
+ * clipped to the window
+ * @param st Stroke state
+ * @param x0 First character of the lines in the window
+ * @param lw Width of the lines in characters
+ */
+static void
+_utable_stroke_clip(tstroke_t *st, size_t x0, size_t lw) {
+    const char *p = st->clip.buf;
+    const char *end = p + st->clip.len;
+    while (p < end) {
+        const char *nl = memchr(p, '\n', end - p);
+        if (NULL == nl) break;
+        _utable_clip_line(st->out, p, nl - p, lw, x0, st->width);
+        p = nl + 1;
+    }
+    st->clip.len = 0;
+    if (st->clip.err) st->out->err = 1;
+}
+
+/**
+ * Internal helper to check if a view draws the columns of its base table in
+ * table order, in which case the borders of the rows are found from the span
+ * index
+ * @param v View
+ * @param c0 Column in the base table drawn first
+ * @return TRUE if the columns are in table order, FALSE otherwise
+ */
+static _Bool
+_utable_span_cols(const tview_t *v, size_t *c0) {
+    *c0 = v->cols && v->nCol ? v->cols[0] : 0;
+    if (v->transposed) return FALSE;
+    for (size_t j = 1; v->cols && j < v->nCol; j++) {
+        if (v->cols[j] != *c0 + j) return FALSE;
+    }
+    return TRUE;
+}
+
+/**
+ * Internal helper to get the spans in a row of a view drawn from the span
+ * index
+ * @param st Stroke state
+ * @param i Row in the view
+ * @param n Number of spans
+ * @return The spans in the row, NULL if the row has none or the view is not
+ *         drawn from the span index
+ */
+static const tspan_t *
+_utable_stroke_spans(tstroke_t *st, size_t i, size_t *n) {
+    *n = 0;
+    if (NULL == st->xpos) return NULL;
+    for (int k = 0; k < 2; k++) {
+        if (st->spanRow[k] == i) {
+            *n = st->spanN[k];
+            return st->spanAt[k];
+        }
+    }
+    const tview_t *v = st->v;
+    const tspan_t *sp = _utable_span_row(v->base, v->rows ? v->rows[i] : i, n);
+    st->spanRow[0] = st->spanRow[1];
+    st->spanAt[0] = st->spanAt[1];
+    st->spanN[0] = st->spanN[1];
+    st->spanRow[1] = i;
+    st->spanAt[1] = sp;
+    st->spanN[1] = *n;
+    return sp;
+}
+
+/**
+ * Internal helper to clip a span to the columns drawn by a stroke. A span
+ * that starts to the left of the drawn columns is not drawn as a span and
+ * the cells it covers are drawn on their own.
+ * @param st Stroke state
+ * @param sp Span
+ * @param j First column in the view
+ * @param m Number of columns in the view
+ * @return TRUE if the span is drawn, FALSE otherwise
+ */
+static _Bool
+_utable_span_clip(const tstroke_t *st, const tspan_t *sp, size_t *j,
+                  size_t *m) {
+    if (sp->col < st->c0 || sp->col >= st->c0 + st->v->nCol) return FALSE;
+    *j = sp->col - st->c0;
+    *m = MIN(sp->cspan, st->v->nCol - *j);
+    return TRUE;
+}
+
+/**
+ * Internal helper to mark the vertical borders of the line between two rows
+ * of a view. From the span index the line starts as the borders of all
+ * columns and only the borders inside the spans of the two rows are
+ * removed, so a row without spans costs nothing more than a table without
+ * spans. Where a row span continues across the line the line has a gap.
+ * Otherwise each cell of the two rows is looked at.
+ * @param st Stroke state
+ * @param above Row in the view above the line, SIZE_MAX for none
+ * @param below Row in the view below the line, SIZE_MAX for none
+ * @return TRUE if the line has a gap, FALSE otherwise
+ */
+static _Bool
+_utable_stroke_marks(tstroke_t *st, size_t above, size_t below) {
+    tview_t *v = st->v;
+    int *eval = st->eval;
+    const size_t *xpos = st->xpos;
+    if (NULL == xpos) {
+        memset(eval, 0, sizeof(int) * st->totwidth);
+        if (SIZE_MAX != above) _utable_mark_verticals(v, eval, 2, above);
+        if (SIZE_MAX != below) _utable_mark_verticals(v, eval, 1, below);
+        return FALSE;
+    }
+
+    memcpy(eval, st->cmarks, sizeof(int) * st->totwidth);
+    const int keep = (SIZE_MAX != above ? 2 : 0) | (SIZE_MAX != below ? 1 : 0);
+    for (size_t x = 0; keep != 3 && x < st->totwidth; x++) eval[x] &= keep;
+
+    size_t n, j, m;
+    const tspan_t *sp =
+            SIZE_MAX != above ? _utable_stroke_spans(st, above, &n) : NULL;
+    for (size_t k = 0; sp && k < n; k++) {
+        if (!_utable_span_clip(st, &sp[k], &j, &m)) continue;
+        for (size_t q = j + 1; q < j + m; q++) eval[xpos[q] - 1] &= ~2;
+    }
+
+    _Bool gap = FALSE;
+    const size_t ra = SIZE_MAX != above ? (v->rows ? v->rows[above] : above) : 0;
+    sp = SIZE_MAX != below ? _utable_stroke_spans(st, below, &n) : NULL;
+    for (size_t k = 0; sp && k < n; k++) {
+        if (!_utable_span_clip(st, &sp[k], &j, &m)) continue;
+        for (size_t q = j + 1; q < j + m; q++) eval[xpos[q] - 1] &= ~1;
+        // The row span continues from the row drawn above
+        if (SIZE_MAX != above && sp[k].owner < sp[k].row &&
+            ra + 1 == sp[k].row) {
+            for (size_t x = xpos[j]; x < xpos[j + m] - 1; x++)
+                eval[x] = EVAL_GAP;
+            gap = TRUE;
+        }
+    }
+    return gap;
+}
+
+/**
+ * Internal helper to write a line between two rows where a row span leaves
+ * a gap. The gap is blank and the line ends at each side of the gap with
+ * the glyph it has at the border of the table.
+ * @param st Stroke state
+ * @param header TRUE for the line beneath the header row
+ */
+static void
+_utable_stroke_gap_line(tstroke_t *st, _Bool header) {
+    tsink_t *s = st->s;
+    const style_t *sd = &st->sd;
+    const int *eval = st->eval;
+    const size_t w = st->totwidth;
+    const char *g[4] = {sd->middle_horizontal, sd->middle_horizontal_down,
+                        sd->middle_horizontal_up, sd->middle_cross};
+    const char *left = sd->middle_left, *right = sd->middle_right;
+    if (header) {
+        g[0] = sd->top_middle_horizontal;
+        g[1] = g[2] = NULL;
+        g[3] = sd->top_middle_cross;
+        left = sd->top_middle_left;
+        right = sd->top_middle_right;
+    }
+    for (int i = 0; i < 4; i++) {
+        if (NULL == g[i]) g[i] = "#ERR#";
+    }
+    // Without interior verticals the line just stops at the gap
+    const char *lend = st->v->base->interior_v ? left : g[0];
+    const char *rend = st->v->base->interior_v ? right : g[0];
+
+    tsink_puts(s, eval[0] & EVAL_GAP ? sd->border_vertical : left);
+    for (size_t x = 0; x + 1 < w; x++) {
+        const _Bool lgap = x > 0 && (eval[x - 1] & EVAL_GAP);
+        const _Bool rgap = eval[x + 1] & EVAL_GAP;
+        if (eval[x] & EVAL_GAP)
+            tsink_write(s, " ", 1);
+        else if (lgap && rgap)
+            tsink_puts(s, sd->middle_vertical);
+        else if (lgap)
+            tsink_puts(s, lend);
+        else if (rgap)
+            tsink_puts(s, rend);
+        else
+            tsink_puts(s, g[eval[x]]);
+    }
+    tsink_puts(s, eval[w - 2] & EVAL_GAP ? sd->border_vertical : right);
+    tsink_write(s, "\n", 1);
+}
+
+/**
+ * Internal helper to draw a row with spans from the span index. The cells
+ * between the spans are drawn on their own and each span is drawn as one
+ * cell, with its text only in its first row.
+ * @param st Stroke state
+ * @param i Row in the view to draw
+ * @param sp Spans in the row
+ * @param n Number of spans
+ */
+static void
+_utable_draw_span_row(tstroke_t *st, size_t i, const tspan_t *sp, size_t n) {
+    tview_t *v = st->v;
+    table_t *t = v->base;
+    tsink_t *s = st->s;
+    const style_t *sd = &st->sd;
+    const size_t r = v->rows ? v->rows[i] : i;
+    size_t j = 0;
+    for (size_t k = 0; k <= n; k++) {
+        size_t at = v->nCol, m = 0;
+        if (k < n && !_utable_span_clip(st, &sp[k], &at, &m)) continue;
+        tfmt_t f;
+        for (; j < at; j++) {
+            const size_t c = st->c0 + j;
+            const tcell_t *cell = &TCELL(r, c);
+            const _Bool merged = cell->flags & CELL_MERGED;
+            _utable_get_fmt(t, r, c, &f);
+            const int cut = _utable_draw_cell_text(
+                    s, j == 0 ? sd->border_vertical : sd->middle_vertical,
+                    merged ? NULL : cell->t, merged ? 0 : cell->len,
+                    v->colwidth[j], f.lpad, f.rpad, f.halign);
+            STATS_COUNT(t, truncated, cut);
+        }
+        if (k == n) break;
+
+        const tcell_t *cell = &TCELL(sp[k].owner, sp[k].col);
+        const _Bool first = sp[k].owner == r;
+        _utable_get_fmt(t, sp[k].owner, sp[k].col, &f);
+        const int cut = _utable_draw_cell_text(
+                s, j == 0 ? sd->border_vertical : sd->middle_vertical,
+                first ? cell->t : NULL, first ? cell->len : 0,
+                st->xpos[at + m] - st->xpos[at] - 1, f.lpad, f.rpad, f.halign);
+        STATS_COUNT(t, truncated, cut);
+        j = at + m;
+    }
+    tsink_puts(s, sd->border_vertical);
+    tsink_write(s, "\n", 1);
+}
+
+/**
+ * Internal helper to prepare a stroke. The callbacks are run and the footer
+ * and column widths are computed.
+ * @param st    Stroke state to initialize
+ * @param v     View to stroke
+ * @param s     Output sink
+ * @param style Table layout style to use
+ * @return -1 on failure, 0 on success
+ */
+static int
+_utable_stroke_init(tstroke_t *st, tview_t *v, tsink_t *s, tblstyle_t style) {
+    table_t *t = v->base;
+    memset(st, 0, sizeof(tstroke_t));
+    st->v = v;
+    st->s = s;
+    if (_utable_view_chk(v)) return -1;
+
+    st->ts = t->stats ? _utable_now_ns() : 0;
+    STATS_COUNT(t, strokes, 1);
+    _utable_run_callbacks(v);
+    STATS_LAP(t, ns_callbacks, st->ts);
+
+    // The footer is computed first since it takes part in the column widths
+    if (!v->transposed && _utable_have_footer(t)) {
+        st->ftxt = _utable_footer_alloc(v);
+        if (NULL == st->ftxt) {
+            logmsg("CRITICAL : Failed to stroke table. Out of memory.");
+            return -1;
+        }
+        STATS_COUNT(t, allocs, 1);
+        _utable_footer_texts(v, st->ftxt);
+    }
+
+    _utable_set_autocolwidth(v, st->ftxt);
+    STATS_LAP(t, ns_autowidth, st->ts);
+
+    // Get the total width of the table in characters
+    for (size_t j = 0; j < v->nCol; j++) st->totwidth += v->colwidth[j] + 1;
+
+    /* The eval is used to evaluate markers on the table */
+    st->eval = st->totwidth ? malloc(st->totwidth * sizeof(int)) : NULL;
+    if (NULL == st->eval) {
+        if (st->totwidth)
+            logmsg("CRITICAL : Failed to stroke table. Out of memory.");
+        _utable_stroke_release(st);
+        return -1;
+    }
+    STATS_COUNT(t, allocs, 1);
+
+    // Spans are drawn from the span index when the columns are in table
+    // order. A window stroke draws a range of these columns.
+    if (t->haveSpan && _utable_span_cols(v, &st->c0)) {
+        st->xpos = malloc((v->nCol + 1) * sizeof(size_t));
+        st->cmarks = malloc(st->totwidth * sizeof(int));
+        if (NULL == st->xpos || NULL == st->cmarks || _utable_span_index(t)) {
+            logmsg("CRITICAL : Failed to stroke table. Out of memory.");
+            _utable_stroke_release(st);
+            return -1;
+        }
+        STATS_COUNT(t, allocs, 2);
+    }
+
+    /* Get characters to use for this style into style data (sd)*/
+    get_style(style, &st->sd, t->interior_v);
+    return 0;
+}
+
+/**
+ * Internal helper to draw the top border and the title
+ * @param st Stroke state
+ */
+static void
+_utable_stroke_head(tstroke_t *st) {
+    tview_t *v = st->v;
+    table_t *t = v->base;
+    tsink_t *s = st->s;
+    style_t *sd = &st->sd;
+    int *eval = st->eval;
+    const size_t totwidth = st->totwidth;
+    const size_t nRow = v->nRow;
+
+    if (st->xpos) {
+        _utable_span_cols(v, &st->c0);
+        st->xpos[0] = 0;
+        for (size_t j = 0; j < v->nCol; j++)
+            st->xpos[j + 1] = st->xpos[j] + v->colwidth[j] + 1;
+        memset(st->cmarks, 0, sizeof(int) * totwidth);
+        _utable_mark_columns(v, st->cmarks, 3);
+        st->spanRow[0] = st->spanRow[1] = SIZE_MAX;
+    }
+
+    if (t->title || 0 == nRow) {
+        memset(eval, 0, sizeof(int) * totwidth);
+        _utable_stroke_line(s, totwidth, eval, sd->top_left, sd->top_right,
+                            sd->top_horizontal, NULL, NULL, NULL);
+    } else {
+        _utable_stroke_marks(st, SIZE_MAX, 0);
+        _utable_stroke_line(s, totwidth, eval, sd->top_left, sd->top_right,
+                            sd->top_horizontal, sd->top_down, NULL, NULL);
+    }
+    STATS_LAP(t, ns_borders, st->ts);
+
+    if (t->title) {
+        // The title is drawn as one cell spanning the full table width
+        if (st->out) {
+            // The title is centered over all columns, not only the drawn
+            _utable_stroke_clip(st, st->x0 - st->xlo, totwidth + 1);
+            _utable_draw_title_row(s, t, st->fullwidth, sd->border_vertical);
+            _utable_stroke_clip(st, st->x0, st->fullwidth + 1);
+        } else {
+            _utable_draw_title_row(s, t, totwidth, sd->border_vertical);
+        }
+
+        _utable_stroke_marks(st, SIZE_MAX, nRow > 0 ? 0 : SIZE_MAX);
+
+        if (t->titleStyle == TITLESTYLE_LINE) {
+            // The optional thin line beneath the title
+            _utable_stroke_line(s, totwidth, eval, sd->middle_left,
+                                sd->middle_right, sd->middle_horizontal,
+                                sd->middle_horizontal_down,
+                                sd->middle_horizontal_up, sd->middle_cross);
+        }
+        STATS_LAP(t, ns_title, st->ts);
+    }
+
+    // Rows without spans all have the same borders. These rows are drawn by
+    // the specialized kernel and the interior line between two of them is
+    // only drawn once.
+    if (!t->haveSpan || st->xpos) st->kc = _utable_kernel_plan(v, sd);
+    if (st->kc && t->interior_h) {
+        memset(eval, 0, sizeof(int) * totwidth);
+        _utable_mark_columns(v, eval, 3);
+        st->hline = _utable_stroke_line_buf(
+                totwidth, eval, sd->middle_left, sd->middle_right,
+                sd->middle_horizontal, sd->middle_horizontal_down,
+                sd->middle_horizontal_up, sd->middle_cross, &st->hlen);
+        if (NULL == st->hline) {
+            free(st->kc);
+            st->kc = NULL;
+        } else {
+            STATS_COUNT(t, allocs, 1);
+        }
+    }
+}
+
+/**
+ * Internal helper to draw the next row and the line below it, unless it is
+ * the last row
+ * @param st Stroke state
+ */
+static void
+_utable_stroke_row(tstroke_t *st) {
+    tview_t *v = st->v;
+    table_t *t = v->base;
+    tsink_t *s = st->s;
+    style_t *sd = &st->sd;
+    int *eval = st->eval;
+    const size_t totwidth = st->totwidth;
+    const size_t nRow = v->nRow;
+    const size_t r = st->row++;
+    const _Bool last = r == nRow - 1;
+    size_t n, nb;
+    const tspan_t *sp = _utable_stroke_spans(st, r, &n);
+    const tspan_t *below = last ? NULL : _utable_stroke_spans(st, r + 1, &nb);
+
+    if (sp)
+        _utable_draw_span_row(st, r, sp, n);
+    else if (st->kc)
+        _utable_draw_row_kernel(s, v, r, st->kc, sd->border_vertical,
+                                strlen(sd->border_vertical));
+    else
+        _utable_draw_cellcontent_row(s, v, r, sd->border_vertical,
+                                     sd->border_vertical, sd->middle_vertical);
+    STATS_LAP(t, ns_rows, st->ts);
+
+    if (st->kc && !sp && !below) {
+        if (t->headerLine && r == 0) {
+            memset(eval, 0, sizeof(int) * totwidth);
+            _utable_mark_columns(v, eval, last ? 2 : 3);
+            _utable_stroke_line(s, totwidth, eval, sd->top_middle_left,
+                                sd->top_middle_right, sd->top_middle_horizontal,
+                                NULL, NULL, sd->top_middle_cross);
+        } else if (st->hline && !last) {
+            tsink_write(s, st->hline, st->hlen);
+        }
+        if (last) {
+            // Leave the marks of the last row for the line below it
+            memset(eval, 0, sizeof(int) * totwidth);
+            _utable_mark_columns(v, eval, 2);
+        }
+        STATS_LAP(t, ns_borders, st->ts);
+        return;
+    }
+
+    const _Bool gap = _utable_stroke_marks(st, r, last ? SIZE_MAX : r + 1);
+    if (t->headerLine && r == 0) {
+        // The heavier line just beneath the header row before the data rows
+        if (gap)
+            _utable_stroke_gap_line(st, TRUE);
+        else
+            _utable_stroke_line(s, totwidth, eval, sd->top_middle_left,
+                                sd->top_middle_right, sd->top_middle_horizontal,
+                                NULL, NULL, sd->top_middle_cross);
+    } else if (t->interior_h && !last) {
+        // Add lines between each data row
+        if (gap)
+            _utable_stroke_gap_line(st, FALSE);
+        else
+            _utable_stroke_line(s, totwidth, eval, sd->middle_left,
+                                sd->middle_right, sd->middle_horizontal,
+                                sd->middle_horizontal_down,
+                                sd->middle_horizontal_up, sd->middle_cross);
+    }
+    STATS_LAP(t, ns_borders, st->ts);
+}
+
+/**
+ * Internal helper to draw the footer and the bottom border
+ * @param st Stroke state
+ */
+static void
+_utable_stroke_tail(tstroke_t *st) {
+    tview_t *v = st->v;
+    table_t *t = v->base;
+    tsink_t *s = st->s;
+    style_t *sd = &st->sd;
+    int *eval = st->eval;
+    const size_t totwidth = st->totwidth;
+    const size_t nRow = v->nRow;
+
+    if (st->ftxt) {
+        // The footer is separated from the rows with an interior line
+        _utable_stroke_marks(st, nRow > 0 ? nRow - 1 : SIZE_MAX, SIZE_MAX);
+        _utable_mark_columns(v, eval, 1);
+        _utable_stroke_line(s, totwidth, eval, sd->middle_left,
+                            sd->middle_right, sd->middle_horizontal,
+                            sd->middle_horizontal_down,
+                            sd->middle_horizontal_up, sd->middle_cross);
+        _utable_draw_footer_row(s, v, st->ftxt + st->lo, sd->border_vertical,
+                                sd->border_vertical, sd->middle_vertical);
+        memset(eval, 0, sizeof(int) * totwidth);
+        _utable_mark_columns(v, eval, 2);
+        STATS_LAP(t, ns_rows, st->ts);
+    }
+
+    if (sd->have_bottom_border) {
+        _utable_stroke_line(s, totwidth, eval, sd->bottom_left,
+                            sd->bottom_right, sd->bottom_horizontal,
+                            sd->bottom_up, sd->bottom_up, NULL);
+        STATS_LAP(t, ns_borders, st->ts);
+    }
+}
+
+/**
+ * Internal helper to draw the next part of a stroke
+ * @param st Stroke state
+ */
+static void
+_utable_stroke_step(tstroke_t *st) {
+    switch (st->phase) {
+        case STROKE_HEAD:
+            _utable_stroke_head(st);
+            st->phase = STROKE_ROWS;
+            break;
+        case STROKE_ROWS:
+            if (st->row < st->v->nRow) {
+                _utable_stroke_row(st);
+            } else {
+                _utable_stroke_tail(st);
+                st->phase = STROKE_DONE;
+            }
+            break;
+        case STROKE_DONE:
+        default:
+            break;
+    }
+}
+
+/**
+ * Internal helper to stroke the rows in a view in the specified style to an
+ * output sink. The cost is linear in the size of the output.
+ * @param v     View to stroke
+ * @param s     Output sink
+ * @param style Table layout style to use
+ * @return -1 on failure, 0 on success
+ */
+static int
+_utable_stroke_sink(tview_t *v, tsink_t *s, tblstyle_t style) {
+    tstroke_t st;
+    if (_utable_stroke_init(&st, v, s, style)) return -1;
+    while (STROKE_DONE != st.phase && !s->err) _utable_stroke_step(&st);
+    _utable_stroke_release(&st);
+    STATS_COUNT(v->base, bytes, tsink_total(s));
+    return s->err ? -1 : 0;
+}
+
+/**
+ * Internal helper to check if a cell in a view is drawn as a part of the
+ * cell to its left, i.e. if it is covered by a column span
+ * @param v View
+ * @param i Row in the view
+ * @param j Column in the view
+ * @return TRUE if the cell is covered by a span, FALSE otherwise
+ */
+static _Bool
+_utable_view_spanned(const tview_t *v, size_t i, size_t j) {
+    table_t *t = v->base;
+    size_t r, c, pr, pc;
+    if (0 == j || v->transposed) return FALSE;
+    _utable_view_rc(v, i, j, &r, &c);
+    if (!(TCELL(r, c).flags & CELL_MERGED)) return FALSE;
+    const tspan_t *sp = _utable_span_at(t, r, c);
+    if (NULL == sp || sp->col == c) return FALSE;
+    _utable_view_rc(v, i, j - 1, &pr, &pc);
+    return pc + 1 == c;
+}
+
+/**
+ * Internal helper to stroke the part of a view that is inside a window of
+ * the full width output. Only the columns that are at least partly inside
+ * the window are drawn and the lines are then clipped to the window.
+ * @param v     View to stroke
+ * @param s     Output sink
+ * @param style Table layout style to use
+ * @param x0    First character in the window
+ * @param width Width of the window in characters
+ * @return -1 on failure, 0 on success
+ */
+static int
+_utable_stroke_window(tview_t *v, tsink_t *s, tblstyle_t style, size_t x0,
+                      size_t width) {
+    table_t *t = v->base;
+    tstroke_t st;
+    if (_utable_stroke_init(&st, v, s, style)) return -1;
+    st.fullwidth = st.totwidth;
+    st.x0 = x0;
+    st.width = width;
+
+    // A column is drawn if the window includes any of its two borders or
+    // its content. A border shared with a column outside the window then
+    // gets the right glyph.
+    size_t lo = v->nCol, hi = 0, x = 0;
+    for (size_t j = 0; j < v->nCol; j++) {
+        const size_t xr = x + v->colwidth[j] + 1;
+        if (x < x0 + width && xr >= x0) {
+            if (lo == v->nCol) {
+                lo = j;
+                st.xlo = x;
+            }
+            hi = j;
+        }
+        x = xr;
+    }
+    if (lo == v->nCol) {
+        // The window is to the right of the table, the lines are empty
+        lo = hi = v->nCol - 1;
+        st.xlo = x - v->colwidth[lo] - 1;
+    }
+
+    // A column span that crosses the edge of the window is drawn in full
+    _Bool changed = t->haveSpan;
+    while (changed) {
+        changed = FALSE;
+        for (size_t i = 0; i < v->nRow; i++) {
+            while (_utable_view_spanned(v, i, lo)) {
+                st.xlo -= v->colwidth[--lo] + 1;
+                changed = TRUE;
+            }
+            while (hi + 1 < v->nCol && _utable_view_spanned(v, i, hi + 1)) {
+                hi++;
+                changed = TRUE;
+            }
+        }
+    }
+
+    st.sub = *v;
+    st.sub.nCol = hi - lo + 1;
+    st.sub.cols = malloc(st.sub.nCol * sizeof(size_t));
+    if (NULL == st.sub.cols || tsink_init_grow(&st.clip)) {
+        logmsg("CRITICAL : Failed to stroke table. Out of memory.");
+        _utable_stroke_release(&st);
+        return -1;
+    }
+    STATS_COUNT(t, allocs, 2);
+    for (size_t j = 0; j < st.sub.nCol; j++)
+        st.sub.cols[j] = v->cols ? v->cols[lo + j] : lo + j;
+    st.sub.colwidth = st.sub.setwidth = v->colwidth + lo;
+    st.v = &st.sub;
+    st.lo = lo;
+    st.out = s;
+    st.s = &st.clip;
+    st.totwidth = 0;
+    for (size_t j = 0; j < st.sub.nCol; j++) st.totwidth += st.sub.colwidth[j] + 1;
+
+    while (STROKE_DONE != st.phase && !s->err) {
+        _utable_stroke_step(&st);
+        _utable_stroke_clip(&st, x0 - st.xlo, st.totwidth + 1);
+    }
+    _utable_stroke_release(&st);
+    STATS_COUNT(t, bytes, tsink_total(s));
+    return s->err ? -1 : 0;
+}
+
+/**
+ * Internal helper to stroke a view to a file descriptor
+ * @param v     View to stroke
+ * @param fd    File descriptor to write to
+ * @param style Table layout style to use
+ * @param x0    First character in the window to stroke
+ * @param width Width of the window in characters, 0 to stroke all columns
+ * @param written Set to the number of bytes written, may be NULL
+ * @return -1 on failure, 0 on success
+ */
+static int
+_utable_stroke_fd(tview_t *v, int fd, tblstyle_t style, size_t x0,
+                  size_t width, size_t *written) {
+    table_t *t = v->base;
+    tsink_t s;
+    if (tsink_init_fd(&s, fd)) {
+        logmsg("CRITICAL : Failed to stroke table. Out of memory.");
+        return -1;
+    }
+    STATS_COUNT(t, allocs, 1);
+    s.timed = NULL != t->stats;
+
+    int ret = width ? _utable_stroke_window(v, &s, style, x0, width)
+                    : _utable_stroke_sink(v, &s, style);
+    if (tsink_close(&s)) ret = -1;
+    STATS_COUNT(t, ns_output, s.ns_write);
+    if (written) *written = s.flushed;
+
+    return ret ? -1 : 0;
+}
+
+/**
+ * Internal helper to stroke a view to a function
+ * @param v     View to stroke
+ * @param cb    Function that is given the output
+ * @param ctx   Context given to the function
+ * @param style Table layout style to use
+ * @return -1 on failure, 0 on success
+ */
+static int
+_utable_stroke_cb(tview_t *v, t_write_cb cb, void *ctx, tblstyle_t style) {
+    tsink_t s;
+    if (tsink_init_cb(&s, cb, ctx)) {
+        logmsg("CRITICAL : Failed to stroke table. Out of memory.");
+        return -1;
+    }
+    STATS_COUNT(v->base, allocs, 1);
+    int ret = _utable_stroke_sink(v, &s, style);
+    if (tsink_close(&s)) ret = -1;
+    return ret;
+}
+
+/**
+ * Internal helper to stroke a view to a string buffer
+ * @param v     View to stroke
+ * @param buff  String buffer to write to
+ * @param bufflen Length of string buffer in bytes
+ * @param style Table layout style to use
+ * @return -1 on failure, 0 on success
+ */
+static int
+_utable_strstroke(tview_t *v, char *buff, size_t bufflen, tblstyle_t style) {
+    if (0 == bufflen) return -1;
+    tsink_t s;
+    tsink_init_buf(&s, buff, bufflen);
+    int ret = _utable_stroke_sink(v, &s, style);
+    if (tsink_close(&s)) ret = -1;
+    return ret;
+}
+
+/**
+ * Internal helper to stroke a view to a file once the callbacks have been
+ * run. The size of the output is counted first so the file can be given its
+ * final size and mapped, the table is then drawn directly into the mapping.
+ * Statistics are only collected when drawing into the mapping.
+ * @param v     View to stroke
+ * @param path  File to write to, it is created or truncated
+ * @param style Table layout style to use
+ * @return -1 on failure, 0 on success
+ */
+static int
+_utable_stroke_map(tview_t *v, const char *path, tblstyle_t style) {
+    table_t *t = v->base;
+    tsink_t s;
+    if (tsink_init_count(&s)) {
+        logmsg("CRITICAL : Failed to stroke table. Out of memory.");
+        return -1;
+    }
+    STATS_COUNT(t, allocs, 1);
+    utable_stats_t *stats = t->stats;
+    if (stats) t->stats = NULL;
+    int ret = _utable_stroke_sink(v, &s, style);
+    if (stats) t->stats = stats;
+    tsink_close(&s);
+    const size_t size = tsink_total(&s);
+    if (ret) return -1;
+
+    const int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        logmsg("Cannot open file to stroke to");
+        return -1;
+    }
+    char *map = NULL;
+    if (0 == ftruncate(fd, size)) {
+        map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (MAP_FAILED == map) map = NULL;
+    }
+    if (NULL == map) {
+        logmsg("Cannot map file to stroke to");
+        close(fd);
+        return -1;
+    }
+    madvise(map, size, MADV_SEQUENTIAL);
+
+    tsink_init_mem(&s, map, size);
+    const int drawn = _utable_stroke_sink(v, &s, style);
+    ret = msync(map, size, MS_SYNC);
+    munmap(map, size);
+    if (drawn || s.len != size) ret = -1;
+    if (close(fd)) ret = -1;
+    if (ret) logmsg("Failed to write stroked table to file");
+    return ret ? -1 : 0;
+}
+
+/**
+ * Internal helper to stroke a view to a file, see _utable_stroke_map(). The
+ * cell callbacks are run once before the output is counted and both passes
+ * draw the texts they returned, so the output has the counted size.
+ * @param v     View to stroke
+ * @param path  File to write to, it is created or truncated
+ * @param style Table layout style to use
+ * @return -1 on failure, 0 on success
+ */
+static int
+_utable_stroke_file(tview_t *v, const char *path, tblstyle_t style) {
+    table_t *t = v->base;
+    if (_utable_view_chk(v)) return -1;
+    STATS_START(t, ts);
+    _utable_run_callbacks(v);
+    STATS_LAP(t, ns_callbacks, ts);
+    const _Bool haveCb = t->haveCb;
+    if (haveCb) t->haveCb = FALSE;
+    const int ret = _utable_stroke_map(v, path, style);
+    if (haveCb) t->haveCb = TRUE;
+    return ret;
+}
+
+/**
+ * Internal helper to start a resumable stroke
+ * @param v     View to stroke, NULL to stroke the table
+ * @param t     Table pointer
+ * @param fd    File descriptor to write to
+ * @param style Table layout style to use
+ * @return NULL on failure, the stroke state otherwise
+ */
+static tstroke_t *
+_utable_stroke_begin(tview_t *v, table_t *t, int fd, tblstyle_t style) {
+    tstroke_t *st = malloc(sizeof(tstroke_t));
+    if (NULL == st) {
+        logmsg("CRITICAL : Failed to stroke table. Out of memory.");
+        return NULL;
+    }
+    tsink_t s;
+    if (tsink_init_fd(&s, fd)) {
+        logmsg("CRITICAL : Failed to stroke table. Out of memory.");
+        free(st);
+        return NULL;
+    }
+    s.nonblock = TRUE;
+    s.timed = NULL != t->stats;
+
+    tview_t tv;
+    if (NULL == v) {
+        _utable_table_view(t, &tv);
+        v = &tv;
+    }
+    if (_utable_stroke_init(st, v, NULL, style)) {
+        tsink_close(&s);
+        free(st);
+        return NULL;
+    }
+    STATS_COUNT(t, allocs, 1);
+    // The state owns the sink and a copy of the table view
+    st->sink = s;
+    st->s = &st->sink;
+    if (v == &tv) {
+        st->view = tv;
+        st->v = &st->view;
+    }
+    return st;
+}
+
+/**
+ * Start a stroke of the entire table to a file descriptor that is drawn
+ * and written in steps with utable_stroke_continue(). This is meant for a
+ * non-blocking descriptor, e.g. a socket in an event loop. Nothing is
+ * written until utable_stroke_continue() is called. The table must not be
+ * changed until the stroke has finished, a snapshot of the table can be
+ * stroked instead to allow that.
+ * @param t     Table pointer
+ * @param fd    File descriptor to write to
+ * @param style Table layout style to use
+ * @return NULL on failure, the stroke state otherwise
+ */
+tstroke_t *
+utable_stroke_begin(table_t *t, int fd, tblstyle_t style) {
+    return _utable_stroke_begin(NULL, t, fd, style);
+}
+
+/**
+ * Start a resumable stroke of a view, see utable_stroke_begin()
+ * @param v     View to stroke
+ * @param fd    File descriptor to write to
+ * @param style Table layout style to use
+ * @return NULL on failure, the stroke state otherwise
+ */
+tstroke_t *
+utable_view_stroke_begin(tview_t *v, int fd, tblstyle_t style) {
+    return _utable_stroke_begin(v, v->base, fd, style);
+}
+
+/**
+ * Continue a resumable stroke. The output that is left from the last call
+ * is written first. Then rows are drawn and written until the descriptor
+ * would block or the stroke is complete. Rows are only drawn once, the
+ * output that could not be written is kept until the next call.
+ * @param st Stroke state
+ * @return 0 when the whole table has been written, 1 if the descriptor
+ *         would block and the call should be repeated when it is writable,
+ *         -1 on failure
+ */
+int
+utable_stroke_continue(tstroke_t *st) {
+    tsink_t *s = st->s;
+    table_t *t = st->v->base;
+    if (_utable_view_chk(st->v)) return -1;
+    tsink_flush(s);
+    while (!s->err && !s->blocked && STROKE_DONE != st->phase)
+        _utable_stroke_step(st);
+    // The last output is written as soon as the stroke is complete
+    if (STROKE_DONE == st->phase && !s->blocked && s->len) tsink_flush(s);
+    if (s->err) return -1;
+    if (s->blocked) return 1;
+    STATS_COUNT(t, bytes, tsink_total(s));
+    STATS_COUNT(t, ns_output, s->ns_write);
+    s->ns_write = 0;
+    return 0;
+}
+
+/**
+ * Get the number of bytes a resumable stroke has written so far
+ * @param st Stroke state
+ * @return Number of bytes
+ */
+size_t
+utable_stroke_written(const tstroke_t *st) {
+    return st->s->flushed;
+}
+
+/**
+ * Release a resumable stroke. This can be called before the stroke is
+ * complete to abandon it, e.g. when the connection is closed.
+ * @param st Stroke state
+ */
+void
+utable_stroke_end(tstroke_t *st) {
+    _utable_stroke_release(st);
+    free(st->sink.buf);
+    free(st);
+}
+
+/**
+ * State of a stream of rows, see utable_stream_create()
+ */
+struct tstream {
+    table_t *t;         // Formats and the rows in the look-ahead window
+    tview_t view;       // Rows in the window when the widths were fixed
+    tstroke_t st;       // Layout of the table, set when the widths are fixed
+    tsink_t sink;       // Output that has not been taken yet
+    size_t taken;       // Bytes at the start of the output already taken
+    tblstyle_t style;   // Table layout style
+    size_t n;           // Rows waiting in the window
+    size_t rows;        // Rows drawn so far
+    _Bool started;      // The widths are fixed and the head is drawn
+    _Bool ended;        // The bottom border is drawn
+};
+
+/**
+ * Internal helper to drop the output that has been taken from a stream
+ * @param ts Stream
+ */
+static void
+_utable_stream_compact(tstream_t *ts) {
+    if (0 == ts->taken) return;
+    memmove(ts->sink.buf, ts->sink.buf + ts->taken, ts->sink.len - ts->taken);
+    ts->sink.len -= ts->taken;
+    ts->taken = 0;
+}
+
+/**
+ * Internal helper to draw the line between the last drawn row of a stream
+ * and the next one
+ * @param ts Stream
+ * @param mark Marks of the vertical borders, 3 between two rows and 2 below
+ *             the last row
+ */
+static void
+_utable_stream_line(tstream_t *ts, int mark) {
+    tstroke_t *st = &ts->st;
+    style_t *sd = &st->sd;
+    memset(st->eval, 0, sizeof(int) * st->totwidth);
+    _utable_mark_columns(st->v, st->eval, mark);
+    if (ts->t->headerLine && 1 == ts->rows) {
+        _utable_stroke_line(&ts->sink, st->totwidth, st->eval,
+                            sd->top_middle_left, sd->top_middle_right,
+                            sd->top_middle_horizontal, NULL, NULL,
+                            sd->top_middle_cross);
+    } else if (ts->t->interior_h && 3 == mark) {
+        if (st->hline)
+            tsink_write(&ts->sink, st->hline, st->hlen);
+        else
+            _utable_stroke_line(&ts->sink, st->totwidth, st->eval,
+                                sd->middle_left, sd->middle_right,
+                                sd->middle_horizontal,
+                                sd->middle_horizontal_down,
+                                sd->middle_horizontal_up, sd->middle_cross);
+    }
+}
+
+/**
+ * Internal helper to draw a row of the window once the widths are fixed.
+ * The line above the row is drawn first since a stream does not know which
+ * row is the last until it is ended.
+ * @param ts Stream
+ * @param slot Row in the window to draw
+ * @param callbacks Run the cell callbacks of the row first
+ */
+static void
+_utable_stream_draw(tstream_t *ts, size_t slot, _Bool callbacks) {
+    tstroke_t *st = &ts->st;
+    style_t *sd = &st->sd;
+    tview_t rv = ts->view;
+    rv.nRow = 1;
+    rv.rows = &slot;
+    if (ts->rows > 0) _utable_stream_line(ts, 3);
+    if (callbacks) _utable_run_callbacks(&rv);
+    if (st->kc)
+        _utable_draw_row_kernel(&ts->sink, &rv, 0, st->kc, sd->border_vertical,
+                                strlen(sd->border_vertical));
+    else
+        _utable_draw_cellcontent_row(&ts->sink, &rv, 0, sd->border_vertical,
+                                     sd->border_vertical, sd->middle_vertical);
+    ts->rows++;
+}
+
+/**
+ * Internal helper to fix the column widths of a stream from the rows in the
+ * window and draw the head and these rows
+ * @param ts Stream
+ * @return -1 on failure, 0 on success
+ */
+static int
+_utable_stream_start(tstream_t *ts) {
+    _utable_table_view(ts->t, &ts->view);
+    ts->view.nRow = ts->n;
+    if (_utable_stroke_init(&ts->st, &ts->view, &ts->sink, ts->style))
+        return -1;
+    // A stream never holds all the rows so there is no footer
+    free(ts->st.ftxt);
+    ts->st.ftxt = NULL;
+    ts->started = TRUE;
+    _utable_stroke_head(&ts->st);
+    for (size_t i = 0; i < ts->n; i++) _utable_stream_draw(ts, i, FALSE);
+    ts->n = 0;
+    return ts->sink.err ? -1 : 0;
+}
+
+/**
+ * Create a stream that draws a table as its rows are added, without keeping
+ * all the rows. The first rows are kept in a look-ahead window and the
+ * column widths are fixed from them when the window is full, after that
+ * every row is drawn as soon as it is added. Texts in later rows that are
+ * wider than their column are truncated. The memory used is bounded by the
+ * window and the output that has not been taken, see
+ * utable_stream_pending().
+ *
+ * The title, header line, interior lines and the table and column formats
+ * are set on the table returned by utable_stream_table() before the first
+ * row is drawn. Column spans, cell formats, sorting and footers do not apply
+ * to a stream.
+ * @param nCol Number of columns
+ * @param lookahead Number of rows the column widths are fixed from
+ * @param style Table layout style to use
+ * @return NULL on failure, the stream otherwise
+ */
+tstream_t *
+utable_stream_create(size_t nCol, size_t lookahead, tblstyle_t style) {
+    if (0 == nCol || 0 == lookahead) return NULL;
+    tstream_t *ts = calloc(1, sizeof(tstream_t));
+    if (NULL == ts) {
+        logmsg("CRITICAL : Failed to create stream. Out of memory.");
+        return NULL;
+    }
+    ts->t = utable_create(lookahead, nCol);
+    if (NULL == ts->t || tsink_init_grow(&ts->sink)) {
+        logmsg("CRITICAL : Failed to create stream. Out of memory.");
+        if (ts->t) utable_free(ts->t);
+        free(ts);
+        return NULL;
+    }
+    ts->style = style;
+    return ts;
+}
+
+/**
+ * Get the table that holds the formats of a stream
+ * @param ts Stream
+ * @return Table pointer
+ */
+table_t *
+utable_stream_table(tstream_t *ts) {
+    return ts->t;
+}
+
+/**
+ * Add a row to a stream. The texts are copied.
+ * @param ts Stream
+ * @param txt Text of each column, NULL for an empty cell
+ * @param len Length of each text in bytes, NULL if the texts are NULL
+ *            terminated
+ * @return -1 on failure, 0 on success
+ */
+int
+utable_stream_row(tstream_t *ts, const char *const txt[], const size_t len[]) {
+    table_t *t = ts->t;
+    if (ts->ended) return -1;
+    _utable_stream_compact(ts);
+    // Once the widths are fixed every row is drawn from the first slot
+    const size_t slot = ts->started ? 0 : ts->n;
+    for (size_t c = 0; c < t->nCol; c++) {
+        const char *p = txt[c] ? txt[c] : "";
+        if (utable_set_cell_n(t, slot, c, p, len ? len[c] : strlen(p)))
+            return -1;
+    }
+    if (ts->started)
+        _utable_stream_draw(ts, slot, TRUE);
+    else if (++ts->n == t->nRow && _utable_stream_start(ts))
+        return -1;
+    return ts->sink.err ? -1 : 0;
+}
+
+/**
+ * End a stream. The rows left in the window are drawn followed by the
+ * bottom border.
+ * @param ts Stream
+ * @return -1 on failure, 0 on success
+ */
+int
+utable_stream_end(tstream_t *ts) {
+    if (ts->ended) return 0;
+    _utable_stream_compact(ts);
+    if (!ts->started && _utable_stream_start(ts)) return -1;
+    if (ts->rows > 0) _utable_stream_line(ts, 2);
+    _utable_stroke_tail(&ts->st);
+    ts->ended = TRUE;
+    return ts->sink.err ? -1 : 0;
+}
+
+/**
+ * Get the output of a stream that has not been taken. The output is valid
+ * until the next call to utable_stream_row() or utable_stream_end().
+ * @param ts Stream
+ * @param len Set to the length of the output in bytes
+ * @return The output
+ */
+const char *
+utable_stream_pending(const tstream_t *ts, size_t *len) {
+    *len = ts->sink.len - ts->taken;
+    return ts->sink.buf + ts->taken;
+}
+
+/**
+ * Take output from a stream, e.g. after it has been written
+ * @param ts Stream
+ * @param n Number of bytes taken from the start of the pending output
+ */
+void
+utable_stream_consume(tstream_t *ts, size_t n) {
+    ts->taken += MIN(n, ts->sink.len - ts->taken);
+}
+
+/**
+ * Free a stream
+ * @param ts Stream
+ */
+void
+utable_stream_free(tstream_t *ts) {
+    if (NULL == ts) return;
+    _utable_stroke_release(&ts->st);
+    tsink_close(&ts->sink);
+    utable_free(ts->t);
+    free(ts);
+}
+
+/**
+ * Stroke the entire table to STDOUT
+ * @param t     Table pointer
+ * @param style Table layout style to use
+ *              Possible styles are: TSTYLE_TOP_DL, TSTYLE_FULL_DL, TSTYLE_SL,
+ * TSTYLE_TOPBOTTOM_DL
+ * @return -1 on failure, 0 on success
+ */
+int
+utable_stroke_stdout(table_t *t, tblstyle_t style) {
+    return utable_stroke(t, STDOUT_FILENO, style);
+}
+
+/**
+ * Stroke the entire table in the specified style to specified file
+ * descriptor. The output is streamed through a small buffer so there is no
+ * limit on the size of the table.
+ * @param t     Table pointer
+ * @param fd    File descriptor to write to
+ * @param style Table layout style to use
+ * @return -1 on failure, 0 on success
+ */
+int
+utable_stroke(table_t *t, int fd, tblstyle_t style) {
+    return utable_stroke_count(t, fd, style, NULL);
+}
+
+/**
+ * Stroke the entire table to a file descriptor as utable_stroke() and give
+ * the number of bytes written, e.g. to size a buffer for utable_strstroke()
+ * @param t     Table pointer
+ * @param fd    File descriptor to write to
+ * @param style Table layout style to use
+ * @param written Set to the number of bytes written, also on failure. May
+ * be NULL.
+ * @return -1 on failure, 0 on success
+ */
+int
+utable_stroke_count(table_t *t, int fd, tblstyle_t style, size_t *written) {
+    tview_t v;
+    _utable_table_view(t, &v);
+    return _utable_stroke_fd(&v, fd, style, 0, 0, written);
+}
+
+/**
+ * Stroke the part of the table that is inside a window of the given width
+ * that starts at the given character in every line, e.g. to scroll a wide
+ * table horizontally in a terminal. The output is the same as cutting the
+ * window out of the output of utable_stroke() but only the columns inside
+ * the window are drawn. Columns that are partly inside the window are cut
+ * and a cell that spans columns is always drawn in full before it is cut.
+ * The title is centered over the full table as usual.
+ * @param t     Table pointer
+ * @param fd    File descriptor to write to
+ * @param style Table layout style to use
+ * @param xoff  First character of each line to stroke, 0 is the left border
+ * @param width Width of the window in characters
+ * @return -1 on failure, 0 on success
+ */
+int
+utable_stroke_window(table_t *t, int fd, tblstyle_t style, size_t xoff,
+                     size_t width) {
+    if (0 == width) return -1;
+    tview_t v;
+    _utable_table_view(t, &v);
+    return _utable_stroke_fd(&v, fd, style, xoff, width, NULL);
+}
+
+/**
+ * Stroke the entire table in the specified style to a function. The output
+ * is given to the function in pieces of up to 64 kB as it is drawn, e.g. to
+ * append it to a string or a stream without a buffer for the whole table.
+ * The function returns 0 on success and a non zero value stops the stroke.
+ * @param t     Table pointer
+ * @param cb    Function that is given the output
+ * @param ctx   Context given to the function
+ * @param style Table layout style to use
+ * @return -1 on failure, 0 on success
+ */
+int
+utable_stroke_cb(table_t *t, t_write_cb cb, void *ctx, tblstyle_t style) {
+    tview_t v;
+    _utable_table_view(t, &v);
+    return _utable_stroke_cb(&v, cb, ctx, style);
+}
+
+/**
+ * Stroke the entire table in the specified style to specified string buffer
+ * @param t     Table pointer
+ * @param buff  String buffer to write to
+ * @param bufflen Length of string byffer in bytes
+ * @param style Table layout style to use
+ * @return -1 on failure, 0 on success
+ */
+int
+utable_strstroke(table_t *t, char *buff, size_t bufflen, tblstyle_t style) {
+    tview_t v;
+    _utable_table_view(t, &v);
+    return _utable_strstroke(&v, buff, bufflen, style);
+}
+
+/**
+ * Stroke the entire table in the specified style to a file. The file is
+ * given the exact size of the output and memory mapped so the table is
+ * drawn directly into the page cache without an intermediate buffer. This
+ * is meant for large reports, to find the size the table is drawn twice.
+ * The cell callbacks are only called once. The file is synchronized to disk
+ * before returning.
+ * @param t     Table pointer
+ * @param path  File to write to, it is created or truncated
+ * @param style Table layout style to use
+ * @return -1 on failure, 0 on success
+ */
+int
+utable_stroke_file(table_t *t, const char *path, tblstyle_t style) {
+    tview_t v;
+    _utable_table_view(t, &v);
+    return _utable_stroke_file(&v, path, style);
+}
+
+/**
+ * Internal helper to write cell text escaped for the specified export format
+ * @param s Output sink
+ * @param txt Text, may be NULL
+ * @param len Length of text in bytes
+ * @param fmt Export format
+ */
+static void
+_utable_export_text(tsink_t *s, const char *txt, size_t len, exportfmt_t fmt) {
+    size_t run = 0;
+
+    if (EXPORT_CSV == fmt) {
+        // RFC 4180, only quote the field when needed
+        size_t i = 0;
+        while (i < len && !strchr(",\"\r\n", txt[i])) i++;
+        if (i == len) {
+            tsink_write(s, txt, len);
+            return;
+        }
+        tsink_write(s, "\"", 1);
+        for (i = 0; i < len; i++) {
+            if ('"' == txt[i]) {
+                tsink_write(s, txt + run, i + 1 - run);
+                run = i;
+            }
+        }
+        tsink_write(s, txt + run, len - run);
+        tsink_write(s, "\"", 1);
+        return;
+    }
+
+    if (EXPORT_JSON_ARRAY == fmt || EXPORT_JSON_OBJECT == fmt)
+        tsink_write(s, "\"", 1);
+    for (size_t i = 0; i < len; i++) {
+        const unsigned char ch = txt[i];
+        const char *esc = NULL;
+        char ubuff[8];
+        if (EXPORT_TSV == fmt) {
+            // Linear TSV, tab, newline and backslash are escaped
+            if ('\t' == ch) esc = "\\t";
+            else if ('\n' == ch) esc = "\\n";
+            else if ('\r' == ch) esc = "\\r";
+            else if ('\\' == ch) esc = "\\\\";
+        } else if (EXPORT_MARKDOWN == fmt) {
+            if ('|' == ch) esc = "\\|";
+            else if ('\n' == ch) esc = "<br>";
+            else if ('\r' == ch) esc = "";
+        } else {
+            if ('"' == ch) esc = "\\\"";
+            else if ('\\' == ch) esc = "\\\\";
+            else if ('\n' == ch) esc = "\\n";
+            else if ('\r' == ch) esc = "\\r";
+            else if ('\t' == ch) esc = "\\t";
+            else if (ch < 0x20) {
+                snprintf(ubuff, sizeof(ubuff), "\\u%04x", ch);
+                esc = ubuff;
+            }
+        }
+        if (esc) {
+            tsink_write(s, txt + run, i - run);
+            tsink_puts(s, esc);
+            run = i + 1;
+        }
+    }
+    tsink_write(s, txt + run, len - run);
+    if (EXPORT_JSON_ARRAY == fmt || EXPORT_JSON_OBJECT == fmt)
+        tsink_write(s, "\"", 1);
+}
+
+/**
+ * Internal helper to write the key for a column when exporting JSON objects.
+ * The key is the text in the header row or the column number if the header
+ * cell has no text of its own.
+ * @param s Output sink
+ * @param t Table pointer
+ * @param col Column
+ */
+static void
+_utable_export_key(tsink_t *s, table_t *t, size_t col) {
+    const tcell_t *cell = &TCELL(TROW(0), col);
+    if (cell->t && !(cell->flags & CELL_MERGED)) {
+        _utable_export_text(s, cell->t, cell->len, EXPORT_JSON_OBJECT);
+    } else {
+        char buff[32];
+        snprintf(buff, sizeof(buff), "\"%zu\"", col);
+        tsink_puts(s, buff);
+    }
+    tsink_write(s, ":", 1);
+}
+
+/**
+ * Internal helper to export the table to an output sink. The cost is linear
+ * in the size of the table.
+ * @param t Table pointer
+ * @param s Output sink
+ * @param fmt Export format
+ * @return -1 on failure, 0 on success
+ */
+static int
+_utable_export_sink(table_t *t, tsink_t *s, exportfmt_t fmt) {
+    static const struct {
+        const char *begin, *rowbegin, *sep, *rowend, *rowsep, *end;
+    } fd[] = {
+        [EXPORT_CSV] = {"", "", ",", "\r\n", "", ""},
+        [EXPORT_TSV] = {"", "", "\t", "\n", "", ""},
+        [EXPORT_JSON_ARRAY] = {"[", "[", ",", "]", ",\n", "]\n"},
+        [EXPORT_JSON_OBJECT] = {"[", "{", ",", "}", ",\n", "]\n"},
+        [EXPORT_MARKDOWN] = {"", "| ", " | ", " |\n", "", ""},
+    };
+    if (fmt > EXPORT_MARKDOWN) {
+        logmsg("Unknown export format");
+        return -1;
+    }
+
+    tview_t tv;
+    _utable_table_view(t, &tv);
+    _utable_run_callbacks(&tv);
+
+    // For JSON objects the header row is used as keys and not exported
+    size_t r = EXPORT_JSON_OBJECT == fmt ? 1 : 0;
+    const int json = EXPORT_JSON_ARRAY == fmt || EXPORT_JSON_OBJECT == fmt;
+
+    tsink_puts(s, fd[fmt].begin);
+    for (; r < t->nRow && !s->err; r++) {
+        if (r > (EXPORT_JSON_OBJECT == fmt)) tsink_puts(s, fd[fmt].rowsep);
+        tsink_puts(s, fd[fmt].rowbegin);
+        for (size_t c = 0; c < t->nCol; c++) {
+            if (c > 0) tsink_puts(s, fd[fmt].sep);
+            if (EXPORT_JSON_OBJECT == fmt) _utable_export_key(s, t, c);
+            // Cells covered by a column span are exported empty so that
+            // every row has the same number of fields
+            const tcell_t *cell = &TCELL(TROW(r), c);
+            if (json && (cell->flags & CELL_MERGED))
+                tsink_write(s, "null", 4);
+            else if (!(cell->flags & CELL_MERGED))
+                _utable_export_text(s, cell->t, cell->len, fmt);
+        }
+        tsink_puts(s, fd[fmt].rowend);
+
+        if (EXPORT_MARKDOWN == fmt && 0 == r) {
+            // The delimiter row after the header with the column alignment
+            tsink_write(s, "|", 1);
+            for (size_t c = 0; c < t->nCol; c++) {
+                tfmt_t f = t->deffmt;
+                _utable_merge_fmt(&f, &t->colfmt[c]);
+                tsink_puts(s, RIGHTALIGN == f.halign    ? " --: |"
+                              : CENTERALIGN == f.halign ? " :-: |"
+                                                        : " --- |");
+            }
+            tsink_write(s, "\n", 1);
+        }
+    }
+    tsink_puts(s, fd[fmt].end);
+
+    return s->err ? -1 : 0;
+}
+
+/**
+ * Export the table in a machine readable format to the specified file
+ * descriptor. No column widths or borders are computed so this is much
+ * faster than stroking the table. Row 0 is used as the header row. Cells
+ * covered by a column span are exported as empty fields, or null in JSON.
+ * @param t     Table pointer
+ * @param fd    File descriptor to write to
+ * @param fmt   Export format
+ * @return -1 on failure, 0 on success
+ */
+int
+utable_export(table_t *t, int fd, exportfmt_t fmt) {
+    return utable_export_count(t, fd, fmt, NULL);
+}
+
+/**
+ * Export the table to a file descriptor as utable_export() and give the
+ * number of bytes written
+ * @param t     Table pointer
+ * @param fd    File descriptor to write to
+ * @param fmt   Export format
+ * @param written Set to the number of bytes written, also on failure. May
+ * be NULL.
+ * @return -1 on failure, 0 on success
+ */
+int
+utable_export_count(table_t *t, int fd, exportfmt_t fmt, size_t *written) {
+    tsink_t s;
+    if (tsink_init_fd(&s, fd)) {
+        logmsg("CRITICAL : Failed to export table. Out of memory.");
+        return -1;
+    }
+    int ret = _utable_export_sink(t, &s, fmt);
+    if (tsink_close(&s)) ret = -1;
+    if (written) *written = s.flushed;
+    return ret ? -1 : 0;
+}
+
+/**
+ * Export the table in a machine readable format to the specified string
+ * buffer. See utable_export()
+ * @param t     Table pointer
+ * @param buff  String buffer to write to
+ * @param bufflen Length of string buffer in bytes
+ * @param fmt   Export format
+ * @return -1 on failure, 0 on success
+ */
+int
+utable_strexport(table_t *t, char *buff, size_t bufflen, exportfmt_t fmt) {
+    if (0 == bufflen) return -1;
+    tsink_t s;
+    tsink_init_buf(&s, buff, bufflen);
+    int ret = _utable_export_sink(t, &s, fmt);
+    if (tsink_close(&s)) ret = -1;
+    return ret;
+}
+
+// Files smaller than this are always loaded by a single thread
+#define LOAD_MINCHUNK (1024 * 1024)
+
+/**
+ * State for loading one chunk of a file with utable_load()
+ */
+typedef struct {
+    table_t *t;             // Table to fill, NULL when only counting
+    const char *begin;      // First byte of chunk
+    const char *end;        // Byte after chunk
+    char sep;               // Field separator
+    char esc;               // Escape character ('"' for CSV, '\\' for TSV)
+    size_t row0;            // First table row of the chunk
+    size_t nrows, ncols;    // Number of rows and maximum number of fields
+    size_t textBytes;       // Bytes allocated for unescaped texts
+    size_t nquotes;         // Number of quotes in the chunk
+    _Bool stray;            // A quote outside of a quoted field was seen
+    int err;                // Out of memory
+} tload_t;
+
+/**
+ * Internal helper to find the first occurrence of any of three bytes. The
+ * buffer is scanned 8 bytes at a time by checking for a zero byte in the
+ * buffer xor:ed with each of the bytes.
+ * @param p Buffer
+ * @param n Length of buffer
+ * @param a First byte to search for
+ * @param b Second byte to search for
+ * @param c Third byte to search for
+ * @return Offset of the first found byte, n if none is found
+ */
+static inline size_t
+_utable_load_scan(const char *p, size_t n, char a, char b, char c) {
+    const uint64_t ones = 0x0101010101010101ULL;
+    const uint64_t high = 0x8080808080808080ULL;
+    const uint64_t ma = ones * (unsigned char) a;
+    const uint64_t mb = ones * (unsigned char) b;
+    const uint64_t mc = ones * (unsigned char) c;
+    size_t i = 0;
+    while (i + 8 <= n) {
+        uint64_t v;
+        memcpy(&v, p + i, 8);
+        const uint64_t x = v ^ ma, y = v ^ mb, z = v ^ mc;
+        if ((((x - ones) & ~x) | ((y - ones) & ~y) | ((z - ones) & ~z)) & high)
+            break;
+        i += 8;
+    }
+    while (i < n && p[i] != a && p[i] != b && p[i] != c) i++;
+    return i;
+}
+
+/**
+ * Internal helper to store an escaped field as an unescaped copy
+ * @param l Loader state
+ * @param cell Cell to update
+ * @param f Escaped field
+ * @param flen Length of escaped field
+ * @return 0 on success, -1 on failure
+ */
+static int
+_utable_load_unescape(tload_t *l, tcell_t *cell, const char *f, size_t flen) {
+    char *txt = malloc(flen + 1);
+    if (NULL == txt) return -1;
+    size_t n = 0;
+    for (size_t i = 0; i < flen; i++) {
+        if (l->esc == f[i] && i + 1 < flen) {
+            i++;
+            if ('\\' == l->esc) {
+                txt[n++] = 't' == f[i] ? '\t' : 'n' == f[i] ? '\n'
+                         : 'r' == f[i] ? '\r' : f[i];
+                continue;
+            }
+        }
+        txt[n++] = f[i];
+    }
+    txt[n] = '\0';
+    cell->t = txt;
+    cell->len = n;
+    l->textBytes += n + 1;
+    return 0;
+}
+
+/**
+ * Internal helper to parse one chunk of a file. When the loader has no table
+ * the rows and fields are only counted. Otherwise the cells of the rows in
+ * the chunk are set, either referencing the field in the file or, if the
+ * field has to be unescaped, to a copy. In a CSV file a quote only starts a
+ * quoted field at the start of a field, a quote anywhere else is kept as it
+ * is and marks the chunk as having stray quotes.
+ * @param arg Loader state
+ * @return NULL
+ */
+static void *
+_utable_load_chunk(void *arg) {
+    tload_t *l = arg;
+    const char *p = l->begin, *end = l->end;
+    size_t row = 0, col = 0;
+    const _Bool csv = '"' == l->esc;
+
+    while (p < end) {
+        const char *f = p;
+        size_t flen;
+        _Bool escaped = FALSE;
+
+        if (csv && '"' == *p) {
+            // Quoted field, a quote inside the field is doubled
+            f = ++p;
+            for (;;) {
+                const char *q = memchr(p, '"', end - p);
+                if (NULL == q) {
+                    p = end;
+                    break;
+                }
+                if (q + 1 < end && '"' == q[1]) {
+                    escaped = TRUE;
+                    p = q + 2;
+                    continue;
+                }
+                p = q;
+                break;
+            }
+            flen = p - f;
+            // Skip the closing quote and anything up to the next separator
+            if (p < end) p++;
+            for (;;) {
+                p += _utable_load_scan(p, end - p, l->sep, '\n', '"');
+                if (p < end && '"' == *p) {
+                    l->stray = TRUE;
+                    p++;
+                    continue;
+                }
+                break;
+            }
+        } else {
+            for (;;) {
+                p += _utable_load_scan(p, end - p, l->sep, '\n', l->esc);
+                if (p < end && l->esc == *p) {
+                    if (csv) {
+                        l->stray = TRUE;
+                        p++;
+                    } else {
+                        escaped = TRUE;
+                        p = MIN(p + 2, end);
+                    }
+                    continue;
+                }
+                break;
+            }
+            flen = p - f;
+            if (flen > 0 && '\r' == f[flen - 1] && (p == end || '\n' == *p))
+                flen--;
+        }
+
+        if (l->t && flen > 0) {
+            tcell_t *cell = &l->t->row[l->row0 + row][col];
+            if (escaped) {
+                if (_utable_load_unescape(l, cell, f, flen)) {
+                    l->err = 1;
+                    return NULL;
+                }
+            } else {
+                cell->t = (char *) f;
+                cell->len = flen;
+                cell->flags |= CELL_EXTERN;
+            }
+        }
+        col++;
+
+        if (p < end && l->sep == *p) {
+            p++;
+            if (p < end) continue;
+            col++;  // A separator at the very end is followed by an empty field
+        }
+        // End of row
+        if (col > l->ncols) l->ncols = col;
+        row++;
+        col = 0;
+        p++;
+    }
+    l->nrows = row;
+    return NULL;
+}
+
+/**
+ * Internal helper to count the quotes in one chunk of a file
+ * @param arg Loader state
+ * @return NULL
+ */
+static void *
+_utable_load_quotes(void *arg) {
+    tload_t *l = arg;
+    for (const char *p = l->begin; p < l->end; p++) {
+        p = memchr(p, '"', l->end - p);
+        if (NULL == p) break;
+        l->nquotes++;
+    }
+    return NULL;
+}
+
+/**
+ * Internal helper to run a loader function on all chunks, in parallel if
+ * there is more than one chunk
+ * @param l Loader state, one per chunk
+ * @param n Number of chunks
+ * @param fn Function to run
+ */
+static void
+_utable_load_run(tload_t *l, int n, void *(*fn)(void *)) {
+    pthread_t tid[n];
+    _Bool started[n];
+    for (int i = 1; i < n; i++) {
+        started[i] = 0 == pthread_create(&tid[i], NULL, fn, &l[i]);
+        // Fall back to running the function in this thread
+        if (!started[i]) fn(&l[i]);
+    }
+    fn(&l[0]);
+    for (int i = 1; i < n; i++) {
+        if (started[i]) pthread_join(tid[i], NULL);
+    }
+}
+
+/**
+ * Load a table from a CSV (RFC 4180) or TSV file. The file is memory mapped
+ * and the cells reference the fields in the file directly, only fields that
+ * need to be unescaped are copied. The mapping is kept until the table is
+ * freed. The number of columns is the largest number of fields in any row
+ * and cells in shorter rows are left empty. In a CSV file a quote that does
+ * not start a field is kept as part of the field. Large files are split into
+ * chunks which are parsed in parallel.
+ * @param path File to load
+ * @param fmt Format of file, EXPORT_CSV or EXPORT_TSV
+ * @param nthreads Maximum number of threads to use, 0 to use one thread per
+ * online CPU
+ * @return NULL on failure, pointer to the new table otherwise
+ */
+table_t *
+utable_load(const char *path, exportfmt_t fmt, int nthreads) {
+    if (EXPORT_CSV != fmt && EXPORT_TSV != fmt) {
+        logmsg("Only CSV and TSV files can be loaded");
+        return NULL;
+    }
+    const int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st)) {
+        logmsg("Cannot open file to load");
+        if (fd >= 0) close(fd);
+        return NULL;
+    }
+    const size_t size = st.st_size;
+    char *map = NULL;
+    if (size > 0) {
+        map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (MAP_FAILED == map) map = NULL;
+    }
+    close(fd);
+    if (size > 0 && NULL == map) {
+        logmsg("Cannot map file to load");
+        return NULL;
+    }
+    if (map) madvise(map, size, MADV_SEQUENTIAL);
+
+    // Skip a UTF-8 byte order mark
+    size_t start = 0;
+    if (size >= 3 && 0 == memcmp(map, "\xEF\xBB\xBF", 3)) start = 3;
+
+    if (nthreads <= 0) nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads <= 0) nthreads = 1;
+    nthreads = MIN((size_t) nthreads, MAX(size / LOAD_MINCHUNK, 1));
+
+    tload_t l[nthreads];
+    const char *base = map + start;
+    const char esc = EXPORT_CSV == fmt ? '"' : '\\';
+    for (int i = 0; i < nthreads; i++) {
+        memset(&l[i], 0, sizeof(tload_t));
+        l[i].sep = EXPORT_CSV == fmt ? ',' : '\t';
+        l[i].esc = esc;
+        l[i].begin = base + (size - start) / nthreads * i;
+        l[i].end = i < nthreads - 1 ? base + (size - start) / nthreads * (i + 1)
+                                    : map + size;
+    }
+
+    // Move each chunk start to the first row that starts at or after it. In
+    // a CSV file a newline inside a quoted field does not end a row so the
+    // quotes in each chunk are counted first to know if a chunk starts
+    // inside a quoted field.
+    if ('"' == esc && nthreads > 1)
+        _utable_load_run(l, nthreads, _utable_load_quotes);
+    _Bool inquote = FALSE;
+    for (int i = 1; i < nthreads; i++) {
+        inquote ^= l[i - 1].nquotes & 1;
+        const char *p = l[i].begin;
+        if ('\n' != p[-1] || inquote) {
+            _Bool q = inquote;
+            while (p < map + size && ('\n' != *p || q)) {
+                q ^= '"' == *p;
+                p++;
+            }
+            p = MIN(p + 1, map + size);
+        }
+        l[i].begin = MAX(p, l[i - 1].begin);
+    }
+    for (int i = 0; i < nthreads; i++) {
+        l[i].end = i < nthreads - 1 ? l[i + 1].begin : map + size;
+    }
+
+    // First pass counts the rows and columns in each chunk. The chunks are
+    // only split correctly if all quotes delimit quoted fields. The first
+    // stray quote is always seen by a chunk that starts where it should, so
+    // if no chunk has seen one the split is right. Otherwise the file is
+    // parsed again as one chunk.
+    _utable_load_run(l, nthreads, _utable_load_chunk);
+    _Bool stray = FALSE;
+    for (int i = 0; i < nthreads; i++) stray |= l[i].stray;
+    if (stray && nthreads > 1) {
+        nthreads = 1;
+        l[0].end = map + size;
+        l[0].ncols = 0;
+        _utable_load_run(l, nthreads, _utable_load_chunk);
+    }
+    size_t nrows = 0, ncols = 0;
+    for (int i = 0; i < nthreads; i++) {
+        l[i].row0 = nrows;
+        nrows += l[i].nrows;
+        ncols = MAX(ncols, l[i].ncols);
+    }
+
+    table_t *t = utable_create(nrows, ncols);
+    if (NULL == t) {
+        if (map) munmap(map, size);
+        return NULL;
+    }
+    t->extmem = map;
+    t->extlen = size;
+    MEM_ADD(size);
+
+    // Second pass sets the cells
+    int err = 0;
+    for (int i = 0; i < nthreads; i++) l[i].t = t;
+    _utable_load_run(l, nthreads, _utable_load_chunk);
+    for (int i = 0; i < nthreads; i++) {
+        t->textBytes += l[i].textBytes;
+        MEM_ADD(l[i].textBytes);
+        err |= l[i].err;
+    }
+    if (err) {
+        logmsg("CRITICAL : Failed to load table. Out of memory.");
+        utable_free(t);
+        return NULL;
+    }
+    return t;
+}
+
+/**
+ * Precomputed sort key for one row
+ */
+typedef struct {
+    uint64_t k;         // Numeric key or big endian prefix of the text
+    const char *t;      // Cell text
+    size_t len;         // Length of cell text
+    size_t row;         // Storage row
+} tsortent_t;
+
+/**
+ * Internal helper to compare two rows by the text of the sort column
+ * @param a First row
+ * @param b Second row
+ * @return <0, 0 or >0 as for strcmp()
+ */
+static int
+_utable_sort_cmp_str(const tsortent_t *a, const tsortent_t *b) {
+    if (a->k != b->k) return a->k < b->k ? -1 : 1;
+    // The first 8 bytes are equal so only compare the rest
+    const size_t n = MIN(a->len, b->len);
+    if (n > 8) {
+        const int c = memcmp(a->t + 8, b->t + 8, n - 8);
+        if (c) return c;
+    }
+    return (a->len > b->len) - (a->len < b->len);
+}
+
+/**
+ * Internal helper to compare two rows by the text of the sort column where
+ * runs of digits are compared by their numeric value, e.g. "file2" comes
+ * before "file10"
+ * @param a First row
+ * @param b Second row
+ * @return <0, 0 or >0 as for strcmp()
+ */
+static int
+_utable_sort_cmp_nat(const tsortent_t *a, const tsortent_t *b) {
+    const unsigned char *p = (const unsigned char *) a->t;
+    const unsigned char *q = (const unsigned char *) b->t;
+    size_t i = 0, j = 0;
+    while (i < a->len && j < b->len) {
+        if (isdigit(p[i]) && isdigit(q[j])) {
+            while (i < a->len && '0' == p[i]) i++;
+            while (j < b->len && '0' == q[j]) j++;
+            const size_t is = i, js = j;
+            while (i < a->len && isdigit(p[i])) i++;
+            while (j < b->len && isdigit(q[j])) j++;
+            // The number with more digits is larger
+            if (i - is != j - js) return i - is < j - js ? -1 : 1;
+            const int c = memcmp(p + is, q + js, i - is);
+            if (c) return c;
+            continue;
+        }
+        if (p[i] != q[j]) return p[i] < q[j] ? -1 : 1;
+        i++;
+        j++;
+    }
+    return (i < a->len) - (j < b->len);
+}
+
+/**
+ * Internal helper to create the 8 byte sort prefix for a natural sort. The
+ * text up to the first digit is followed by a '0', the number of digits
+ * and the digits of the first number without leading zeros packed two in
+ * each byte. Comparing
+ * two prefixes gives the same order as _utable_sort_cmp_nat() unless they
+ * are equal.
+ * @param txt Text
+ * @param len Length of text
+ * @param pre Prefix, must be initialized to zero
+ */
+static void
+_utable_sort_natprefix(const char *txt, size_t len, unsigned char pre[8]) {
+    const unsigned char *p = (const unsigned char *) txt;
+    size_t o = 0, i = 0;
+    while (o < 8 && i < len && !isdigit(p[i])) pre[o++] = p[i++];
+    if (o == 8 || i == len) return;
+    pre[o++] = '0';
+    while (i < len && '0' == p[i]) i++;
+    size_t d = i;
+    while (d < len && isdigit(p[d])) d++;
+    // A number too long for its length to fit in a byte is left to the
+    // full comparison
+    if (o == 8 || d - i > 255) return;
+    pre[o++] = d - i;
+    // Two digits in each byte, stored as digit + 1 in each half
+    while (o < 8 && i < d) {
+        unsigned char b = (p[i++] - '0' + 1) << 4;
+        if (i < d) b |= p[i++] - '0' + 1;
+        pre[o++] = b;
+    }
+}
+
+/**
+ * Internal helper to compute the 64 bit key and text of the sort column for
+ * each row. The key orders the rows in the requested direction, for numeric
+ * keys completely and for text keys up to the 8 byte prefix.
+ * @param t Table pointer
+ * @param e Rows, the storage row must be set
+ * @param n Number of rows
+ * @param key Sort key
+ */
+static void
+_utable_sort_keys(table_t *t, tsortent_t *e, size_t n, const sortkey_t *key) {
+    for (size_t i = 0; i < n; i++) {
+        const tcell_t *cell = &TCELL(e[i].row, key->col);
+        const _Bool merged = cell->flags & CELL_MERGED;
+        e[i].t = merged || NULL == cell->t ? "" : cell->t;
+        e[i].len = merged ? 0 : cell->len;
+        if (SORT_NUMERIC == key->cmp) {
+            double v;
+            if (merged || _utable_cell_double(cell, &v)) {
+                // Cells that are not numbers are always sorted last
+                e[i].k = UINT64_MAX;
+            } else {
+                // Map the double to an integer with the same order. Zero
+                // has two encodings, -0 is made +0 so they are equal.
+                if (0 == v) v = 0;
+                uint64_t u;
+                memcpy(&u, &v, sizeof(u));
+                u = (u >> 63) ? ~u : u | (1ULL << 63);
+                e[i].k = key->descending ? ~u : u;
+            }
+        } else {
+            // The first 8 bytes in big endian order
+            unsigned char pre[8] = {0};
+            if (SORT_NATURAL == key->cmp)
+                _utable_sort_natprefix(e[i].t, e[i].len, pre);
+            else
+                memcpy(pre, e[i].t, MIN(e[i].len, 8));
+            uint64_t k = 0;
+            for (int b = 0; b < 8; b++) k = k << 8 | pre[b];
+            e[i].k = key->descending ? ~k : k;
+        }
+    }
+}
+
+/**
+ * Internal helper to do a stable merge sort of rows
+ * @param e Rows to sort
+ * @param tmp Scratch space of the same size
+ * @param n Number of rows
+ * @param cmp Compare function
+ * @param desc Sort in descending order
+ */
+static void
+_utable_merge_sort(tsortent_t *e, tsortent_t *tmp, size_t n,
+                   int (*cmp)(const tsortent_t *, const tsortent_t *),
+                   _Bool desc) {
+    if (n <= 16) {
+        // Insertion sort for short runs
+        for (size_t i = 1; i < n; i++) {
+            const tsortent_t x = e[i];
+            size_t j = i;
+            while (j > 0 && (desc ? cmp(&e[j - 1], &x) < 0
+                                  : cmp(&e[j - 1], &x) > 0)) {
+                e[j] = e[j - 1];
+                j--;
+            }
+            e[j] = x;
+        }
+        return;
+    }
+    const size_t h = n / 2;
+    _utable_merge_sort(e, tmp, h, cmp, desc);
+    _utable_merge_sort(e + h, tmp, n - h, cmp, desc);
+    memcpy(tmp, e, h * sizeof(tsortent_t));
+    size_t i = 0, j = h, k = 0;
+    while (i < h && j < n) {
+        const int c = cmp(&e[j], &tmp[i]);
+        // Take from the right run only if it is strictly before the left
+        if (desc ? c > 0 : c < 0)
+            e[k++] = e[j++];
+        else
+            e[k++] = tmp[i++];
+    }
+    while (i < h) e[k++] = tmp[i++];
+}
+
+/**
+ * Internal helper to do a stable LSD radix sort of rows on the numeric key
+ * @param e Rows to sort
+ * @param tmp Scratch space of the same size
+ * @param n Number of rows
+ */
+static void
+_utable_radix_sort(tsortent_t *e, tsortent_t *tmp, size_t n) {
+    if (n < 2) return;
+    size_t cnt[8][256];
+    memset(cnt, 0, sizeof(cnt));
+    for (size_t i = 0; i < n; i++) {
+        for (int b = 0; b < 8; b++) cnt[b][(e[i].k >> (8 * b)) & 0xff]++;
+    }
+    tsortent_t *src = e, *dst = tmp;
+    for (int b = 0; b < 8; b++) {
+        // Skip the byte if it is the same in all keys
+        if (cnt[b][(e[0].k >> (8 * b)) & 0xff] == n) continue;
+        size_t pos = 0;
+        for (int d = 0; d < 256; d++) {
+            const size_t c = cnt[b][d];
+            cnt[b][d] = pos;
+            pos += c;
+        }
+        for (size_t i = 0; i < n; i++)
+            dst[cnt[b][(src[i].k >> (8 * b)) & 0xff]++] = src[i];
+        tsortent_t *x = src;
+        src = dst;
+        dst = x;
+    }
+    if (src != e) memcpy(e, src, n * sizeof(tsortent_t));
+}
+
+/**
+ * Sort the rows in the table on one or more columns. The cells are not
+ * moved, instead the table keeps a row order that is followed when the
+ * table is stroked or exported. Row and column arguments to all other
+ * functions still refer to the rows in the order they were created.
+ * The sort is stable and rows that compare equal on all keys are kept in
+ * the order they were created. All keys are radix sorted on a precomputed
+ * 64 bit key, for text this is a prefix and only rows with the same prefix
+ * are compared on the full text.
+ * @param t Table pointer
+ * @param keys Sort keys, the first key is the most significant
+ * @param nkeys Number of sort keys
+ * @param nhdr Number of header rows at the top that are not sorted
+ * @return 0 on success, -1 on failure
+ */
+int
+utable_sort_by_col(table_t *t, const sortkey_t keys[], size_t nkeys,
+                   size_t nhdr) {
+    for (size_t i = 0; i < nkeys; i++) {
+        if (_utable_col_chk(t, keys[i].col)) return -1;
+    }
+    nhdr = MIN(nhdr, t->nRow);
+    const size_t n = t->nRow - nhdr;
+
+    if (NULL == t->rowmap) {
+        t->rowmap = malloc(t->nRow * sizeof(size_t) + 1);
+        if (NULL == t->rowmap) {
+            logmsg("CRITICAL : Failed to sort table. Out of memory.");
+            return -1;
+        }
+        MEM_ADD(t->nRow * sizeof(size_t));
     }
-    *lpad = t->c[TIDX(row, col)].lpad;
-    *rpad = t->c[TIDX(row, col)].rpad;
+    // A table with only header rows has nothing to sort
+    tsortent_t *e = n > 0 ? malloc(2 * n * sizeof(tsortent_t)) : NULL;
+    if (n > 0 && NULL == e) {
+        logmsg("CRITICAL : Failed to sort table. Out of memory.");
+        return -1;
+    }
+
+    // The text used for sorting includes any text set by callbacks
+    tview_t tv;
+    _utable_table_view(t, &tv);
+    _utable_run_callbacks(&tv);
+
+    for (size_t i = 0; i < n; i++) e[i].row = nhdr + i;
+
+    // Sort on the least significant key first, since every sort is stable
+    // the rows end up sorted on all keys
+    for (size_t kidx = nkeys; kidx-- > 0;) {
+        const sortkey_t *key = &keys[kidx];
+        _utable_sort_keys(t, e, n, key);
+
+        // Radix sort on the numeric key or the prefix. Rows with the same
+        // prefix are then sorted on the full text.
+        _utable_radix_sort(e, e + n, n);
+        if (SORT_NUMERIC != key->cmp) {
+            for (size_t i = 0, j; i < n; i = j) {
+                for (j = i + 1; j < n && e[j].k == e[i].k; j++)
+                    ;
+                if (j - i > 1)
+                    _utable_merge_sort(e + i, e + n, j - i,
+                                       SORT_NATURAL == key->cmp
+                                               ? _utable_sort_cmp_nat
+                                               : _utable_sort_cmp_str,
+                                       key->descending);
+            }
+        }
+    }
+
+    for (size_t r = 0; r < nhdr; r++) t->rowmap[r] = r;
+    for (size_t i = 0; i < n; i++) t->rowmap[nhdr + i] = e[i].row;
+    free(e);
+    return 0;
+}
+
+/**
+ * Remove any sort order so the rows are drawn in the order they were
+ * created
+ * @param t Table pointer
+ */
+void
+utable_unsort(table_t *t) {
+    if (t->rowmap) MEM_SUB(t->nRow * sizeof(size_t));
+    free(t->rowmap);
+    t->rowmap = NULL;
+}
+
+/**
+ * Internal helper to allocate a view with room for the specified number of
+ * rows
+ * @param t Base table
+ * @param n Number of rows
+ * @return NULL on failure, pointer to the new view otherwise
+ */
+static tview_t *
+_utable_view_alloc(table_t *t, size_t n) {
+    tview_t *v = calloc(1, sizeof(tview_t));
+    if (NULL == v) return NULL;
+    v->base = t;
+    v->rows = malloc(n * sizeof(size_t) + 1);
+    v->setwidth = calloc(2 * t->nCol + 1, sizeof(size_t));
+    if (NULL == v->rows || NULL == v->setwidth) {
+        free(v->rows);
+        free(v->setwidth);
+        free(v);
+        return NULL;
+    }
+    v->colwidth = v->setwidth + t->nCol;
+    v->nCol = t->nCol;
+    v->gen = t->editGen;
+    return v;
+}
+
+/**
+ * Internal helper to get the memory used by a view
+ * @param v View
+ * @return Size in bytes
+ */
+static size_t
+_utable_view_size(tview_t *v) {
+    const size_t n = (v->rows ? v->nRow : 0) + (v->cols ? v->nCol : 0);
+    return sizeof(tview_t) + (n + 2 * v->nCol) * sizeof(size_t);
+}
+
+/**
+ * Create a view of the rows in a table for which the predicate returns TRUE.
+ * The predicate is called for the rows in the order they are drawn, i.e.
+ * after any sorting of the table, and the view keeps that order. The first
+ * nhdr rows are always included so the header rows are kept in the view.
+ * The view only holds the indices of the selected rows and no cell texts
+ * are copied. Any later change to the cells in the base table is shown in
+ * the view.
+ * @param t Base table
+ * @param pred Row predicate, NULL to include all rows
+ * @param arg User argument passed on to the predicate
+ * @param nhdr Number of header rows that are always included
+ * @return NULL on failure, pointer to the new view otherwise
+ */
+tview_t *
+utable_view_create(table_t *t, t_row_pred pred, void *arg, size_t nhdr) {
+    nhdr = MIN(nhdr, t->nRow);
+    size_t size = pred ? MAX(nhdr, 16) : t->nRow;
+    tview_t *v = _utable_view_alloc(t, size);
+    if (NULL == v) {
+        logmsg("CRITICAL : Failed to create view. Out of memory.");
+        return NULL;
+    }
+    for (size_t r = 0; r < t->nRow; r++) {
+        const size_t row = TROW(r);
+        if (r >= nhdr && pred && !pred(t, row, arg)) continue;
+        if (v->nRow == size) {
+            size_t *rows = realloc(v->rows, 2 * size * sizeof(size_t));
+            if (NULL == rows) {
+                logmsg("CRITICAL : Failed to create view. Out of memory.");
+                free(v->rows);
+                free(v->setwidth);
+                free(v);
+                return NULL;
+            }
+            v->rows = rows;
+            size *= 2;
+        }
+        v->rows[v->nRow++] = row;
+    }
+
+    // Give back what the doubling allocated beyond the selected rows
+    if (v->nRow < size) {
+        size_t *rows = realloc(v->rows, v->nRow * sizeof(size_t) + 1);
+        if (rows) v->rows = rows;
+    }
+    MEM_ADD(_utable_view_size(v));
+    return v;
+}
+
+/**
+ * Create a view of an explicit list of rows in a table. The rows are drawn
+ * in the order they are listed and a row may be listed more than once.
+ * @param t Base table
+ * @param rows Rows in the base table, in the order they were created
+ * @param n Number of rows
+ * @return NULL on failure, pointer to the new view otherwise
+ */
+tview_t *
+utable_view_create_rows(table_t *t, const size_t rows[], size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (_utable_rc_chk(t, rows[i], 0)) return NULL;
+    }
+    tview_t *v = _utable_view_alloc(t, n);
+    if (NULL == v) {
+        logmsg("CRITICAL : Failed to create view. Out of memory.");
+        return NULL;
+    }
+    if (n) memcpy(v->rows, rows, n * sizeof(size_t));
+    v->nRow = n;
+    MEM_ADD(_utable_view_size(v));
+    return v;
+}
+
+/**
+ * Free a view. The base table is not affected.
+ * @param v View
+ */
+void
+utable_view_free(tview_t *v) {
+    if (NULL == v) return;
+    MEM_SUB(_utable_view_size(v));
+    free(v->rows);
+    free(v->cols);
+    free(v->setwidth);
+    free(v);
+}
+
+/**
+ * Set the width for the specified column in a view. The view does not use
+ * the column widths of the base table, by default all columns in a view get
+ * the width of the widest text in the rows of the view.
+ * @param v View
+ * @param col Column in the view to set
+ * @param width Width to set, 0 for automatic width
+ * @return 0 on success, -1 on failure
+ */
+int
+utable_view_set_colwidth(tview_t *v, size_t col, size_t width) {
+    if (col >= v->nCol) return -1;
+    v->setwidth[col] = width;
+    return 0;
+}
+
+/**
+ * Internal helper to compare two rows for a top-N selection. Rows that are
+ * equal on the key are ordered by their storage row so the order is total.
+ * @param a First row
+ * @param b Second row
+ * @param cmp Compare function for the full text, NULL for numeric keys
+ * @param desc Descending order
+ * @return TRUE if a comes before b
+ */
+static inline _Bool
+_utable_top_before(const tsortent_t *a, const tsortent_t *b,
+                   int (*cmp)(const tsortent_t *, const tsortent_t *),
+                   _Bool desc) {
+    if (a->k != b->k) return a->k < b->k;
+    if (cmp) {
+        const int c = cmp(a, b);
+        if (c) return desc ? c > 0 : c < 0;
+    }
+    return a->row < b->row;
+}
+
+#define TOP_SWAP(_a, _b) \
+    do {                 \
+        tsortent_t _x = (_a); \
+        (_a) = (_b);     \
+        (_b) = _x;       \
+    } while (0)
+
+/**
+ * Internal helper to move the k first rows to the front of the vector in
+ * sorted order. This is a quicksort that only recurses into the partitions
+ * that hold any of the first k rows, the expected cost is O(n + k log k).
+ * @param e Rows
+ * @param n Number of rows
+ * @param k Number of rows to select
+ * @param cmp Compare function for the full text, NULL for numeric keys
+ * @param desc Descending order
+ */
+static void
+_utable_top_select(tsortent_t *e, size_t n, size_t k,
+                   int (*cmp)(const tsortent_t *, const tsortent_t *),
+                   _Bool desc) {
+    while (n > 16 && k > 0) {
+        // Median of three as pivot, placed last
+        const size_t m = n / 2;
+        if (_utable_top_before(&e[m], &e[0], cmp, desc)) TOP_SWAP(e[m], e[0]);
+        if (_utable_top_before(&e[n - 1], &e[0], cmp, desc))
+            TOP_SWAP(e[n - 1], e[0]);
+        if (_utable_top_before(&e[m], &e[n - 1], cmp, desc))
+            TOP_SWAP(e[m], e[n - 1]);
+        size_t p = 0;
+        for (size_t i = 0; i < n - 1; i++) {
+            if (_utable_top_before(&e[i], &e[n - 1], cmp, desc)) {
+                TOP_SWAP(e[i], e[p]);
+                p++;
+            }
+        }
+        TOP_SWAP(e[p], e[n - 1]);
+
+        // The rows before the pivot are all selected if the pivot is
+        if (p >= k) {
+            n = p;
+        } else {
+            _utable_top_select(e, p, p, cmp, desc);
+            e += p + 1;
+            n -= p + 1;
+            k -= p + 1;
+        }
+    }
+    // Nothing is left to select after the pivot, otherwise at most 16 rows
+    if (0 == k) return;
+    // Insertion sort for short runs
+    for (size_t i = 1; i < n; i++) {
+        const tsortent_t x = e[i];
+        size_t j = i;
+        while (j > 0 && _utable_top_before(&x, &e[j - 1], cmp, desc)) {
+            e[j] = e[j - 1];
+            j--;
+        }
+        e[j] = x;
+    }
+}
+
+/**
+ * Create a view of the first n rows of the table as if it was sorted on the
+ * key, e.g. the 50 rows with the largest value in a column. Only the
+ * selected rows are sorted so the cost is O(rows + n log n) compared to
+ * O(rows log rows) for a full sort. Rows that are equal on the key are kept
+ * in the order they were created. The first nhdr rows are header rows that
+ * are always included first in the view and are not part of the selection.
+ * The column widths of the view are computed over the selected rows.
+ * @param t Table pointer
+ * @param key Sort key
+ * @param n Number of rows to select, fewer if the table is smaller
+ * @param nhdr Number of header rows
+ * @return NULL on failure, pointer to the new view otherwise
+ */
+tview_t *
+utable_view_top(table_t *t, const sortkey_t *key, size_t n, size_t nhdr) {
+    if (_utable_col_chk(t, key->col)) return NULL;
+    nhdr = MIN(nhdr, t->nRow);
+    const size_t ndata = t->nRow - nhdr;
+    n = MIN(n, ndata);
+
+    // Without rows to select the view only has the header rows
+    tsortent_t *e = n > 0 ? malloc(ndata * sizeof(tsortent_t)) : NULL;
+    tview_t *v = _utable_view_alloc(t, nhdr + n);
+    if ((n > 0 && NULL == e) || NULL == v) {
+        logmsg("CRITICAL : Failed to create view. Out of memory.");
+        free(e);
+        if (v) {
+            free(v->rows);
+            free(v->setwidth);
+            free(v);
+        }
+        return NULL;
+    }
+
+    if (n > 0) {
+        // The text used for selecting includes any text set by callbacks
+        tview_t tv;
+        _utable_table_view(t, &tv);
+        _utable_run_callbacks(&tv);
+
+        for (size_t i = 0; i < ndata; i++) e[i].row = nhdr + i;
+        _utable_sort_keys(t, e, ndata, key);
+        _utable_top_select(e, ndata, n,
+                           SORT_NUMERIC == key->cmp  ? NULL
+                           : SORT_NATURAL == key->cmp ? _utable_sort_cmp_nat
+                                                      : _utable_sort_cmp_str,
+                           key->descending);
+    }
+
+    for (size_t r = 0; r < nhdr; r++) v->rows[r] = r;
+    for (size_t i = 0; i < n; i++) v->rows[nhdr + i] = e[i].row;
+    v->nRow = nhdr + n;
+    free(e);
+    MEM_ADD(_utable_view_size(v));
+    return v;
+}
+
+/**
+ * Internal helper to replace the column map of a view. The column widths
+ * set on the view are reset since the columns have changed.
+ * @param v View
+ * @param cols New column map, NULL for all columns
+ * @param n Number of columns in the view
+ * @return 0 on success, -1 on failure
+ */
+static int
+_utable_view_setmap(tview_t *v, size_t *cols, size_t n) {
+    size_t *w = calloc(2 * n + 1, sizeof(size_t));
+    if (NULL == w) {
+        logmsg("CRITICAL : Failed to update view. Out of memory.");
+        return -1;
+    }
+    MEM_SUB(_utable_view_size(v));
+    free(v->cols);
+    free(v->setwidth);
+    v->cols = cols;
+    v->nCol = n;
+    v->setwidth = w;
+    v->colwidth = w + n;
+    MEM_ADD(_utable_view_size(v));
+    return 0;
+}
+
+/**
+ * Select which columns of the base table are drawn in a view and in which
+ * order. A column may be listed more than once. Only the listed columns are
+ * visited when the view is stroked so a narrow projection of a wide table is
+ * cheap. A cell that spans columns keeps its span as long as the spanned
+ * columns follow it in the same order in the view. For a transposed view
+ * the columns are rows in the base table.
+ * @param v View
+ * @param cols Columns in the base table
+ * @param n Number of columns, at least 1
+ * @return 0 on success, -1 on failure
+ */
+int
+utable_view_set_cols(tview_t *v, const size_t cols[], size_t n) {
+    const size_t max = v->transposed ? v->base->nRow : v->base->nCol;
+    if (0 == n) return -1;
+    for (size_t j = 0; j < n; j++) {
+        if (cols[j] >= max) {
+            char buffer[128];
+            snprintf(buffer, sizeof(buffer),
+                     "View column specified is out of range [%zu]", cols[j]);
+            logmsg(buffer);
+            return -1;
+        }
+    }
+    size_t *map = malloc(n * sizeof(size_t));
+    if (NULL == map) {
+        logmsg("CRITICAL : Failed to update view. Out of memory.");
+        return -1;
+    }
+    memcpy(map, cols, n * sizeof(size_t));
+    if (_utable_view_setmap(v, map, n)) {
+        free(map);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Transpose a view so that each row in the base table is drawn as a column
+ * and each column as a row. This is typically used to show a single record
+ * as a list of fields, e.g. a view of the header row and one data row. Only
+ * the row and column maps are swapped, no cells are copied. Column spans are
+ * not drawn in a transposed view. Transposing a transposed view gives back
+ * the original orientation.
+ * @param v View
+ * @return 0 on success, -1 on failure
+ */
+int
+utable_view_transpose(tview_t *v) {
+    size_t *w = calloc(2 * v->nRow + 1, sizeof(size_t));
+    if (NULL == w) {
+        logmsg("CRITICAL : Failed to update view. Out of memory.");
+        return -1;
+    }
+    MEM_SUB(_utable_view_size(v));
+    free(v->setwidth);
+    size_t *rows = v->rows;
+    const size_t nRow = v->nRow;
+    v->rows = v->cols;
+    v->nRow = v->nCol;
+    v->cols = rows;
+    v->nCol = nRow;
+    v->setwidth = w;
+    v->colwidth = w + v->nCol;
+    v->transposed = !v->transposed;
+    MEM_ADD(_utable_view_size(v));
+    return 0;
+}
+
+/**
+ * Stroke the rows in a view in the specified style to specified file
+ * descriptor. The title, formats and borders are taken from the base table.
+ * @param v     View to stroke
+ * @param fd    File descriptor to write to
+ * @param style Table layout style to use
+ * @return -1 on failure, 0 on success
+ */
+int
+utable_view_stroke(tview_t *v, int fd, tblstyle_t style) {
+    return _utable_stroke_fd(v, fd, style, 0, 0, NULL);
 }
 
 /**
- * Set the width for the specified column
- * @param t Table pointer
- * @param col Column to set
- * @param width Width to set
- * @return 0 on success, -1 on failure
+ * Stroke the part of a view that is inside a window, see
+ * utable_stroke_window()
+ * @param v     View to stroke
+ * @param fd    File descriptor to write to
+ * @param style Table layout style to use
+ * @param xoff  First character of each line to stroke, 0 is the left border
+ * @param width Width of the window in characters
+ * @return -1 on failure, 0 on success
  */
 int
-utable_set_colwidth(table_t *t, size_t col, size_t width) {
-    if (col >= t->nCol) return -1;
-    t->colwidth[col] = width;
-    return 0;
+utable_view_stroke_window(tview_t *v, int fd, tblstyle_t style, size_t xoff,
+                          size_t width) {
+    if (0 == width) return -1;
+    return _utable_stroke_fd(v, fd, style, xoff, width, NULL);
 }
 
 /**
- * Set the width for all columns in the table
- * @param t Table pointer
- * @param width Width to set
+ * Stroke the rows in a view in the specified style to a function, see
+ * utable_stroke_cb()
+ * @param v     View to stroke
+ * @param cb    Function that is given the output
+ * @param ctx   Context given to the function
+ * @param style Table layout style to use
+ * @return -1 on failure, 0 on success
  */
-void
-utable_set_table_colwidth(table_t *t, size_t width) {
-    for (size_t c = 0; c < t->nCol; c++) {
-        utable_set_colwidth(t, c, width);
-    }
+int
+utable_view_stroke_cb(tview_t *v, t_write_cb cb, void *ctx, tblstyle_t style) {
+    return _utable_stroke_cb(v, cb, ctx, style);
 }
 
 /**
- * Reset column widths for entire table to auto
- * @param t Table pointer
+ * Stroke the rows in a view in the specified style to specified string
+ * buffer
+ * @param v     View to stroke
+ * @param buff  String buffer to write to
+ * @param bufflen Length of string buffer in bytes
+ * @param style Table layout style to use
+ * @return -1 on failure, 0 on success
  */
-void
-utable_reset_table_colwidth(table_t *t) {
-    utable_set_table_colwidth(t, 0);
+int
+utable_view_strstroke(tview_t *v, char *buff, size_t bufflen,
+                      tblstyle_t style) {
+    return _utable_strstroke(v, buff, bufflen, style);
 }
 
 /**
- * Set the min width for the specified column
- * @param t Table pointer
- * @param col Column to set
- * @param width Width to set
+ * Stroke the rows in a view in the specified style to a file, see
+ * utable_stroke_file()
+ * @param v     View to stroke
+ * @param path  File to write to, it is created or truncated
+ * @param style Table layout style to use
+ * @return -1 on failure, 0 on success
  */
 int
-utable_set_mincolwidth(table_t *t, size_t col, size_t width) {
-    if (col >= t->nCol) return -1;
-    t->mincolwidth[col] = width;
-    return 0;
+utable_view_stroke_file(tview_t *v, const char *path, tblstyle_t style) {
+    return _utable_stroke_file(v, path, style);
 }
 
 /**
- * Set the minimum width for all columns in the table
+ * Internal helper to copy a chunk of rows with their texts
  * @param t Table pointer
- * @param width Width to set
+ * @param k Chunk
+ * @return NULL on failure, the new chunk otherwise with one reference
  */
-void
-utable_set_table_mincolwidth(table_t *t, size_t width) {
-    for (size_t c = 0; c < t->nCol; c++) {
-        utable_set_mincolwidth(t, c, width);
+static tchunk_t *
+_utable_chunk_build(table_t *t, size_t k) {
+    const size_t r0 = k * SNAP_ROWS;
+    const size_t n = (MIN(t->nRow, r0 + SNAP_ROWS) - r0) * t->nCol;
+    size_t size = sizeof(tchunk_t) + n * sizeof(tcell_t) +
+                  t->nCol * sizeof(size_t);
+    for (size_t i = 0; i < n; i++) {
+        const tcell_t *src = &TCELL(r0 + i / t->nCol, i % t->nCol);
+        if (src->t) size += src->len + 1;
+    }
+    tchunk_t *ch = malloc(size);
+    if (NULL == ch) return NULL;
+    ch->refs = 1;
+    ch->size = size;
+    ch->w = (size_t *) (ch->c + n);
+    memset(ch->w, 0, t->nCol * sizeof(size_t));
+    char *p = (char *) (ch->w + t->nCol);
+    for (size_t i = 0; i < n; i++) {
+        const size_t r = r0 + i / t->nCol, c = i % t->nCol;
+        const tcell_t *src = &TCELL(r, c);
+        size_t lpad, rpad;
+        _utable_get_cp(t, r, c, &lpad, &rpad);
+        ch->w[c] = MAX(ch->w[c], xmb_width_n(src->t, src->len) + lpad + rpad);
+        ch->c[i] = *src;
+        ch->c[i].flags = (src->flags & ~CELL_BORROWED) | CELL_SHARED;
+        if (src->t) {
+            memcpy(p, src->t, src->len);
+            p[src->len] = '\0';
+            ch->c[i].t = p;
+            p += src->len + 1;
+        }
     }
+    MEM_ADD(size);
+    return ch;
 }
 
-static _Bool cut_in_padding = FALSE;
-
 /**
- * Determine policy when table width is set too small to fit everythign that is
- * needed. If flag is set to true then the left padding will be kept as much as
- * possible and the text and the right padding will be cut as needed.
- * If false then the padding will be kept as much as possible (both left and
- * right) and the text cut as needed. Default is false sp the padding will be
- * kept as much as possible
- * @param cutInPadding
+ * Internal helper to copy the formats, footers and other table wide state
+ * into a snapshot. Everything that is allocated is accounted for so that the
+ * snapshot can be freed with utable_free() on failure.
+ * @param t Table pointer
+ * @param s Snapshot
+ * @return 0 on success, -1 on failure
  */
-void
-utable_set_padding_policy(_Bool cutInPadding) {
-    cut_in_padding = cutInPadding;
+static int
+_utable_snap_copy(table_t *t, table_t *s) {
+    s->tag = t->tag;
+    s->deffmt = t->deffmt;
+    s->fmtSeq = t->fmtSeq;
+    s->haveSpan = t->haveSpan;
+    s->titleStyle = t->titleStyle;
+    s->interior_v = t->interior_v;
+    s->interior_h = t->interior_h;
+    s->headerLine = t->headerLine;
+    s->noKernel = t->noKernel;
+    memcpy(s->colwidth, t->colwidth, (t->nCol + 1) * sizeof(size_t));
+    memcpy(s->mincolwidth, t->mincolwidth, (t->nCol + 1) * sizeof(size_t));
+    memcpy(s->colfmt, t->colfmt, (t->nCol + 1) * sizeof(tfmt_t));
+
+    if (t->ovrSize) {
+        s->ovr = malloc(t->ovrSize * sizeof(tovr_t));
+        if (NULL == s->ovr) return -1;
+        memcpy(s->ovr, t->ovr, t->ovrSize * sizeof(tovr_t));
+        s->ovrSize = t->ovrSize;
+        s->ovrUsed = t->ovrUsed;
+        MEM_ADD(s->ovrSize * sizeof(tovr_t));
+    }
+    if (s->haveSpan && _utable_span_index(s)) return -1;
+    if (t->title) {
+        s->title = strdup(t->title);
+        if (NULL == s->title) return -1;
+        MEM_ADD(strlen(s->title) + 1);
+    }
+    if (t->rowmap) {
+        s->rowmap = malloc(t->nRow * sizeof(size_t) + 1);
+        if (NULL == s->rowmap) return -1;
+        memcpy(s->rowmap, t->rowmap, t->nRow * sizeof(size_t));
+        MEM_ADD(t->nRow * sizeof(size_t));
+    }
+    if (t->agg) {
+        s->agg = calloc(t->nCol, sizeof(tagg_t));
+        if (NULL == s->agg) return -1;
+        MEM_ADD(t->nCol * sizeof(tagg_t));
+        for (size_t c = 0; c < t->nCol; c++) {
+            const tagg_t *a = &t->agg[c];
+            tagg_t *b = &s->agg[c];
+            if (_utable_agg_setstr(&b->fmt, a->fmt) ||
+                _utable_agg_setstr(&b->label, a->label))
+                return -1;
+            b->agg = a->agg;
+            if (AGG_NONE == a->agg) continue;
+            // The totals are computed now so that a stroke of the snapshot
+            // only reads them
+            if (_utable_agg_totals(t, c)) return -1;
+            b->val = malloc(t->nRow * sizeof(double) + 1);
+            if (NULL == b->val) return -1;
+            memcpy(b->val, a->val, t->nRow * sizeof(double));
+            MEM_ADD(t->nRow * sizeof(double));
+            b->reduced = TRUE;
+            b->sum = a->sum;
+            b->min = a->min;
+            b->max = a->max;
+            b->count = a->count;
+        }
+    }
+    return 0;
 }
 
 /**
- * Internal helper function to draw a single line of table data
- * @param file Filepointer to write to
+ * Make an immutable snapshot of the table. The snapshot is a table of its
+ * own that can be stroked, exported or used as the base of views while the
+ * table keeps being changed, typically by another thread. Any cell callbacks
+ * are run when the snapshot is made and the snapshot has their texts.
+ *
+ * The cells and their texts are copied in chunks of rows that are shared
+ * between the snapshots of a table. Only the chunks with a row that has
+ * changed since the last snapshot are copied again, the other chunks are
+ * shared with the previous snapshot, so making a snapshot of a table where
+ * few rows change only costs its row directory. A snapshot must not be changed. Since nothing is
+ * written to it when it is stroked the same snapshot may be stroked from
+ * several threads at once. It is released with utable_snapshot_release().
  * @param t Table pointer
- * @param row Row to draw
- * @param style Table style
+ * @return NULL on failure, the new snapshot otherwise
  */
-#define MAXPADCHARS 256
-#define MAXPBUFF (10 * 1024)
-
-static void
-_utable_draw_cellcontent_row(char *buff, int *buffleft, table_t *t,
-                             size_t row, char *midleft,
-                             char *midright, char *midvert) {
-    size_t c = 0;
-    int buffused = 0;
-    char pbuff[MAXPBUFF];
-
-    *pbuff = '\0';
-    while (c < t->nCol) {
-        int w = 0;
-
-        // tcell_t *cell = &t->c[TIDX(row, c)];
-
-        // Determine the total width of this cell. This needs to take
-        // into account the fact that this could be a cell that is spanning
-        // multiple other cells.
-        const size_t cspan = t->c[TIDX(row, c)].cspan;
-        size_t lpad, rpad;
-        _utable_get_cp(t, row, c, &lpad, &rpad);
-        // const size_t totpad = lpad + rpad;
-        char lpadstr[MAXPADCHARS], rpadstr[MAXPADCHARS];
+table_t *
+utable_snapshot(table_t *t) {
+    tview_t tv;
+    _utable_table_view(t, &tv);
+    _utable_run_callbacks(&tv);
 
-        for (size_t i = 0; i < lpad; ++i) {
-            lpadstr[i] = ' ';
-        }
-        for (size_t i = 0; i < rpad; ++i) {
-            rpadstr[i] = ' ';
-        }
-        lpadstr[lpad] = '\0';
-        rpadstr[rpad] = '\0';
-        for (size_t cs = 0; cs < cspan; cs++) {
-            w += t->colwidth[c + cs] + 1;
+    const size_t nchunk = (t->nRow + SNAP_ROWS - 1) / SNAP_ROWS;
+    if (NULL == t->chunks) {
+        // The first snapshot copies all chunks and the table starts to track
+        // the changed rows
+        utable_mem_t before;
+        utable_memory_usage(t, &before);
+        t->chunks = calloc(nchunk + 1, sizeof(tchunk_t *));
+        t->chunkDirty = malloc(nchunk + 1);
+        if (NULL == t->chunks || NULL == t->chunkDirty) {
+            logmsg("CRITICAL : Failed to create snapshot. Out of memory.");
+            free(t->chunks);
+            free(t->chunkDirty);
+            t->chunks = NULL;
+            t->chunkDirty = NULL;
+            return NULL;
         }
-        w -= 1;  // Don't include the last border since that remains
-
-        if (NULL != t->c[TIDX(row, c)].cb) {
-            char *cb_str =
-                    t->c[TIDX(row, c)].cb(row - (t->title ? 1 : 0), c, t->tag);
-            if (NULL != cb_str) {
-                if (t->c[TIDX(row, c)].t) {
-                    free(t->c[TIDX(row, c)].t);
-                }
-                t->c[TIDX(row, c)].t = strdup(cb_str);
+        memset(t->chunkDirty, TRUE, nchunk + 1);
+        _utable_mem_sync(t, &before);
+    }
+    for (size_t k = 0; k < nchunk; k++) {
+        if (t->chunkDirty[k] || NULL == t->chunks[k]) {
+            tchunk_t *ch = _utable_chunk_build(t, k);
+            if (NULL == ch) {
+                logmsg("CRITICAL : Failed to create snapshot. Out of memory.");
+                return NULL;
             }
+            _utable_chunk_release(t->chunks[k]);
+            t->chunks[k] = ch;
+            t->chunkDirty[k] = FALSE;
         }
+    }
 
-        const char *txt = t->c[TIDX(row, c)].t;
-        char txtbuff[512], txtbuff2[1024];
-
-        // A choice in how to handle the case when the column width is smaller
-        // than what is needed. We can either include the padding chars in the
-        // limiting or try to maintain the padding and only limiting the actual
-        // content
-        if (cut_in_padding) {
-            // Cut the text so that even the right padding is cut
-            snprintf(txtbuff2, sizeof(txtbuff2), "%s%s%s", lpadstr, txt,
-                     rpadstr);
-            size_t len = xmb_offset(txtbuff2, w);
-            xstrlcpy(txtbuff, txtbuff2,
-                     len + 1);  // +1 since the length also must include the
-            // terminating 0
-        } else {
-            // Keep the padding chars as much as possible
-            snprintf(txtbuff2, sizeof(txtbuff2), "%s%s", lpadstr, txt);
-            size_t len = xmb_offset(txtbuff2, w - rpad);
-            xstrlcpy(txtbuff, txtbuff2,
-                     len + 1);  // +1 since the length also must include the
-            // terminating 0
-            snprintf(txtbuff2, sizeof(txtbuff2), "%s%s", txtbuff, rpadstr);
-            len = xmb_offset(txtbuff2, w) + 1;  // Offset starts at 0
-            xstrlcpy(txtbuff, txtbuff2,
-                     len + 1);  // +1 since the length also must include the
-            // terminating 0
-        }
-
-        // We reuse the rpadstr buffer to use for padding the cell to the
-        // assigned width in order to make the text left, right or center
-        // aligned We have to do this ourself since it is not safe to use "%*s"
-        // format since this is not UTF safe since internally snprintf() uses
-        // strlen())
-        memset(rpadstr, 0, sizeof(rpadstr));
-        if (w > (int) utf8len(txtbuff))
-            for (size_t i = 0; i < w - utf8len(txtbuff); ++i) {
-                rpadstr[i] = ' ';
-            }
+    // The snapshot has no cells of its own, its row directory points into
+    // the chunks
+    table_t *s = utable_create(0, t->nCol);
+    if (NULL == s) return NULL;
+    utable_mem_t before;
+    utable_memory_usage(s, &before);
+    tcell_t **row = realloc(s->row, (t->nRow + 1) * sizeof(tcell_t *));
+    if (row) {
+        s->row = row;
+        s->rowCap = t->nRow;
+        s->chunks = calloc(nchunk + 1, sizeof(tchunk_t *));
+    }
+    if (NULL == row || NULL == s->chunks) {
+        logmsg("CRITICAL : Failed to create snapshot. Out of memory.");
+        _utable_mem_sync(s, &before);
+        utable_free(s);
+        return NULL;
+    }
+    s->nRow = t->nRow;
+    for (size_t k = 0; k < nchunk; k++) {
+        tchunk_t *ch = t->chunks[k];
+        __atomic_add_fetch(&ch->refs, 1, __ATOMIC_RELAXED);
+        s->chunks[k] = ch;
+        const size_t r0 = k * SNAP_ROWS;
+        for (size_t r = r0; r < MIN(s->nRow, r0 + SNAP_ROWS); r++)
+            s->row[r] = &ch->c[(r - r0) * s->nCol];
+    }
+    _utable_mem_sync(s, &before);
+    if (_utable_snap_copy(t, s)) {
+        logmsg("CRITICAL : Failed to create snapshot. Out of memory.");
+        utable_free(s);
+        return NULL;
+    }
 
-        // We need these values to center the text
-        const int w_half = w / 2;
-        const int len_half = (utf8len(txtbuff) /*+ totpad*/) / 2;
-        int padlen;
-
-        if (c == 0) {
-            switch (t->c[TIDX(row, c)].halign) {
-                case RIGHTALIGN:
-                    buffused = snprintf(pbuff, MAXPBUFF, "%s%s%s", midleft,
-                                        rpadstr, txtbuff);
-                    xstrlcat(buff, pbuff, *buffleft);
-                    *buffleft -= buffused;
-                    break;
-                case LEFTALIGN:
-                    buffused = snprintf(pbuff, MAXPBUFF, "%s%s%s", midleft,
-                                        txtbuff, rpadstr);
-                    xstrlcat(buff, pbuff, *buffleft);
-                    *buffleft -= buffused;
-                    break;
-                case CENTERALIGN:
-                    memset(rpadstr, 0, sizeof(rpadstr));
-                    padlen = (w - w_half + len_half) - utf8len(txtbuff);
-                    for (int i = 0; i < padlen; ++i) {
-                        rpadstr[i] = ' ';
-                    }
-                    buffused =
-                            snprintf(pbuff, MAXPBUFF, "%s%*s%s%s", midleft,
-                                     w_half - len_half, "", txtbuff, rpadstr);
-                    xstrlcat(buff, pbuff, *buffleft);
-                    *buffleft -= buffused;
-                    break;
-            }
-        } else {
-            switch (t->c[TIDX(row, c)].halign) {
-                case RIGHTALIGN:
-                    buffused = snprintf(pbuff, MAXPBUFF, "%s%s%s", midvert,
-                                        rpadstr, txtbuff);
-                    xstrlcat(buff, pbuff, *buffleft);
-                    *buffleft -= buffused;
-                    break;
-                case LEFTALIGN:
-                    buffused = snprintf(pbuff, MAXPBUFF, "%s%s%s", midvert,
-                                        txtbuff, rpadstr);
-                    xstrlcat(buff, pbuff, *buffleft);
-                    *buffleft -= buffused;
-                    break;
-                case CENTERALIGN:
-                    memset(rpadstr, 0, sizeof(rpadstr));
-                    padlen = (w - w_half + len_half) - utf8len(txtbuff);
-                    for (int i = 0; i < padlen; ++i) {
-                        rpadstr[i] = ' ';
-                    }
-                    buffused =
-                            snprintf(pbuff, MAXPBUFF, "%s%*s%s%s", midvert,
-                                     w_half - len_half, "", txtbuff, rpadstr);
-                    xstrlcat(buff, pbuff, *buffleft);
-                    *buffleft -= buffused;
-                    break;
-            }
+    // The column widths are fixed now so that strokes of the snapshot do not
+    // need to write them
+    s->snapRefs = 1;
+    const char **ftxt = NULL;
+    _utable_table_view(s, &tv);
+    if (_utable_have_footer(s)) {
+        ftxt = _utable_footer_alloc(&tv);
+        if (NULL == ftxt) {
+            logmsg("CRITICAL : Failed to create snapshot. Out of memory.");
+            utable_free(s);
+            return NULL;
         }
-
-        c += cspan;
+        _utable_footer_texts(&tv, ftxt);
     }
-    buffused = snprintf(pbuff, MAXPBUFF, "%s\n", midright);
-    xstrlcat(buff, pbuff, *buffleft);
-    *buffleft -= buffused;
+    _utable_set_autocolwidth(&tv, ftxt);
+    free(ftxt);
+    return s;
 }
 
 /**
- * Set automatic column width for columns with no user specified width
- * @param t Table pointer
+ * Drop a reference to a snapshot and free it when it was the last one. This
+ * can be called from any thread.
+ * @param s Snapshot
  */
-static void
-_utable_set_autocolwidth(table_t *t) {
-    for (size_t c = 0; c < t->nCol; c++) {
-        if (t->colwidth[c] == 0) {
-            // User has not yet set column width so find the widest text
-            // If the table has a header row we must ignore that since it
-            // a) only has one column allocated, and b) will be as wide as the
-            // table
-            size_t startrow = 0;
-            if (t->title && t->titleCopied) startrow = 1;
-            for (size_t r = startrow; r < t->nRow; r++) {
-                size_t lpad, rpad;
-                _utable_get_cp(t, r, c, &lpad, &rpad);
-                if (utf8len(t->c[TIDX(r, c)].t) + lpad + rpad >
-                    t->colwidth[c]) {
-                    t->colwidth[c] = utf8len(t->c[TIDX(r, c)].t) + lpad + rpad;
-                }
-            }
-            t->colwidth[c] = MAX(t->colwidth[c], t->mincolwidth[c]);
-            // Make sure the column width is at least 1 character wide
-            if (0 == t->colwidth[c]) t->colwidth[c] = 1;
-        }
-    }
+void
+utable_snapshot_release(table_t *s) {
+    if (s && 0 == __atomic_sub_fetch(&s->snapRefs, 1, __ATOMIC_ACQ_REL))
+        utable_free(s);
 }
 
 /**
- * Internal helper function. This functions builds a logic view of the border
- * between two rows. Since the vertical borders up and down are not necessarily
- * always on the same position since cell can have been merged (spans over
- * several columns) this function sets a the logical map "eval" if it
- * discovers the need for vertical border. The same logical map are used
- * with both the "over" and "under" row of data. The value to logically or
- * is specified in the "mark" argument. To find the top verticals
- * we normally call this function with mark==1 and for the bottom verticals
- * we call this with mark==2. If the logical map is initialized with 0 this will
- * can the be interpretated as 0=only a horizontal, 1=horizontal with an "up"
- * vertical, 2=horizontal with an "down" vertical and 2=horizontal with both up
- * and down vertical
- * @param t Table pointer
- * @param eval
- * @param mark
- * @param row
+ * Create a slot where one writer thread publishes snapshots of a table and
+ * any number of reader threads acquire the latest one
+ * @return NULL on failure, the new slot otherwise
  */
-static void
-_utable_mark_verticals(table_t *t, int eval[], int mark,
-                       size_t row) {
-    size_t c = 0;
-    size_t absw = 0;
-    while (c < t->nCol) {
-        int w = 0;
-        for (size_t cs = 0; cs < t->c[TIDX(row, c)].cspan; cs++) {
-            w += t->colwidth[c + cs] + 1;
-        }
+tpub_t *
+utable_pub_create(void) {
+    tpub_t *p = calloc(1, sizeof(tpub_t));
+    if (NULL == p) logmsg("CRITICAL : Failed to create slot. Out of memory.");
+    return p;
+}
 
-        absw += w;
-        eval[absw - 1] |= mark;
-        c += t->c[TIDX(row, c)].cspan;
+/**
+ * Free a slot and release the snapshots it holds. No reader may be in
+ * utable_pub_acquire() when the slot is freed, snapshots that have been
+ * acquired stay valid until they are released.
+ * @param p Slot
+ */
+void
+utable_pub_free(tpub_t *p) {
+    for (int e = 0; e < 2; e++) {
+        for (size_t i = 0; i < p->nRetired[e]; i++)
+            utable_snapshot_release(p->retired[e][i]);
+        free(p->retired[e]);
     }
+    utable_snapshot_release(p->cur);
+    free(p);
 }
 
 /**
- * Internal helper functions to write out the border characters identified by
- * the _mark_verticals
- * @param file
- * @param totwidth
- * @param eval
- * @param s0
- * @param s1
- * @param s2
- * @param s3
+ * Make a snapshot of the table and publish it in the slot, replacing the
+ * snapshot published before. This must only be called from one thread for
+ * each slot, normally the thread that changes the table. It never waits for
+ * the readers. A replaced snapshot is put on the retire list of the current
+ * epoch. The epoch is advanced when no reader is left that started in the
+ * epoch before it, and the snapshots replaced in that epoch are released
+ * then. Readers that keep coming only hold back the epoch they started in,
+ * so the retire lists stay short also when a reader is always present.
+ * @param p Slot
+ * @param t Table pointer
+ * @return 0 on success, -1 on failure
  */
-static void
-_utable_stroke_verticals(char *buff, int *buffleft, int totwidth,
-                         int eval[], char *s0, char *s1, char *s2,
-                         char *s3) {
-    int buffused = 0;
-    char pbuff[MAXPBUFF];
-    for (int i = 0; i < totwidth - 1; i++) {
-        if (eval[i] == 0) {  // HORIZONTAL
-            if (s0 == NULL)
-                buffused = snprintf(pbuff, MAXPBUFF, "#ERR#");
-            else
-                buffused = snprintf(pbuff, MAXPBUFF, "%s", s0);
-
-            xstrlcat(buff, pbuff, *buffleft);
-            *buffleft -= buffused;
-        } else if (eval[i] == 1) {  // TOP DOWN
-            if (s1 == NULL)
-                buffused = snprintf(pbuff, MAXPBUFF, "#ERR#");
-            else
-                buffused = snprintf(pbuff, MAXPBUFF, "%s", s1);
-
-            xstrlcat(buff, pbuff, *buffleft);
-            *buffleft -= buffused;
-
-        } else if (eval[i] == 2) {  // BOTTOM UP
-            if (s2 == NULL)
-                buffused = snprintf(pbuff, MAXPBUFF, "#ERR#");
-            else
-                buffused = snprintf(pbuff, MAXPBUFF, "%s", s2);
-
-            xstrlcat(buff, pbuff, *buffleft);
-            *buffleft -= buffused;
-        } else {  // CROSS
-            if (s3 == NULL)
-                buffused = snprintf(pbuff, MAXPBUFF, "#ERR#");
-            else
-                buffused = snprintf(pbuff, MAXPBUFF, "%s", s3);
-
-            xstrlcat(buff, pbuff, *buffleft);
-            *buffleft -= buffused;
+int
+utable_pub_publish(tpub_t *p, table_t *t) {
+    const size_t e = p->epoch & 1;
+    if (p->nRetired[e] == p->retiredSize[e]) {
+        const size_t size = p->retiredSize[e] ? 2 * p->retiredSize[e] : 8;
+        table_t **r = realloc(p->retired[e], size * sizeof(table_t *));
+        if (NULL == r) {
+            logmsg("CRITICAL : Failed to publish snapshot. Out of memory.");
+            return -1;
         }
+        p->retired[e] = r;
+        p->retiredSize[e] = size;
     }
-    if (*buffleft < 1) {
-        logmsg("Out of buffer space in _utable_stroke_verticals()");
-        exit(EXIT_FAILURE);
+    table_t *s = utable_snapshot(t);
+    if (NULL == s) return -1;
+
+    table_t *old = __atomic_exchange_n(&p->cur, s, __ATOMIC_SEQ_CST);
+    if (old) p->retired[e][p->nRetired[e]++] = old;
+    // Only readers counted when a snapshot was replaced can hold it. The
+    // list of the epoch before the current one is released when its counter
+    // is zero, the other counter was zero when the current epoch began.
+    for (int i = 0; i < 2; i++) {
+        const size_t prev = (p->epoch + 1) & 1;
+        if (__atomic_load_n(&p->readers[prev], __ATOMIC_SEQ_CST)) break;
+        for (size_t j = 0; j < p->nRetired[prev]; j++)
+            utable_snapshot_release(p->retired[prev][j]);
+        p->nRetired[prev] = 0;
+        __atomic_store_n(&p->epoch, p->epoch + 1, __ATOMIC_SEQ_CST);
     }
+    return 0;
 }
 
 /**
- * Set display of interior horizontal and vertical border
- * @param t Table pointer
- * @param v Flag to enable/disable vertical interior borders
- * @param h Flag to enable/disable horizontal interior borders
+ * Get the latest snapshot published in the slot. This never blocks and can
+ * be called from any number of threads. The snapshot stays valid until it
+ * is released with utable_snapshot_release(), also when newer snapshots are
+ * published.
+ * @param p Slot
+ * @return NULL if nothing has been published yet, the snapshot otherwise
  */
-void
-utable_set_interior(table_t *t, _Bool v, _Bool h) {
-    t->interior_v = v;
-    t->interior_h = h;
+table_t *
+utable_pub_acquire(tpub_t *p) {
+    const size_t e = __atomic_load_n(&p->epoch, __ATOMIC_SEQ_CST) & 1;
+    __atomic_add_fetch(&p->readers[e], 1, __ATOMIC_SEQ_CST);
+    table_t *s = __atomic_load_n(&p->cur, __ATOMIC_SEQ_CST);
+    if (s) __atomic_add_fetch(&s->snapRefs, 1, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&p->readers[e], 1, __ATOMIC_SEQ_CST);
+    return s;
 }
 
 /**
- * Stroke the entire table to STDOUT
- * @param t     Table pointer
- * @param style Table layout style to use
- *              Possible styles are: TSTYLE_TOP_DL, TSTYLE_FULL_DL, TSTYLE_SL,
- * TSTYLE_TOPBOTTOM_DL
- * @return -1 on failure, 0 on success
+ * Enable or disable collection of stroke statistics for the table. When
+ * disabled (the default) no time is spent on collecting statistics.
+ * Enabling statistics on a table that already collects statistics keeps
+ * the values collected so far.
+ * @param t Table pointer
+ * @param enable Flag to enable/disable statistics
+ * @return 0 on success, -1 on failure
  */
 int
-utable_stroke_stdout(table_t *t, tblstyle_t style) {
-    return utable_stroke(t, STDOUT_FILENO, style);
+utable_enable_stats(table_t *t, _Bool enable) {
+    if (!enable) {
+        if (t->stats) MEM_SUB(sizeof(utable_stats_t));
+        free(t->stats);
+        t->stats = NULL;
+    } else if (NULL == t->stats) {
+        t->stats = calloc(1, sizeof(utable_stats_t));
+        if (NULL == t->stats) {
+            logmsg("CRITICAL : Failed to enable statistics. Out of memory.");
+            return -1;
+        }
+        MEM_ADD(sizeof(utable_stats_t));
+    }
+    return 0;
 }
 
 /**
- * Stroke the entire table in the specified style to specified file descriptor
- * @param t     Table pointer
- * @param fd    File descriptor to write to
- * @param style Table layout style to use
- * @return -1 on failure, 0 on success
+ * Get a copy of the stroke statistics collected for the table
+ * @param t Table pointer
+ * @param stats Statistics to fill in
+ * @return 0 on success, -1 if statistics are not enabled for the table
  */
 int
-utable_stroke(table_t *t, int fd, tblstyle_t style) {
-    char *buff = calloc(MAXSTROKEBUFF, sizeof(char));
-    if (NULL == buff || -1 == utable_strstroke(t, buff, MAXSTROKEBUFF, style)) {
-        free(buff);
-        return -1;
-    }
-
-    int ret = write(fd, buff, strlen(buff));
-
-    free(buff);
-    return ret;
+utable_get_stats(table_t *t, utable_stats_t *stats) {
+    if (NULL == t->stats) return -1;
+    *stats = *t->stats;
+    return 0;
 }
 
 /**
- * Internal helper fuction to set up the title
- * @param t	Table handle
+ * Reset all the stroke statistics for the table to zero
+ * @param t Table pointer
  */
-static void
-_utable_strstroke_title(table_t *t) {
-    if (t->title) {
-        // We need to check if this has already been done since it is perfectly
-        // legal to stroke the same table objct multiple times
-        if (!t->titleCopied) {
-            // Insert the title as the top row by moving existing row down one
-            // step
-            memmove(&t->c[t->nCol], &t->c[0], (t->nRow * t->nCol) * sizeof(tcell_t));
-            memset(&t->c[0], 0, t->nCol * sizeof(tcell_t));
-            t->c[0].t = strdup(t->title);
-            t->c[0].halign = CENTERALIGN;
-            utable_set_cell_colspan(t, 0, 0, t->nCol);
-            t->nRow++;
-            t->titleCopied = TRUE;
-        } else {
-            free(t->c[0].t);
-            t->c[0].t = strdup(t->title);
-        }
-    }
+void
+utable_reset_stats(table_t *t) {
+    if (t->stats) memset(t->stats, 0, sizeof(utable_stats_t));
 }
 
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wstack-protector"
-
 /**
- * Stroke the entire table in the specified style to specified string buffer
- * @param t     Table pointer
- * @param buff  String buffer to write to
- * @param bufflen Length of string byffer in bytes
- * @param style Table layout style to use
- * @return -1 on failure, 0 on success
+ * Get the memory used by the table broken down by category
+ * @param t Table pointer
+ * @param mem Memory usage to fill in
  */
-int
-utable_strstroke(table_t *t, char *buff, size_t bufflen, tblstyle_t style) {
-
-    _utable_set_autocolwidth(t);
-    _utable_strstroke_title(t);
-
-    // Get the total width of the table in characters
-    size_t totwidth = 0;
-    for (size_t i = 0; i < t->nCol; i++) totwidth += t->colwidth[i] + 1;
-
-    if (0 == totwidth) return -1;
-
-    /* The eval is used to evaluate markers on the table */
-    int eval[totwidth];
-
-    /* Get characters to use for this style into style data (sd)*/
-    style_t sd;
-    get_style(style, &sd, t->interior_v);
-
-    char pbuff[MAXPBUFF];
-    *buff = '\0';
-    memset(eval, 0, sizeof(int) * totwidth);
-    int buffleft = bufflen;
-    int len = snprintf(pbuff, MAXPBUFF, "%s", sd.top_left);
-    xstrlcat(buff, pbuff, buffleft);
-    buffleft -= len;
-    if (buffleft < 1) return -1;
-
-    if (t->title)
-        _utable_stroke_verticals(buff, &buffleft, totwidth, eval,
-                                 sd.top_horizontal, NULL, NULL, NULL);
-    else {
-        _utable_mark_verticals(t, eval, 1, 0);
-        _utable_stroke_verticals(buff, &buffleft, totwidth, eval,
-                                 sd.top_horizontal, sd.top_down, NULL, NULL);
-    }
-    if (buffleft < 1) return -1;
-
-    len = snprintf(pbuff, MAXPBUFF, "%s\n", sd.top_right);
-    xstrlcat(buff, pbuff, buffleft);
-    buffleft -= len;
-    if (buffleft < 1) return -1;
-
-    for (size_t r = 0; r < t->nRow; r++) {
-        _utable_draw_cellcontent_row(buff, &buffleft, t, r, sd.border_vertical,
-                                     sd.border_vertical, sd.middle_vertical);
-        if (buffleft < 1) return -1;
-
-        memset(eval, 0, sizeof(int) * totwidth);
-        _utable_mark_verticals(t, eval, 2, r);
-        if (r < t->nRow - 1)
-            _utable_mark_verticals(t, eval, 1, r + 1);  // Top verticals
-
-        if (t->headerLine && ((r == 0 && !t->title) || (r == 1 && t->title))) {
-            // The heavier line just beneath the header row before the data rows
-            len = snprintf(pbuff, MAXPBUFF, "%s", sd.top_middle_left);
-            xstrlcat(buff, pbuff, buffleft);
-            buffleft -= len;
-            if (buffleft < 1) return -1;
-
-            _utable_stroke_verticals(buff, &buffleft, totwidth, eval,
-                                     sd.top_middle_horizontal, NULL, NULL,
-                                     sd.top_middle_cross);
-            if (buffleft < 1) return -1;
-
-            len = snprintf(pbuff, MAXPBUFF, "%s\n", sd.top_middle_right);
-            xstrlcat(buff, pbuff, buffleft);
-            buffleft -= len;
-
-            buffleft -= len;
-            if (buffleft < 1) return -1;
-
-        } else if (r == 0 && t->title) {
-            if (t->titleStyle == TITLESTYLE_LINE) {
-                // The optional thin line beneath the title
-                len = snprintf(pbuff, MAXPBUFF, "%s", sd.middle_left);
-                xstrlcat(buff, pbuff, buffleft);
-                buffleft -= len;
-                if (buffleft < 1) return -1;
-
-                _utable_stroke_verticals(
-                        buff, &buffleft, totwidth, eval, sd.middle_horizontal,
-                        sd.middle_horizontal_down, sd.middle_horizontal_up,
-                        sd.middle_cross);
-                if (buffleft < 1) return -1;
-
-                len = snprintf(pbuff, MAXPBUFF, "%s\n", sd.middle_right);
-                xstrlcat(buff, pbuff, buffleft);
-                buffleft -= len;
-                if (buffleft < 1) return -1;
-            }
-        } else if (t->interior_h) {
-            // Add lines between each data row
-            if (r < t->nRow - 1) {
-                len = snprintf(pbuff, MAXPBUFF, "%s", sd.middle_left);
-                xstrlcat(buff, pbuff, buffleft);
-                buffleft -= len;
-                if (buffleft < 1) return -1;
-
-                _utable_stroke_verticals(
-                        buff, &buffleft, totwidth, eval, sd.middle_horizontal,
-                        sd.middle_horizontal_down, sd.middle_horizontal_up,
-                        sd.middle_cross);
-                if (buffleft < 1) return -1;
-
-                len = snprintf(pbuff, MAXPBUFF, "%s\n", sd.middle_right);
-                xstrlcat(buff, pbuff, buffleft);
-                buffleft -= len;
-                if (buffleft < 1) return -1;
-            }
-        }
-    }
-
-    if (sd.have_bottom_border) {
-        len = snprintf(pbuff, MAXPBUFF, "%s", sd.bottom_left);
-        xstrlcat(buff, pbuff, buffleft);
-        buffleft -= len;
-        if (buffleft < 1) return -1;
-
-        _utable_stroke_verticals(buff, &buffleft, totwidth, eval,
-                                 sd.bottom_horizontal, sd.bottom_up,
-                                 sd.bottom_up, NULL);
-        len = snprintf(pbuff, MAXPBUFF, "%s\n", sd.bottom_right);
-        xstrlcat(buff, pbuff, buffleft);
-        buffleft -= (len + 1);
-        if (buffleft < 1) return -1;
-    }
-
-    return 0;
+void
+utable_memory_usage(table_t *t, utable_mem_t *mem) {
+    mem->table = sizeof(table_t) + (t->stats ? sizeof(utable_stats_t) : 0);
+    // Rows allocated on their own have one cell more, like the block, and
+    // the directories have one entry more than they are used for
+    const size_t nchunk = t->chunks ? (t->nRow + SNAP_ROWS - 1) / SNAP_ROWS + 1 : 0;
+    mem->cells = (t->blockRows * t->nCol + 1 + t->looseRows * (t->nCol + 1)) *
+                 sizeof(tcell_t) + (t->rowCap + 1) * sizeof(tcell_t *) +
+                 nchunk * sizeof(tchunk_t *) + (t->chunkDirty ? nchunk : 0);
+    mem->columns = (t->nCol + 1) * (2 * sizeof(size_t) + sizeof(tfmt_t));
+    mem->overrides = t->ovrSize * sizeof(tovr_t) +
+                     (t->span ? (t->nSpan + 1) * sizeof(tspan_t) : 0);
+    mem->texts = t->textBytes;
+    mem->title = t->title ? strlen(t->title) + 1 : 0;
+    mem->mapped = t->extlen;
+    mem->index = t->rowmap ? t->nRow * sizeof(size_t) : 0;
+    mem->footer = _utable_agg_size(t);
+    mem->total = mem->table + mem->cells + mem->columns + mem->overrides +
+                 mem->texts + mem->title + mem->mapped + mem->index +
+                 mem->footer;
 }
 
-#pragma GCC diagnostic pop
+/**
+ * Get the number of live tables in the process and the total memory they use.
+ * This can be called from any thread.
+ * @param tables Number of live tables, may be NULL
+ * @param bytes Total number of bytes used by the live tables, may be NULL
+ */
+void
+utable_memory_global(size_t *tables, size_t *bytes) {
+    if (tables) *tables = __atomic_load_n(&_live_tables, __ATOMIC_RELAXED);
+    if (bytes) *bytes = __atomic_load_n(&_live_bytes, __ATOMIC_RELAXED);
+}
 
 // [EOF]]
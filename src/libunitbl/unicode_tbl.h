@@ -26,6 +26,9 @@
 #define	UNICODE_TBL_H
 
 #ifdef	__cplusplus
+// Makes the C99 _Bool in the API available as an alias for bool
+#include <stdbool.h>
+
 extern "C" {
 #endif
 
@@ -45,12 +48,61 @@ typedef enum {
 
 
 /**
- * Buffer allocated when we stroke a table. This effectively limits the size of the
- * table we can stroke. We set this to 10 MB
+ * Suggested buffer size for utable_strstroke(). Tables stroked with
+ * utable_stroke() or utable_stroke_file() are not limited in size.
  */
 #define MAXSTROKEBUFF (1024*1024*10)
 
 
+/**
+ * Machine readable export formats
+ */
+typedef enum {
+    EXPORT_CSV,         /**< RFC 4180 comma separated values */
+    EXPORT_TSV,         /**< Tab separated values */
+    EXPORT_JSON_ARRAY,  /**< JSON array with one array per row */
+    EXPORT_JSON_OBJECT, /**< JSON array with one object per data row */
+    EXPORT_MARKDOWN     /**< GitHub flavored Markdown table */
+} exportfmt_t;
+
+/**
+ * Order of the texts in an array with all the cells of a table
+ */
+typedef enum {
+    ROW_MAJOR,  /**< All cells of the first row, then the second row, ... */
+    COL_MAJOR   /**< All cells of the first column, then the second, ... */
+} dataorder_t;
+
+/**
+ * How cells are compared when sorting
+ */
+typedef enum {
+    SORT_STRING,    /**< Byte wise comparison of the cell text */
+    SORT_NUMERIC,   /**< Cell text as a number, non numeric cells last */
+    SORT_NATURAL    /**< As strings but runs of digits compared as numbers */
+} sortcmp_t;
+
+/**
+ * One key when sorting the rows in a table
+ */
+typedef struct {
+    size_t col;         //!< Column to sort on
+    sortcmp_t cmp;      //!< How to compare the cells
+    _Bool descending;   //!< Sort in descending order
+} sortkey_t;
+
+/**
+ * Aggregate drawn in the footer row below a column
+ */
+typedef enum {
+    AGG_NONE,   /**< No aggregate */
+    AGG_SUM,    /**< Sum of the numeric cells */
+    AGG_MIN,    /**< Smallest numeric cell */
+    AGG_MAX,    /**< Largest numeric cell */
+    AGG_MEAN,   /**< Mean of the numeric cells */
+    AGG_COUNT   /**< Number of numeric cells */
+} aggregate_t;
+
 /**
  * Table title line style  
  */
@@ -68,35 +120,198 @@ typedef enum {
 typedef char* (*t_cell_cb)(int,int,void*);
 
 /**
- * Data structure that represents one cell in the table
+ * Function that is given the output of utable_stroke_cb()
+ */
+typedef int (*t_write_cb)(const char*,size_t,void*);
+
+/**
+ * Data structure that represents one cell in the table. Cells are kept as
+ * small as possible since there is one for every position in the table.
+ * Alignment, padding and callbacks are kept on table and column level (see
+ * tfmt_t) and only cells that differ from their column have an entry in the
+ * table override map.
  */
 typedef struct {
-    t_cell_cb cb;       //!< Cell callback as an alternative way to set the text
-    char *t;            //!< A pointer to the text in te cell
-    halign_t halign;    //!<  What horizontal alignment to use for text
-    int pRow, pCol;     //!<  Parent row and column
-    _Bool merged;       //!<  Is this cell part of a merged cell
-    size_t rspan;       //!<  How many rows this cell spans
-    size_t cspan;       //!<  How many columns thi cell spans (not used)
-    size_t lpad, rpad;  //!<  Left and right padding
+    char *t;            //!< A pointer to the text in the cell
+    unsigned int len;   //!< Length of the text in bytes
+    unsigned int flags; //!< Internal cell state flags
 } tcell_t;
 
+/**
+ * Formatting attributes for a cell. A format exists on table, column and cell
+ * level. Each attribute has a stamp taken from a table wide sequence counter
+ * when it is set and the effective value for a cell is the one with the
+ * highest stamp. A stamp of 0 means the attribute is not set on that level.
+ */
+typedef struct {
+    t_cell_cb cb;           //!< Cell callback as an alternative way to set the text
+    halign_t halign;        //!< What horizontal alignment to use for text
+    size_t lpad, rpad;      //!< Left and right padding
+    unsigned long seq_cb, seq_halign, seq_pad; //!< Stamps for each attribute
+} tfmt_t;
+
+/**
+ * Entry in the sparse per-cell override map
+ */
+typedef struct {
+    size_t key;         //!< Cell index + 1, a key of 0 marks an empty slot
+    size_t cspan;       //!< How many columns this cell spans
+    size_t rspan;       //!< How many rows this cell spans
+    tfmt_t fmt;         //!< Cell specific format
+} tovr_t;
+
+/**
+ * Entry in the span index. A cell that spans several rows has one entry for
+ * each row it covers. The entries are sorted by row and column so the spans
+ * of a row are found with a binary search.
+ */
+typedef struct {
+    size_t row;         //!< Row covered by the span
+    size_t col;         //!< First column of the span
+    size_t cspan;       //!< How many columns the span covers
+    size_t owner;       //!< Row of the cell that spans, i.e. the first row
+} tspan_t;
+
+/**
+ * Footer of one column. The numeric value of each cell is parsed once and
+ * kept until a cell in the column changes.
+ */
+typedef struct {
+    aggregate_t agg;    //!< Aggregate to draw
+    char *fmt;          //!< printf() format for the aggregate value
+    char *label;        //!< Text drawn when the column has no aggregate
+    double *val;        //!< Value of each cell, NaN for cells that are not numbers
+    _Bool dirty;        //!< A cell has changed since the values were parsed
+    _Bool reduced;      //!< The totals below are valid for all rows
+    double sum, min, max;   //!< Totals over all rows
+    size_t count;       //!< Number of numeric cells in all rows
+} tagg_t;
+
+/**
+ * Statistics collected while stroking a table. Collection is off by default
+ * and enabled per table with utable_enable_stats(). All times are in
+ * nanoseconds and accumulate over all strokes since the last reset.
+ */
+typedef struct {
+    unsigned long long strokes;         //!< Number of strokes
+    unsigned long long ns_callbacks;    //!< Time spent running cell callbacks
+    unsigned long long ns_autowidth;    //!< Time spent computing column widths
+    unsigned long long ns_title;        //!< Time spent drawing the title
+    unsigned long long ns_rows;         //!< Time spent drawing cell rows
+    unsigned long long ns_borders;      //!< Time spent drawing border lines
+    unsigned long long ns_output;       //!< Time spent in write(), overlaps the drawing phases
+    unsigned long long callbacks;       //!< Number of callback invocations
+    unsigned long long bytes;           //!< Number of bytes emitted
+    unsigned long long truncated;       //!< Number of cells truncated to fit
+    unsigned long long allocs;          //!< Number of heap allocations
+} utable_stats_t;
+
+/**
+ * Memory used by a table broken down by category. All sizes are in bytes and
+ * count the requested allocation sizes, i.e. without any allocator overhead.
+ */
+typedef struct {
+    size_t table;       //!< The table structure and statistics
+    size_t cells;       //!< The cells, the row directory and the chunk directory of snapshots
+    size_t columns;     //!< Column widths and column formats
+    size_t overrides;   //!< The cell override map and the span index
+    size_t texts;       //!< Cell texts
+    size_t title;       //!< The table title
+    size_t mapped;      //!< File mapped by utable_load()
+    size_t index;       //!< Row order after sorting
+    size_t footer;      //!< Column aggregates and parsed values
+    size_t total;       //!< Sum of all categories
+} utable_mem_t;
+
 /**
  * Data structure that represents the table
  */
 typedef struct {
     void *tag;          //!< Arbitrary pointer to a "tag" used to identify the table in callbacks
     size_t nRow, nCol;  //!< Number of rows and columns in the table
-    tcell_t *c;         //!< Pointer to the data matrix
+    tcell_t *c;         //!< Block with the cells of the rows the table was made with
+    tcell_t **row;      //!< Cells of each row, in the block or allocated on their own
+    size_t rowCap;      //!< Number of entries allocated in the row directory
+    size_t blockRows;   //!< Number of rows the block has room for
+    size_t looseRows;   //!< Number of rows allocated on their own
     size_t *colwidth;   //!< A vector with comuted or forced column widths
     size_t *mincolwidth;    //!< The set minimum column width
-    char *title;        //!< Title of the table
-    _Bool titleCopied;  //!< State variables to indicate if the title has been allocated
+    tfmt_t deffmt;      //!< Table wide default format
+    tfmt_t *colfmt;     //!< A vector with the format for each column
+    tovr_t *ovr;        //!< Open addressed map with cell overrides
+    size_t ovrSize, ovrUsed;    //!< Number of slots and used slots in the override map
+    unsigned long fmtSeq;   //!< Last stamp handed out to a format attribute
+    unsigned long editGen;  //!< Bumped when rows or columns are inserted or deleted
+    _Bool haveCb;       //!< Has any cell callback been set
+    _Bool haveSpan;     //!< Has any cell been set to span columns or rows
+    tspan_t *span;      //!< Span index, NULL until it is needed after a span has changed
+    size_t nSpan;       //!< Number of entries in the span index
+    utable_stats_t *stats;  //!< Stroke statistics, NULL when not enabled
+    size_t textBytes;   //!< Bytes allocated for cell texts
+    char *block;        //!< Texts set by utable_set_n() in one allocation
+    size_t blockLen;    //!< Size of the text block
+    void *extmem;       //!< File mapped by utable_load(), referenced by cells
+    size_t extlen;      //!< Length of the mapped file
+    size_t *rowmap;     //!< Storage row drawn at each position, NULL if not sorted
+    tagg_t *agg;        //!< Footer of each column, NULL if no footer has been set
+    struct tchunk **chunks; //!< Shared copy of each chunk of rows made by the last snapshot
+    unsigned char *chunkDirty;  //!< Chunks with a row changed since the last snapshot
+    size_t snapRefs;    //!< References to a snapshot, 0 if the table is not a snapshot
+    char *title;        //!< Title of the table, drawn above the cells
     titlestyle_t titleStyle;    //!< Style of line or not under the title
     _Bool interior_v, interior_h;   //!< Should the interior lines in the table be shown
     _Bool headerLine;   //!<  Should the header line be added
+    _Bool noKernel;     //!< Draw all rows with the generic code, see utable_set_fast_render()
 } table_t;
 
+/**
+ * A view of a subset of the rows and columns in a table. The view only holds
+ * the row and column indices and its own column widths, the cells are always
+ * read from the base table so the base table must not be freed before the
+ * view. In a transposed view the row map holds columns and the column map
+ * holds rows of the base table. A view can not be stroked after rows or
+ * columns have been inserted in or deleted from the base table.
+ */
+typedef struct {
+    table_t *base;      //!< Table the view refers to
+    size_t nRow, nCol;  //!< Number of rows and columns in the view
+    size_t *rows;       //!< Row in the base table drawn at each position, NULL for all
+    size_t *cols;       //!< Column in the base table drawn at each position, NULL for all
+    _Bool transposed;   //!< Base rows are drawn as columns and base columns as rows
+    size_t *setwidth;   //!< Column widths set on the view, 0 for automatic
+    size_t *colwidth;   //!< Column widths used when the view was last stroked
+    unsigned long gen;  //!< Edit generation of the base table when the view was made
+} tview_t;
+
+/**
+ * State of a resumable stroke, see utable_stroke_begin()
+ */
+typedef struct tstroke tstroke_t;
+
+/**
+ * State of a table drawn as its rows are added, see utable_stream_create()
+ */
+typedef struct tstream tstream_t;
+
+/**
+ * A slot where one thread publishes snapshots of a table and other threads
+ * acquire the latest one without any locks
+ */
+typedef struct {
+    table_t *cur;       //!< Latest published snapshot, NULL before the first
+    size_t epoch;       //!< Advanced when the readers of the epoch before have left
+    size_t readers[2];  //!< Number of readers acquiring a snapshot in even and odd epochs
+    table_t **retired[2];   //!< Snapshots replaced in even and odd epochs, not yet released
+    size_t nRetired[2], retiredSize[2]; //!< Number of used and allocated retired entries
+} tpub_t;
+
+/**
+ * Type for the row predicate used to select the rows in a view. The
+ * predicate is called with the table, the row and the user argument and
+ * returns TRUE for the rows to include in the view.
+ */
+typedef _Bool (*t_row_pred)(table_t*,size_t,void*);
+
 typedef void (*t_log_func)(int,char*);
 
 void
@@ -105,6 +320,9 @@ utable_set_logfunc(t_log_func f, int loglevel, char *prefix);
 int
 utable_set_cell_colspan(table_t *t, size_t row, size_t col, size_t cspan);
 
+int
+utable_set_cell_rowspan(table_t *t, size_t row, size_t col, size_t rspan);
+
 int
 utable_set_cell_halign(table_t *t, int row, int col, halign_t halign);
 
@@ -123,9 +341,20 @@ utable_set_table_cellpadding(table_t *t, size_t lpad, size_t rpad);
 int
 utable_set_table_halign(table_t *t, halign_t halign);
 
+char *
+utable_get_cell(table_t *t, int row, int col);
+
 int
 utable_set_cell(table_t *t, size_t row, size_t col, char *txt);
 
+int
+utable_set_cell_n(table_t *t, size_t row, size_t col, const char *val,
+                  size_t len);
+
+int
+utable_set_cell_ref(table_t *t, size_t row, size_t col, const char *val,
+                    size_t len);
+
 int
 utable_set_row_halign(table_t *t, int row, halign_t halign);
 
@@ -156,9 +385,29 @@ utable_set_table_colwidth(table_t *t, size_t width);
 int
 utable_set(table_t *t, char *data[]);
 
+int
+utable_set_n(table_t *t, const char *const data[], const size_t len[],
+             dataorder_t order);
+
+table_t *
+utable_create_set_n(size_t nRow, size_t nCol, const char *const data[],
+                    const size_t len[], dataorder_t order);
+
 void
 utable_free(table_t *t);
 
+int
+utable_insert_rows(table_t *t, size_t at, size_t n);
+
+int
+utable_delete_rows(table_t *t, size_t at, size_t n);
+
+int
+utable_insert_cols(table_t *t, size_t at, size_t n);
+
+int
+utable_delete_cols(table_t *t, size_t at, size_t n);
+
 void
 utable_set_interior(table_t *t, _Bool v, _Bool h);
 
@@ -168,9 +417,77 @@ utable_stroke_stdout(table_t *t, tblstyle_t style);
 int
 utable_stroke(table_t *t, int fd, tblstyle_t style);
 
+int
+utable_stroke_count(table_t *t, int fd, tblstyle_t style, size_t *written);
+
 int
 utable_strstroke(table_t *t, char *dets, size_t maxlen, tblstyle_t style);
 
+int
+utable_stroke_cb(table_t *t, t_write_cb cb, void *ctx, tblstyle_t style);
+
+int
+utable_stroke_file(table_t *t, const char *path, tblstyle_t style);
+
+int
+utable_stroke_window(table_t *t, int fd, tblstyle_t style, size_t xoff,
+                     size_t width);
+
+tstroke_t *
+utable_stroke_begin(table_t *t, int fd, tblstyle_t style);
+
+tstroke_t *
+utable_view_stroke_begin(tview_t *v, int fd, tblstyle_t style);
+
+int
+utable_stroke_continue(tstroke_t *st);
+
+size_t
+utable_stroke_written(const tstroke_t *st);
+
+void
+utable_stroke_end(tstroke_t *st);
+
+tstream_t *
+utable_stream_create(size_t nCol, size_t lookahead, tblstyle_t style);
+
+table_t *
+utable_stream_table(tstream_t *ts);
+
+int
+utable_stream_row(tstream_t *ts, const char *const txt[], const size_t len[]);
+
+int
+utable_stream_end(tstream_t *ts);
+
+const char *
+utable_stream_pending(const tstream_t *ts, size_t *len);
+
+void
+utable_stream_consume(tstream_t *ts, size_t n);
+
+void
+utable_stream_free(tstream_t *ts);
+
+table_t *
+utable_load(const char *path, exportfmt_t fmt, int nthreads);
+
+int
+utable_sort_by_col(table_t *t, const sortkey_t keys[], size_t nkeys,
+                   size_t nhdr);
+
+void
+utable_unsort(table_t *t);
+
+int
+utable_export(table_t *t, int fd, exportfmt_t fmt);
+
+int
+utable_export_count(table_t *t, int fd, exportfmt_t fmt, size_t *written);
+
+int
+utable_strexport(table_t *t, char *buff, size_t bufflen, exportfmt_t fmt);
+
 void
 utable_set_title(table_t *t, char *title, titlestyle_t style);
 
@@ -180,15 +497,99 @@ utable_set_headerline(table_t *t, _Bool headerLine);
 void
 utable_set_padding_policy(_Bool cutInPadding);
 
+void
+utable_set_fast_render(table_t *t, _Bool enable);
+
 int
 utable_set_cellcallback(table_t *t, int row, int col, t_cell_cb cb);
 
+int
+utable_set_col_cellcallback(table_t *t, int col, t_cell_cb cb);
+
 void
 utable_set_table_cellcallback(table_t *t, t_cell_cb cb);
 
 int
 utable_set_coltitles(table_t *t, char *titles[]);
 
+tview_t *
+utable_view_create(table_t *t, t_row_pred pred, void *arg, size_t nhdr);
+
+tview_t *
+utable_view_create_rows(table_t *t, const size_t rows[], size_t n);
+
+tview_t *
+utable_view_top(table_t *t, const sortkey_t *key, size_t n, size_t nhdr);
+
+void
+utable_view_free(tview_t *v);
+
+int
+utable_view_set_colwidth(tview_t *v, size_t col, size_t width);
+
+int
+utable_view_set_cols(tview_t *v, const size_t cols[], size_t n);
+
+int
+utable_view_transpose(tview_t *v);
+
+int
+utable_view_stroke(tview_t *v, int fd, tblstyle_t style);
+
+int
+utable_view_stroke_file(tview_t *v, const char *path, tblstyle_t style);
+
+int
+utable_view_stroke_window(tview_t *v, int fd, tblstyle_t style, size_t xoff,
+                          size_t width);
+
+int
+utable_view_stroke_cb(tview_t *v, t_write_cb cb, void *ctx, tblstyle_t style);
+
+int
+utable_view_strstroke(tview_t *v, char *buff, size_t bufflen,
+                      tblstyle_t style);
+
+int
+utable_set_col_aggregate(table_t *t, size_t col, aggregate_t agg,
+                         const char *fmt);
+
+int
+utable_set_footer_label(table_t *t, size_t col, const char *label);
+
+table_t *
+utable_snapshot(table_t *t);
+
+void
+utable_snapshot_release(table_t *s);
+
+tpub_t *
+utable_pub_create(void);
+
+void
+utable_pub_free(tpub_t *p);
+
+int
+utable_pub_publish(tpub_t *p, table_t *t);
+
+table_t *
+utable_pub_acquire(tpub_t *p);
+
+int
+utable_enable_stats(table_t *t, _Bool enable);
+
+int
+utable_get_stats(table_t *t, utable_stats_t *stats);
+
+void
+utable_reset_stats(table_t *t);
+
+void
+utable_memory_usage(table_t *t, utable_mem_t *mem);
+
+void
+utable_memory_global(size_t *tables, size_t *bytes);
+
 #ifdef	__cplusplus
 }
 #endif
@@ -0,0 +1,665 @@
+/* =========================================================================
+ * File:        unitable.hpp
+ * Description: C++17 wrapper for the table library. The table is owned by
+ *              a Table object and texts are given as string views with an
+ *              explicit length. Tables can also be made directly from ranges
+ *              of tuples or structs.
+ * Author:      Johan Persson (johan162@gmail.com)
+ *
+ * Copyright (C) 2021 Johan Persson
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>
+ * =========================================================================
+ */
+
+#ifndef UNITABLE_HPP
+#define UNITABLE_HPP
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <ctime>
+#include <exception>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
+#include "unicode_tbl.h"
+
+namespace unitable {
+
+/**
+ * Error thrown when the library reports a failure
+ */
+class error : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+/**
+ * A table that owns a table_t and frees it when destroyed. A Table can be
+ * moved but not copied. Texts are given as string views with the length so
+ * the library never has to look for the terminator, and a std::string that
+ * is moved in is kept by the Table and referenced by the cell instead of
+ * being copied.
+ */
+class Table {
+public:
+    /**
+     * Create a table
+     * @param rows Number of rows
+     * @param cols Number of columns
+     */
+    Table(std::size_t rows, std::size_t cols) : t_(utable_create(rows, cols)) {
+        if (nullptr == t_) throw error("Cannot create table");
+    }
+
+    /**
+     * Take over a table created with the C API, e.g. by utable_load()
+     * @param t Table pointer, must not be NULL
+     */
+    explicit Table(table_t *t) : t_(t) {
+        if (nullptr == t_) throw error("Cannot take over a NULL table");
+    }
+
+    Table(Table &&o) noexcept
+            : t_(std::exchange(o.t_, nullptr)), owned_(std::move(o.owned_)) {}
+
+    Table &operator=(Table &&o) noexcept {
+        if (this != &o) {
+            reset();
+            t_ = std::exchange(o.t_, nullptr);
+            owned_ = std::move(o.owned_);
+        }
+        return *this;
+    }
+
+    Table(const Table &) = delete;
+    Table &operator=(const Table &) = delete;
+
+    ~Table() { reset(); }
+
+    /**
+     * Get the table for use with the C API
+     * @return Table pointer
+     */
+    table_t *get() const noexcept { return t_; }
+
+    std::size_t rows() const noexcept { return t_->nRow; }
+    std::size_t cols() const noexcept { return t_->nCol; }
+
+    /**
+     * Set the text in a cell. The text is copied.
+     * @param r Row
+     * @param c Column
+     * @param txt Text
+     * @return The table
+     */
+    Table &set(std::size_t r, std::size_t c, std::string_view txt) {
+        check(r, c);
+        const char *old = t_->row[r][c].t;
+        if (utable_set_cell_n(t_, r, c, txt.data(), txt.size()))
+            throw error("Cannot set cell");
+        drop(old);
+        return *this;
+    }
+
+    Table &set(std::size_t r, std::size_t c, const char *txt) {
+        return set(r, c, std::string_view(txt));
+    }
+
+    /**
+     * Set the text in a cell from a string that is moved into the table.
+     * The table keeps the string and the cell references its buffer, so
+     * the text is not copied. The string is released when the cell is set
+     * again through the Table, and otherwise when the Table is destroyed.
+     * Rows and columns may be inserted and deleted with the C API since the
+     * string follows the cell.
+     * @param r Row
+     * @param c Column
+     * @param txt Text
+     * @return The table
+     */
+    Table &set(std::size_t r, std::size_t c, std::string &&txt) {
+        check(r, c);
+        const char *old = t_->row[r][c].t;
+        auto s = std::make_unique<std::string>(std::move(txt));
+        const char *key = s->data();
+        const auto it = owned_.emplace(key, std::move(s)).first;
+        if (utable_set_cell_ref(t_, r, c, it->first, it->second->size())) {
+            owned_.erase(it);
+            throw error("Cannot set cell");
+        }
+        drop(old);
+        return *this;
+    }
+
+    /**
+     * Set the cells in a row from a range, starting at a column. The
+     * elements can be anything a cell can be set from. The strings in a
+     * range that is given as an rvalue are moved into the table.
+     * @param r Row
+     * @param cells Range of texts
+     * @param c First column to set
+     * @return The table
+     */
+    template <class Range>
+    Table &set_row(std::size_t r, Range &&cells, std::size_t c = 0) {
+        for (auto &&x : cells) set(r, c++, forward_elem<Range>(x));
+        return *this;
+    }
+
+    /**
+     * Set the cells in a column from a range, starting at a row
+     * @param c Column
+     * @param cells Range of texts
+     * @param r First row to set
+     * @return The table
+     */
+    template <class Range>
+    Table &set_col(std::size_t c, Range &&cells, std::size_t r = 0) {
+        for (auto &&x : cells) set(r++, c, forward_elem<Range>(x));
+        return *this;
+    }
+
+    /**
+     * Set the cells in consecutive rows from a range of rows, starting at
+     * a row
+     * @param rows Range of ranges of texts
+     * @param r First row to set
+     * @return The table
+     */
+    template <class Range>
+    Table &set_rows(Range &&rows, std::size_t r = 0) {
+        for (auto &&row : rows) {
+            if constexpr (std::is_rvalue_reference_v<Range &&>)
+                set_row(r++, std::move(row));
+            else
+                set_row(r++, row);
+        }
+        return *this;
+    }
+
+    /**
+     * Get the text in a cell without copying it
+     * @param r Row
+     * @param c Column
+     * @return The text, empty for a cell without text
+     */
+    std::string_view cell(std::size_t r, std::size_t c) const {
+        check(r, c);
+        const tcell_t &cell = t_->row[r][c];
+        return cell.t ? std::string_view(cell.t, cell.len) : std::string_view();
+    }
+
+    Table &title(const std::string &title,
+                 titlestyle_t style = TITLESTYLE_LINE) {
+        utable_set_title(t_, const_cast<char *>(title.c_str()), style);
+        return *this;
+    }
+
+    Table &interior(bool v, bool h) {
+        utable_set_interior(t_, v, h);
+        return *this;
+    }
+
+    Table &headerline(bool on) {
+        utable_set_headerline(t_, on);
+        return *this;
+    }
+
+    Table &halign(std::size_t c, halign_t halign) {
+        if (utable_set_col_halign(t_, static_cast<int>(c), halign)) throw error("Cannot set alignment");
+        return *this;
+    }
+
+    Table &colspan(std::size_t r, std::size_t c, std::size_t span) {
+        if (utable_set_cell_colspan(t_, r, c, span)) throw error("Cannot set span");
+        return *this;
+    }
+
+    /**
+     * Let the library measure the width of all columns again, e.g. after
+     * cells in a table made by make_table() have been changed
+     * @return The table
+     */
+    Table &autowidth() {
+        utable_reset_table_colwidth(t_);
+        return *this;
+    }
+
+    /**
+     * Stroke the table to a file descriptor
+     * @param fd File descriptor
+     * @param style Table style
+     * @return Number of bytes written
+     */
+    std::size_t stroke(int fd, tblstyle_t style) const {
+        std::size_t n = 0;
+        if (utable_stroke_count(t_, fd, style, &n))
+            throw error("Cannot stroke table");
+        return n;
+    }
+
+    /**
+     * Stroke the table to a stream. The output is written to the stream as
+     * it is drawn.
+     * @param os Stream
+     * @param style Table style
+     */
+    void stroke(std::ostream &os, tblstyle_t style) const {
+        stroke_to(os, style);
+    }
+
+    /**
+     * Stroke the table to a string. The output is appended to the string as
+     * it is drawn.
+     * @param style Table style
+     * @return The table as a string
+     */
+    std::string str(tblstyle_t style) const {
+        std::string s;
+        stroke_to(s, style);
+        return s;
+    }
+
+private:
+    table_t *t_;
+    // Strings moved into the cells, by the address of their text which the
+    // cell keeps wherever it is moved
+    std::unordered_map<const char *, std::unique_ptr<std::string>> owned_;
+
+    void reset() noexcept {
+        if (t_) utable_free(t_);
+        t_ = nullptr;
+        owned_.clear();
+    }
+
+    void check(std::size_t r, std::size_t c) const {
+        if (r >= rows() || c >= cols()) throw std::out_of_range("No such cell");
+    }
+
+    // Release the string that was moved into a cell that now has another
+    // text
+    void drop(const char *old) noexcept {
+        if (old) owned_.erase(old);
+    }
+
+    template <class Range, class T>
+    static decltype(auto) forward_elem(T &x) {
+        if constexpr (std::is_rvalue_reference_v<Range &&> &&
+                      std::is_same_v<std::decay_t<T>, std::string>)
+            return std::move(x);
+        else
+            return static_cast<const T &>(x);
+    }
+
+    // Output target and the exception it threw, since an exception must not
+    // pass through the C library
+    template <class Out>
+    struct sink {
+        Out &out;
+        std::exception_ptr ex;
+    };
+
+    static void put(std::ostream &os, const char *p, std::size_t n) {
+        if (!os.write(p, n)) throw error("Cannot write to stream");
+    }
+
+    static void put(std::string &s, const char *p, std::size_t n) {
+        s.append(p, n);
+    }
+
+    template <class Out>
+    static int write_cb(const char *p, std::size_t n, void *ctx) {
+        auto *k = static_cast<sink<Out> *>(ctx);
+        try {
+            put(k->out, p, n);
+            return 0;
+        } catch (...) {
+            k->ex = std::current_exception();
+            return -1;
+        }
+    }
+
+    template <class Out>
+    void stroke_to(Out &out, tblstyle_t style) const {
+        sink<Out> k{out, nullptr};
+        const int ret = utable_stroke_cb(t_, write_cb<Out>, &k, style);
+        if (k.ex) std::rethrow_exception(k.ex);
+        if (ret) throw error("Cannot stroke table");
+    }
+};
+
+/**
+ * Size of the buffer a cell value is formatted into
+ */
+constexpr std::size_t cell_buf_size = 64;
+
+/**
+ * How a value of type T is written to a cell. Every specialization has
+ *
+ *   halign  Default alignment of a column of this type
+ *   ascii   True if the text is always ASCII, the width of the text is then
+ *           its length and it never has to be measured
+ *   format  Function that returns the text for a value. It may use the
+ *           buffer of cell_buf_size bytes it is given.
+ *
+ * Specialize it to put other types in tables made by make_table().
+ */
+template <class T, class = void>
+struct cell_traits;
+
+template <class T>
+struct cell_traits<T, std::enable_if_t<std::is_integral_v<T> &&
+                                       !std::is_same_v<T, bool>>> {
+    static constexpr halign_t halign = RIGHTALIGN;
+    static constexpr bool ascii = true;
+    static std::string_view format(T v, char *buf) {
+        return {buf, static_cast<std::size_t>(
+                std::to_chars(buf, buf + cell_buf_size, v).ptr - buf)};
+    }
+};
+
+template <class T>
+struct cell_traits<T, std::enable_if_t<std::is_floating_point_v<T>>> {
+    static constexpr halign_t halign = RIGHTALIGN;
+    static constexpr bool ascii = true;
+    static std::string_view format(T v, char *buf) {
+        return {buf, static_cast<std::size_t>(
+                std::to_chars(buf, buf + cell_buf_size, v).ptr - buf)};
+    }
+};
+
+template <>
+struct cell_traits<bool> {
+    static constexpr halign_t halign = LEFTALIGN;
+    static constexpr bool ascii = true;
+    static std::string_view format(bool v, char *) {
+        return v ? "true" : "false";
+    }
+};
+
+template <class T>
+struct cell_traits<T, std::enable_if_t<
+        std::is_convertible_v<const T &, std::string_view> &&
+        !std::is_pointer_v<T>>> {
+    static constexpr halign_t halign = LEFTALIGN;
+    static constexpr bool ascii = false;
+    static std::string_view format(const T &v, char *) {
+        return std::string_view(v);
+    }
+};
+
+template <class T>
+struct cell_traits<T, std::enable_if_t<
+        std::is_same_v<T, const char *> || std::is_same_v<T, char *>>> {
+    static constexpr halign_t halign = LEFTALIGN;
+    static constexpr bool ascii = false;
+    static std::string_view format(const char *v, char *) {
+        return v ? std::string_view(v) : std::string_view();
+    }
+};
+
+/**
+ * A duration is written as its count followed by the unit, e.g. "250ms".
+ * Durations in other units than the standard ones are written in seconds.
+ */
+template <class Rep, class Period>
+struct cell_traits<std::chrono::duration<Rep, Period>> {
+    static constexpr halign_t halign = RIGHTALIGN;
+    static constexpr bool ascii = true;
+    static std::string_view format(const std::chrono::duration<Rep, Period> &v,
+                                   char *buf) {
+        using namespace std::chrono;
+        if constexpr (std::is_same_v<Period, std::nano>)
+            return with_unit(v.count(), "ns", buf);
+        else if constexpr (std::is_same_v<Period, std::micro>)
+            return with_unit(v.count(), "us", buf);
+        else if constexpr (std::is_same_v<Period, std::milli>)
+            return with_unit(v.count(), "ms", buf);
+        else if constexpr (std::is_same_v<Period, std::ratio<1>>)
+            return with_unit(v.count(), "s", buf);
+        else if constexpr (std::is_same_v<Period, std::ratio<60>>)
+            return with_unit(v.count(), "min", buf);
+        else if constexpr (std::is_same_v<Period, std::ratio<3600>>)
+            return with_unit(v.count(), "h", buf);
+        else
+            return with_unit(duration<double>(v).count(), "s", buf);
+    }
+
+private:
+    template <class N>
+    static std::string_view with_unit(N n, const char *unit, char *buf) {
+        char *p = std::to_chars(buf, buf + cell_buf_size - 4, n).ptr;
+        const std::size_t len = std::strlen(unit);
+        std::memcpy(p, unit, len);
+        return {buf, static_cast<std::size_t>(p - buf) + len};
+    }
+};
+
+/**
+ * A point in time of the system clock is written as UTC, e.g.
+ * "2021-05-01 12:00:00"
+ */
+template <class Duration>
+struct cell_traits<std::chrono::time_point<std::chrono::system_clock, Duration>> {
+    static constexpr halign_t halign = LEFTALIGN;
+    static constexpr bool ascii = true;
+    static std::string_view format(
+            const std::chrono::time_point<std::chrono::system_clock, Duration> &v,
+            char *buf) {
+        using namespace std::chrono;
+        const std::time_t tt = system_clock::to_time_t(
+                time_point_cast<system_clock::duration>(v));
+        std::tm tm;
+        if (nullptr == gmtime_r(&tt, &tm)) return {};
+        return {buf, std::strftime(buf, cell_buf_size, "%Y-%m-%d %H:%M:%S", &tm)};
+    }
+};
+
+/**
+ * Column of a table made from a range of structs, see column()
+ */
+template <class Get>
+struct column_t {
+    std::string_view name;  // Header text
+    Get get;                // Member pointer or function that gives the value
+};
+
+/**
+ * Describe a column of a table made from a range of structs
+ * @param name Header text
+ * @param get Member pointer, or function that is called with a row and
+ *            returns the value of the column
+ * @return Column description for make_table()
+ */
+template <class Get>
+column_t<Get> column(std::string_view name, Get get) {
+    return {name, std::move(get)};
+}
+
+namespace detail {
+
+template <class T>
+using value_t = std::remove_cv_t<std::remove_reference_t<T>>;
+
+// Width of the widest text in each column with ASCII texts
+struct widths {
+    std::size_t *w;
+    bool *ascii;
+};
+
+template <class T>
+void put(table_t *t, std::size_t r, std::size_t c, const T &v, widths &wd) {
+    using traits = cell_traits<value_t<T>>;
+    char buf[cell_buf_size];
+    const std::string_view s = traits::format(v, buf);
+    if (utable_set_cell_n(t, r, c, s.data(), s.size()))
+        throw error("Cannot set cell");
+    if constexpr (traits::ascii) wd.w[c] = std::max(wd.w[c], s.size());
+}
+
+template <class T>
+constexpr bool is_ascii() {
+    return cell_traits<value_t<T>>::ascii;
+}
+
+template <class Range>
+std::size_t count(const Range &rows) {
+    return static_cast<std::size_t>(std::distance(std::begin(rows), std::end(rows)));
+}
+
+// Set the header and the alignment of each column, and find out which
+// columns only have ASCII texts
+template <class... V>
+void start(Table &tbl, const std::string_view *names, widths &wd) {
+    const halign_t halign[] = {cell_traits<value_t<V>>::halign...};
+    const bool ascii[] = {is_ascii<V>()...};
+    for (std::size_t c = 0; c < sizeof...(V); c++) {
+        tbl.halign(c, halign[c]);
+        wd.ascii[c] = ascii[c];
+        wd.w[c] = 0;
+        if (names) {
+            tbl.set(0, c, names[c]);
+            for (unsigned char ch : names[c]) {
+                if (ch & 0x80) wd.ascii[c] = false;
+            }
+            wd.w[c] = names[c].size();
+        }
+    }
+    if (names) tbl.headerline(true);
+}
+
+// The widths of the columns with ASCII texts are already known so set them
+// to spare the library from measuring every cell when the table is stroked
+inline void finish(Table &tbl, const widths &wd) {
+    const table_t *t = tbl.get();
+    for (std::size_t c = 0; c < tbl.cols(); c++) {
+        if (wd.ascii[c] && wd.w[c] > 0)
+            utable_set_colwidth(tbl.get(), c,
+                                wd.w[c] + t->deffmt.lpad + t->deffmt.rpad);
+    }
+}
+
+template <class Range, std::size_t... I>
+Table from_tuples(const Range &rows, const std::string_view *names,
+                  std::index_sequence<I...>) {
+    using row_t = value_t<decltype(*std::begin(rows))>;
+    constexpr std::size_t ncol = sizeof...(I);
+    static_assert(ncol > 0, "At least one column is needed");
+    const std::size_t hdr = names ? 1 : 0;
+    Table tbl(count(rows) + hdr, ncol);
+    std::array<std::size_t, ncol> w;
+    std::array<bool, ncol> ascii;
+    widths wd{w.data(), ascii.data()};
+    start<std::tuple_element_t<I, row_t>...>(tbl, names, wd);
+    std::size_t r = hdr;
+    for (const auto &row : rows) {
+        using std::get;
+        (put(tbl.get(), r, I, get<I>(row), wd), ...);
+        r++;
+    }
+    finish(tbl, wd);
+    return tbl;
+}
+
+template <class Range, class... Get, std::size_t... I>
+Table from_structs(const Range &rows, std::index_sequence<I...>,
+                   const column_t<Get> &...cols) {
+    using row_t = value_t<decltype(*std::begin(rows))>;
+    constexpr std::size_t ncol = sizeof...(Get);
+    Table tbl(count(rows) + 1, ncol);
+    const std::string_view names[] = {cols.name...};
+    std::array<std::size_t, ncol> w;
+    std::array<bool, ncol> ascii;
+    widths wd{w.data(), ascii.data()};
+    start<std::invoke_result_t<const Get &, const row_t &>...>(tbl, names, wd);
+    std::size_t r = 1;
+    for (const auto &row : rows) {
+        (put(tbl.get(), r, I, std::invoke(cols.get, row), wd), ...);
+        r++;
+    }
+    finish(tbl, wd);
+    return tbl;
+}
+
+}  // namespace detail
+
+/**
+ * Make a table from a range of tuples, pairs or arrays with one row for each
+ * element. The type of each column is known when the program is compiled so
+ * each value is formatted directly from its type, see cell_traits. Numbers
+ * are right aligned. The width of the columns where the text is always
+ * ASCII, e.g. numbers, is found while the table is made and is set as a fixed
+ * width, call Table::autowidth() if such cells are changed later on.
+ * @param rows Range of rows
+ * @return The table
+ */
+template <class Range>
+Table make_table(const Range &rows) {
+    using row_t = detail::value_t<decltype(*std::begin(rows))>;
+    return detail::from_tuples(rows, nullptr,
+            std::make_index_sequence<std::tuple_size_v<row_t>>());
+}
+
+/**
+ * Make a table from a range of tuples, pairs or arrays with a header row
+ * @param rows Range of rows
+ * @param header Text of the header of each column
+ * @return The table
+ */
+template <class Range>
+Table make_table(const Range &rows,
+                 std::initializer_list<std::string_view> header) {
+    using row_t = detail::value_t<decltype(*std::begin(rows))>;
+    constexpr std::size_t ncol = std::tuple_size_v<row_t>;
+    if (header.size() != ncol) throw error("Header does not match the columns");
+    return detail::from_tuples(rows, header.begin(),
+                               std::make_index_sequence<ncol>());
+}
+
+/**
+ * Make a table from a range of structs, or any other type, with a header row
+ * and one column for each column description, e.g.
+ *
+ *   make_table(files, column("Name", &file::name),
+ *                     column("Size", [](const file &f) { return f.size; }));
+ *
+ * @param rows Range of rows
+ * @param cols Column descriptions made with column()
+ * @return The table
+ */
+template <class Range, class... Get>
+Table make_table(const Range &rows, const column_t<Get> &...cols) {
+    static_assert(sizeof...(Get) > 0, "At least one column is needed");
+    return detail::from_structs(rows, std::index_sequence_for<Get...>(),
+                                cols...);
+}
+
+}  // namespace unitable
+
+#endif /* UNITABLE_HPP */
@@ -0,0 +1,401 @@
+/* =========================================================================
+ * File:        unitable_stream.hpp
+ * Description: C++20 interface to draw a table as its rows are produced,
+ *              e.g. by a generator, without keeping all the rows. The output
+ *              can be given to a stream or to an asynchronous sink that is
+ *              awaited for each row.
+ * Author:      Johan Persson (johan162@gmail.com)
+ *
+ * Copyright (C) 2021 Johan Persson
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>
+ * =========================================================================
+ */
+
+#ifndef UNITABLE_STREAM_HPP
+#define UNITABLE_STREAM_HPP
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+
+#include "unitable.hpp"
+
+namespace unitable {
+
+/**
+ * Coroutine that produces rows with co_yield, e.g.
+ *
+ *   generator<std::tuple<int, std::string>> query() {
+ *       while (...) co_yield {id, name};
+ *   }
+ *
+ * A yielded row is only valid until the next row is asked for, which is all
+ * a stream needs since the row is copied when it is added.
+ */
+template <class T>
+class generator {
+public:
+    struct promise_type {
+        const T *value = nullptr;
+        std::exception_ptr ex;
+
+        generator get_return_object() {
+            return generator(handle::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        std::suspend_always yield_value(const T &v) noexcept {
+            value = std::addressof(v);
+            return {};
+        }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { ex = std::current_exception(); }
+
+        // Rows are produced synchronously
+        template <class U>
+        std::suspend_never await_transform(U &&) = delete;
+    };
+
+    using handle = std::coroutine_handle<promise_type>;
+
+    class iterator {
+    public:
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+
+        explicit iterator(handle h) : h_(h) {}
+        const T &operator*() const { return *h_.promise().value; }
+        iterator &operator++() {
+            h_.resume();
+            rethrow(h_);
+            return *this;
+        }
+        void operator++(int) { ++*this; }
+        bool operator==(std::default_sentinel_t) const noexcept {
+            return h_.done();
+        }
+
+    private:
+        handle h_;
+    };
+
+    generator(generator &&o) noexcept : h_(std::exchange(o.h_, nullptr)) {}
+    generator &operator=(generator &&o) noexcept {
+        if (this != &o) {
+            if (h_) h_.destroy();
+            h_ = std::exchange(o.h_, nullptr);
+        }
+        return *this;
+    }
+    ~generator() {
+        if (h_) h_.destroy();
+    }
+
+    iterator begin() {
+        h_.resume();
+        rethrow(h_);
+        return iterator(h_);
+    }
+    std::default_sentinel_t end() const noexcept { return {}; }
+
+private:
+    handle h_;
+
+    explicit generator(handle h) : h_(h) {}
+
+    static void rethrow(handle h) {
+        if (h.promise().ex) std::rethrow_exception(std::exchange(h.promise().ex, nullptr));
+    }
+};
+
+/**
+ * Coroutine without a result that is started by awaiting it, or by start()
+ * from code that is not a coroutine. When it completes the coroutine that
+ * awaits it is resumed and an exception it threw is thrown there, or by
+ * get().
+ */
+class task {
+public:
+    struct promise_type {
+        std::coroutine_handle<> cont;
+        std::exception_ptr ex;
+
+        struct final_awaiter {
+            bool await_ready() const noexcept { return false; }
+            std::coroutine_handle<> await_suspend(
+                    std::coroutine_handle<promise_type> h) noexcept {
+                const std::coroutine_handle<> c = h.promise().cont;
+                return c ? c : std::noop_coroutine();
+            }
+            void await_resume() const noexcept {}
+        };
+
+        task get_return_object() {
+            return task(handle::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        final_awaiter final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { ex = std::current_exception(); }
+    };
+
+    using handle = std::coroutine_handle<promise_type>;
+
+    task(task &&o) noexcept : h_(std::exchange(o.h_, nullptr)) {}
+    task &operator=(task &&o) noexcept {
+        if (this != &o) {
+            if (h_) h_.destroy();
+            h_ = std::exchange(o.h_, nullptr);
+        }
+        return *this;
+    }
+    ~task() {
+        if (h_) h_.destroy();
+    }
+
+    auto operator co_await() noexcept {
+        struct awaiter {
+            handle h;
+            bool await_ready() const noexcept { return h.done(); }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> c) noexcept {
+                h.promise().cont = c;
+                return h;
+            }
+            void await_resume() const {
+                if (h.promise().ex) std::rethrow_exception(h.promise().ex);
+            }
+        };
+        return awaiter{h_};
+    }
+
+    /**
+     * Run the task until it first suspends
+     */
+    void start() { h_.resume(); }
+
+    /**
+     * Check if the task has completed
+     * @return True if it has completed
+     */
+    bool done() const noexcept { return h_.done(); }
+
+    /**
+     * Throw the exception from a completed task, if any
+     */
+    void get() const {
+        if (h_.promise().ex) std::rethrow_exception(h_.promise().ex);
+    }
+
+private:
+    handle h_;
+
+    explicit task(handle h) : h_(h) {}
+};
+
+namespace detail {
+
+template <class T>
+concept tuple_like = requires { std::tuple_size<T>::value; };
+
+}  // namespace detail
+
+/**
+ * A table that is drawn as its rows are added, see utable_stream_create().
+ * The column widths are fixed from the first rows, which are kept in a
+ * look-ahead window, and after that every row is drawn as soon as it is
+ * added. A row is a tuple, pair or array, or a range, and every value is
+ * written with its cell_traits. The output of each row can be taken with
+ * pending() and consume().
+ */
+class Stream {
+public:
+    /**
+     * Create a stream
+     * @param cols Number of columns
+     * @param lookahead Number of rows the column widths are fixed from
+     * @param style Table style
+     */
+    Stream(std::size_t cols, std::size_t lookahead, tblstyle_t style)
+            : ts_(utable_stream_create(cols, lookahead, style)), cols_(cols),
+              buf_(std::make_unique<char[]>(cols * cell_buf_size)),
+              txt_(std::make_unique<const char *[]>(cols)),
+              len_(std::make_unique<std::size_t[]>(cols)) {
+        if (nullptr == ts_) throw error("Cannot create stream");
+    }
+
+    Stream(Stream &&o) noexcept
+            : ts_(std::exchange(o.ts_, nullptr)), cols_(o.cols_),
+              buf_(std::move(o.buf_)), txt_(std::move(o.txt_)),
+              len_(std::move(o.len_)) {}
+
+    Stream(const Stream &) = delete;
+    Stream &operator=(const Stream &) = delete;
+    Stream &operator=(Stream &&) = delete;
+
+    ~Stream() { utable_stream_free(ts_); }
+
+    /**
+     * Get the table that holds the formats of the stream
+     * @return Table pointer
+     */
+    table_t *table() const noexcept { return utable_stream_table(ts_); }
+
+    std::size_t cols() const noexcept { return cols_; }
+
+    Stream &title(const std::string &title,
+                  titlestyle_t style = TITLESTYLE_LINE) {
+        utable_set_title(table(), const_cast<char *>(title.c_str()), style);
+        return *this;
+    }
+
+    Stream &interior(bool v, bool h) {
+        utable_set_interior(table(), v, h);
+        return *this;
+    }
+
+    Stream &headerline(bool on) {
+        utable_set_headerline(table(), on);
+        return *this;
+    }
+
+    Stream &halign(std::size_t c, halign_t halign) {
+        if (utable_set_col_halign(table(), static_cast<int>(c), halign))
+            throw error("Cannot set alignment");
+        return *this;
+    }
+
+    /**
+     * Add a row
+     * @param row Tuple, pair, array or range with one value per column
+     */
+    template <class Row>
+    void push(const Row &row) {
+        std::size_t c = 0;
+        if constexpr (detail::tuple_like<Row>) {
+            if (std::tuple_size_v<Row> != cols_)
+                throw error("Row does not match the columns");
+            std::apply([&](const auto &...v) { (put(c++, v), ...); }, row);
+        } else {
+            for (const auto &v : row) {
+                if (c == cols_) throw error("Row does not match the columns");
+                put(c++, v);
+            }
+            if (c != cols_) throw error("Row does not match the columns");
+        }
+        if (utable_stream_row(ts_, txt_.get(), len_.get()))
+            throw error("Cannot draw row");
+    }
+
+    /**
+     * End the stream, the rest of the table is drawn
+     */
+    void end() {
+        if (utable_stream_end(ts_)) throw error("Cannot draw table");
+    }
+
+    /**
+     * Get the output that has not been taken. It is valid until the next
+     * call to push() or end().
+     * @return Output
+     */
+    std::string_view pending() const noexcept {
+        std::size_t len;
+        const char *p = utable_stream_pending(ts_, &len);
+        return {p, len};
+    }
+
+    /**
+     * Take output from the start of the pending output
+     * @param n Number of bytes
+     */
+    void consume(std::size_t n) noexcept { utable_stream_consume(ts_, n); }
+
+private:
+    tstream_t *ts_;
+    std::size_t cols_;
+    std::unique_ptr<char[]> buf_;           // Formatted values of a row
+    std::unique_ptr<const char *[]> txt_;   // Text of each column of a row
+    std::unique_ptr<std::size_t[]> len_;    // Length of each text
+
+    template <class T>
+    void put(std::size_t c, const T &v) {
+        const std::string_view s =
+                cell_traits<detail::value_t<T>>::format(v, buf_.get() + c * cell_buf_size);
+        txt_[c] = s.data();
+        len_[c] = s.size();
+    }
+};
+
+/**
+ * Draw the rows from a generator, or any other range of rows, to an output
+ * stream. Each row is written as soon as it is drawn.
+ * @param st Stream with the formats set
+ * @param rows Range of rows
+ * @param os Output stream
+ */
+template <class Rows>
+void render(Stream &st, Rows &&rows, std::ostream &os) {
+    auto drain = [&] {
+        const std::string_view p = st.pending();
+        if (!os.write(p.data(), p.size())) throw error("Cannot write to stream");
+        st.consume(p.size());
+    };
+    for (const auto &row : rows) {
+        st.push(row);
+        drain();
+    }
+    st.end();
+    drain();
+}
+
+/**
+ * Draw the rows from a generator, or any other range of rows, to an
+ * asynchronous sink. The sink has a member write(std::string_view) that
+ * returns an awaitable which completes when all the bytes are written, and
+ * the output of each row is awaited before the next row is asked for. The
+ * range is kept by the coroutine, so a container should be moved in or be
+ * given as a view.
+ * @param st Stream with the formats set, it must be kept until the task
+ *           completes
+ * @param rows Range of rows
+ * @param sink Output
+ * @return Task that draws the table when it is awaited or started
+ */
+template <class Rows, class Sink>
+task render_async(Stream &st, Rows rows, Sink &sink) {
+    for (const auto &row : rows) {
+        st.push(row);
+        for (std::string_view p = st.pending(); !p.empty(); p = st.pending()) {
+            co_await sink.write(p);
+            st.consume(p.size());
+        }
+    }
+    st.end();
+    for (std::string_view p = st.pending(); !p.empty(); p = st.pending()) {
+        co_await sink.write(p);
+        st.consume(p.size());
+    }
+}
+
+}  // namespace unitable
+
+#endif /* UNITABLE_STREAM_HPP */
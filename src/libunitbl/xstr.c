@@ -116,4 +116,182 @@ size_t utf8len(const char *s) {
     return len;
 }
 
+// Two stage display width table generated by bldscripts/gen_uniwidth.py
+extern const unsigned char uw_stage1[];
+extern const unsigned char uw_stage2[][64];
+
+// Inlined table lookup used by the string functions below
+static inline int
+_xwc_width(unsigned int cp) {
+    if (cp >= 0x110000) return 1;
+    const unsigned char b = uw_stage2[uw_stage1[cp >> 8]][(cp & 0xff) >> 2];
+    return (b >> ((cp & 3) << 1)) & 3;
+}
+
+/**
+ * Get the display width (number of terminal columns) of a Unicode code point
+ * @param cp Code point
+ * @return 0 for combining and zero width characters, 2 for East Asian wide
+ * and fullwidth characters and 1 otherwise
+ */
+int
+xwc_width(unsigned int cp) {
+    return _xwc_width(cp);
+}
+
+/**
+ * Decode one UTF8 sequence. Malformed sequences are consumed one byte at a
+ * time and decoded as a code point with width 1.
+ * @param s Pointer to the start of the sequence
+ * @param n Number of bytes available
+ * @param cp Decoded code point
+ * @return Number of bytes consumed
+ */
+static inline size_t
+_xmb_decode(const unsigned char *s, size_t n, unsigned int *cp) {
+    const unsigned char c = s[0];
+    size_t len;
+    if (c < 0xc0) {
+        *cp = c < 0x80 ? c : 0xfffd;
+        return 1;
+    } else if (c < 0xe0) {
+        len = 2;
+        *cp = c & 0x1f;
+    } else if (c < 0xf0) {
+        len = 3;
+        *cp = c & 0x0f;
+    } else {
+        len = 4;
+        *cp = c & 0x07;
+    }
+    if (len > n) {
+        *cp = 0xfffd;
+        return 1;
+    }
+    for (size_t i = 1; i < len; i++) {
+        if ((s[i] & 0xc0) != 0x80) {
+            *cp = 0xfffd;
+            return 1;
+        }
+        *cp = (*cp << 6) | (s[i] & 0x3f);
+    }
+    return len;
+}
+
+/**
+ * Length of the leading run of ASCII characters in a buffer. This is the fast
+ * path for the display width functions and checks eight bytes at a time.
+ * @param s Buffer
+ * @param n Number of bytes in buffer
+ * @return Number of leading ASCII bytes
+ */
+static inline size_t
+_xmb_ascii_prefix(const unsigned char *s, size_t n) {
+    size_t i = 0;
+    while (i + 8 <= n) {
+        unsigned long long w;
+        memcpy(&w, s + i, 8);
+        if (w & 0x8080808080808080ULL) break;
+        i += 8;
+    }
+    while (i < n && s[i] < 0x80) i++;
+    return i;
+}
+
+/**
+ * Find the display width (number of terminal columns) of the first "n" bytes
+ * of a UTF8 string. This takes East Asian wide characters and zero width
+ * characters such as combining marks into account. ASCII characters are
+ * always counted as one column.
+ * @param s String buffer
+ * @param n Number of bytes
+ * @return Display width
+ */
+size_t
+xmb_width_n(const char *s, size_t n) {
+    if (NULL == s) return 0;
+    const unsigned char *p = (const unsigned char *)s;
+    size_t width = 0, i = 0;
+    while (i < n) {
+        if (p[i] < 0x80) {
+            const size_t a = _xmb_ascii_prefix(p + i, n - i);
+            width += a;
+            i += a;
+            continue;
+        }
+        unsigned int cp;
+        i += _xmb_decode(p + i, n - i, &cp);
+        width += _xwc_width(cp);
+    }
+    return width;
+}
+
+/**
+ * Find the display width (number of terminal columns) of a NULL terminated
+ * UTF8 string. See xmb_width_n()
+ * @param s String
+ * @return Display width
+ */
+size_t
+xmb_width(const char *s) {
+    if (NULL == s) return 0;
+    return xmb_width_n(s, strlen(s));
+}
+
+/**
+ * Find the byte offset of the longest prefix of the first "n" bytes of a UTF8
+ * string that fits in "cols" display columns. Zero width characters that
+ * follow the last character that fits are included in the prefix so that
+ * combining marks stay with their base character. A wide character that
+ * would straddle the limit is not included.
+ * @param s String buffer
+ * @param n Number of bytes
+ * @param cols Maximum display width
+ * @param width If not NULL set to the display width of the prefix
+ * @return Byte offset
+ */
+size_t
+xmb_dispoffset_n(const char *s, size_t n, size_t cols, size_t *width) {
+    const unsigned char *p = (const unsigned char *)s;
+    size_t w = 0, i = 0;
+    if (NULL == s) n = 0;
+    while (i < n) {
+        size_t a = _xmb_ascii_prefix(p + i, n - i);
+        if (w + a >= cols) {
+            // ASCII run reaches the limit. Only continue if the limit is
+            // reached exactly at the end of the buffer or a combining
+            // character could follow.
+            i += cols - w;
+            w = cols;
+            if (i < n && p[i] < 0x80) break;
+            a = 0;
+        }
+        w += a;
+        i += a;
+        if (i >= n) break;
+        unsigned int cp;
+        const size_t l = _xmb_decode(p + i, n - i, &cp);
+        const size_t cw = _xwc_width(cp);
+        if (w + cw > cols) break;
+        w += cw;
+        i += l;
+    }
+    if (width) *width = w;
+    return i;
+}
+
+/**
+ * Find the byte offset of the longest prefix of a NULL terminated string that
+ * fits in "cols" display columns. This is the display width aware version of
+ * xmb_offset(). See xmb_dispoffset_n()
+ * @param s String
+ * @param cols Maximum display width
+ * @return Byte offset
+ */
+size_t
+xmb_dispoffset(const char *s, int cols) {
+    if (NULL == s || cols <= 0) return 0;
+    return xmb_dispoffset_n(s, strlen(s), cols, NULL);
+}
+
 /* EOF */
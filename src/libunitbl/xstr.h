@@ -37,6 +37,16 @@ size_t xmb_offset(const char *s, int charnum);
 
 size_t utf8len(const char *s);
 
+int xwc_width(unsigned int cp);
+
+size_t xmb_width(const char *s);
+
+size_t xmb_width_n(const char *s, size_t n);
+
+size_t xmb_dispoffset(const char *s, int cols);
+
+size_t xmb_dispoffset_n(const char *s, size_t n, size_t cols, size_t *width);
+
 
 #ifdef	__cplusplus
 }
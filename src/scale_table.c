@@ -0,0 +1,262 @@
+// We want the full POSIX and C99 standard
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "libunitbl/unicode_tbl.h"
+
+/*
+ * Scaling test for stroking tables. For a number of table shapes a table is
+ * built and stroked at sizes from 10^2 to 10^6 cells. Each size is run in a
+ * child process of its own so the peak RSS can be measured with getrusage().
+ *
+ * Rendering should be linear in the size of the output so for every shape
+ * the time per output byte and the peak RSS per output byte must stay within
+ * a tolerance factor of the best size. The exit status is non zero if any
+ * shape is outside the tolerance, so a complexity regression in the stroke
+ * path is caught automatically by "make scale-test".
+ */
+
+typedef struct {
+  char *name;           // Name of the shape
+  size_t (*rows)(size_t cells);   // Number of rows for the number of cells
+  size_t celllen;       // Number of characters in each cell
+  _Bool ih;             // Interior horizontal lines
+} shape_t;
+
+static size_t
+rows_square(size_t cells) {
+  size_t r = 1;
+  while ((r + 1) * (r + 1) <= cells) r++;
+  return r;
+}
+
+static size_t
+rows_wide(size_t cells) {
+  (void)cells;
+  return 2;
+}
+
+static size_t
+rows_tall(size_t cells) {
+  return cells / 4;
+}
+
+static const shape_t shapes[] = {
+  {"square", rows_square, 8, FALSE},     // Square table, short texts
+  {"wide", rows_wide, 4, FALSE},         // Two very wide rows
+  {"tall", rows_tall, 8, TRUE},          // Four columns, interior lines
+  {"longtext", rows_tall, 100, FALSE},   // Four columns, long cell texts
+};
+
+#define NSHAPES (sizeof(shapes) / sizeof(shapes[0]))
+
+typedef struct {
+  double strstroke_ns;  // Best time for utable_strstroke()
+  double stroke_ns;     // Best time for utable_stroke()
+  size_t bytes;         // Output size
+  long maxrss_kb;       // Peak RSS of the child
+  int ok;               // The child completed
+} result_t;
+
+static double
+now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static table_t *
+build_table(const shape_t *s, size_t cells) {
+  const size_t rows = s->rows(cells);
+  const size_t cols = cells / rows;
+  char *buff = malloc(s->celllen + 1);
+  table_t *t = utable_create(rows, cols);
+  if (NULL == t || NULL == buff) {
+    free(buff);
+    return NULL;
+  }
+  for (size_t r = 0; r < rows; r++) {
+    for (size_t c = 0; c < cols; c++) {
+      for (size_t i = 0; i < s->celllen; i++)
+        buff[i] = 'a' + (r + c + i) % 26;
+      buff[s->celllen] = '\0';
+      utable_set_cell(t, r, c, buff);
+    }
+  }
+  free(buff);
+  utable_set_interior(t, TRUE, s->ih);
+  utable_set_title(t, "Scaling test", TITLESTYLE_LINE);
+  return t;
+}
+
+/**
+ * Run one shape and size. Called in the child process.
+ */
+static int
+run_size(const shape_t *s, size_t cells, int reps, result_t *res) {
+  table_t *t = build_table(s, cells);
+  if (NULL == t) return -1;
+
+  // The file descriptor stroke returns the size which is used to size the
+  // buffer for the string stroke
+  const int devnull = open("/dev/null", O_WRONLY);
+  if (devnull < 0) return -1;
+  res->stroke_ns = res->strstroke_ns = 1e300;
+  for (int i = 0; i < reps; i++) {
+    const double t0 = now_ns();
+    size_t n = 0;
+    const int ret = utable_stroke_count(t, devnull, TSTYLE_SINGLE_V2, &n);
+    const double ns = now_ns() - t0;
+    if (ret) return -1;
+    res->bytes = n;
+    if (ns < res->stroke_ns) res->stroke_ns = ns;
+  }
+  close(devnull);
+
+  char *out = malloc(res->bytes + 1);
+  if (NULL == out) return -1;
+  for (int i = 0; i < reps; i++) {
+    const double t0 = now_ns();
+    if (utable_strstroke(t, out, res->bytes + 1, TSTYLE_SINGLE_V2)) return -1;
+    const double ns = now_ns() - t0;
+    if (ns < res->strstroke_ns) res->strstroke_ns = ns;
+  }
+  free(out);
+  utable_free(t);
+  return 0;
+}
+
+/**
+ * Run one shape and size in a child process and collect the result and
+ * the peak RSS of the child. A size of 0 only measures the baseline RSS.
+ */
+static void
+run_child(const shape_t *s, size_t cells, int reps, result_t *res) {
+  int fds[2];
+  memset(res, 0, sizeof(*res));
+  if (pipe(fds)) return;
+  const pid_t pid = fork();
+  if (pid < 0) return;
+  if (0 == pid) {
+    close(fds[0]);
+    result_t r;
+    memset(&r, 0, sizeof(r));
+    r.ok = 0 == cells || 0 == run_size(s, cells, reps, &r);
+    if (write(fds[1], &r, sizeof(r)) != sizeof(r)) _exit(EXIT_FAILURE);
+    _exit(EXIT_SUCCESS);
+  }
+  close(fds[1]);
+  if (read(fds[0], res, sizeof(*res)) != sizeof(*res)) res->ok = 0;
+  close(fds[0]);
+  int status;
+  struct rusage ru;
+  if (wait4(pid, &status, 0, &ru) < 0 || !WIFEXITED(status) ||
+      WEXITSTATUS(status))
+    res->ok = 0;
+  res->maxrss_kb = ru.ru_maxrss;
+}
+
+static void
+usage(void) {
+  fprintf(stderr,
+          "Usage: scale_table [-m maxcells] [-t tolerance] [-r reps]\n"
+          "  -m maxcells   Largest table in cells (1000000)\n"
+          "  -t tolerance  Allowed growth factor per output byte (4.0)\n"
+          "  -r reps       Number of strokes per size, best is used (3)\n");
+}
+
+int
+main(int argc, char **argv) {
+  size_t maxcells = 1000000;
+  double tol = 4.0;
+  int reps = 3, opt;
+
+  while ((opt = getopt(argc, argv, "m:t:r:h")) != -1) {
+    switch (opt) {
+      case 'm':
+        maxcells = strtoul(optarg, NULL, 10);
+        break;
+      case 't':
+        tol = atof(optarg);
+        break;
+      case 'r':
+        reps = atoi(optarg);
+        break;
+      default:
+        usage();
+        exit(EXIT_FAILURE);
+    }
+  }
+
+  // The RSS of a child that does not build any table. This is subtracted
+  // from the measured peak RSS.
+  result_t base;
+  run_child(NULL, 0, 0, &base);
+
+  // Only sizes where the output is large enough to dominate the fixed
+  // overhead are used to check the time and memory per output byte
+  const size_t minbytes_time = 64 * 1024;
+  const size_t minbytes_rss = 8 * 1024 * 1024;
+
+  printf("libunitbl %s scaling test (tolerance %.1f)\n", PACKAGE_VERSION, tol);
+  printf("%-9s %8s %11s %11s %11s %10s\n", "Shape", "Cells", "Bytes",
+         "str ns/B", "fd ns/B", "RSS B/B");
+
+  int failed = 0;
+  for (size_t i = 0; i < NSHAPES; i++) {
+    const shape_t *s = &shapes[i];
+    double tmin = 1e300, tmax = 0, rmin = 1e300, rmax = 0;
+
+    for (size_t cells = 100; cells <= maxcells; cells *= 10) {
+      result_t res;
+      run_child(s, cells, reps, &res);
+      if (!res.ok) {
+        printf("%-9s %8zu FAILED\n", s->name, cells);
+        failed = 1;
+        continue;
+      }
+      const double sns = res.strstroke_ns / res.bytes;
+      const double fns = res.stroke_ns / res.bytes;
+      const long rss = (res.maxrss_kb - base.maxrss_kb) * 1024;
+      const double rpb = rss > 0 ? (double)rss / res.bytes : 0;
+      printf("%-9s %8zu %11zu %11.3f %11.3f %10.2f\n", s->name, cells,
+             res.bytes, sns, fns, rpb);
+      fflush(stdout);
+
+      if (res.bytes >= minbytes_time) {
+        const double lo = sns < fns ? sns : fns;
+        const double hi = sns > fns ? sns : fns;
+        if (lo < tmin) tmin = lo;
+        if (hi > tmax) tmax = hi;
+      }
+      if (res.bytes >= minbytes_rss) {
+        if (rpb < rmin) rmin = rpb;
+        if (rpb > rmax) rmax = rpb;
+      }
+    }
+
+    if (tmax > tol * tmin) {
+      printf("%-9s ** FAILED ** time per byte grows %.1fx\n", s->name,
+             tmax / tmin);
+      failed = 1;
+    } else if (rmax > tol * rmin) {
+      printf("%-9s ** FAILED ** RSS per byte grows %.1fx\n", s->name,
+             rmax / rmin);
+      failed = 1;
+    } else {
+      printf("%-9s PASSED\n", s->name);
+    }
+  }
+
+  exit(failed ? EXIT_FAILURE : EXIT_SUCCESS);
+}
@@ -1,10 +1,29 @@
 #!/bin/bash
 
-unit_tests=("ut1 ut2 ut3 ut4")
+unit_tests=("ut1 ut2 ut3 ut4 ut5 ut6 ut7 ut8 ut9 ut10 ut11 ut12 ut13 ut14 ut15 ut16 ut17 ut18 ut19 ut20 ut21 ut22 ut23 ut24 ut25")
+
+# Tests of the C++ wrapper and the C++20 streaming interface are in their
+# own programs
+cxx_tests=" ut17 ut18 "
+cxx20_tests=" ut20 "
 
 for ut in $unit_tests;
 do
-    ../test_table $ut > _test.txt
+    prog=../test_table
+    if [[ "$cxx_tests" == *" $ut "* ]]
+    then
+	prog=../test_tablexx
+    elif [[ "$cxx20_tests" == *" $ut "* ]]
+    then
+	prog=../test_streamxx
+    fi
+    # The C++20 test program is not built by compilers without coroutines
+    if [ ! -x $prog ]
+    then
+	echo "${ut} SKIPPED"
+	continue
+    fi
+    $prog $ut > _test.txt
     diff ${ut}_correct.txt _test.txt
     _res=`diff ${ut}_correct.txt _test.txt | wc -l`
     if [ $_res -eq 0 ]
@@ -0,0 +1,136 @@
+// Unit tests for the C++20 streaming interface. Run the same way as
+// test_table, i.e. "test_streamxx ut20", and compared with the golden file
+// by test/ut.sh
+
+#include <chrono>
+#include <coroutine>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "libunitbl/unitable_stream.hpp"
+
+using unitable::Stream;
+
+using job_t = std::tuple<int, std::string, double, std::chrono::milliseconds>;
+
+// Rows of a query that produces them one at a time
+unitable::generator<job_t> jobs(int n, int fail) {
+  for (int i = 0; i < n; i++) {
+    if (i == fail) throw std::runtime_error("Query failed");
+    co_yield {i * i * i, std::string(i + 2, 'a' + i), i / 4.0,
+              std::chrono::milliseconds(i * 250)};
+  }
+}
+
+Stream job_stream(std::size_t lookahead) {
+  Stream st(4, lookahead, TSTYLE_SINGLE_V2);
+  st.title("Jobs").headerline(true).halign(0, RIGHTALIGN).halign(2, RIGHTALIGN);
+  st.push(std::tuple{"Id", "Name", "Load", "Time"});
+  return st;
+}
+
+// A minimal event loop with a sink that completes every write on the next
+// turn of the loop, like a socket in an asynchronous framework
+struct event_loop {
+  std::deque<std::coroutine_handle<>> ready;
+
+  void run() {
+    while (!ready.empty()) {
+      std::coroutine_handle<> h = ready.front();
+      ready.pop_front();
+      h.resume();
+    }
+  }
+};
+
+struct async_sink {
+  event_loop &loop;
+  std::string out;
+  std::size_t writes = 0, largest = 0;
+
+  explicit async_sink(event_loop &l) : loop(l) {}
+
+  auto write(std::string_view p) {
+    struct awaiter {
+      async_sink &s;
+      std::string_view p;
+      bool await_ready() const noexcept { return false; }
+      void await_suspend(std::coroutine_handle<> h) {
+        s.out.append(p);
+        s.writes++;
+        s.largest = std::max(s.largest, p.size());
+        s.loop.ready.push_back(h);
+      }
+      void await_resume() const noexcept {}
+    };
+    return awaiter{*this, p};
+  }
+};
+
+unitable::task report(Stream &st, async_sink &sink, int n, int fail) {
+  co_await unitable::render_async(st, jobs(n, fail), sink);
+  sink.out.append("Report done\n");
+}
+
+void ut20() {
+  try {
+    // Rows from a generator, the widths are fixed from the header and the
+    // first three rows
+    Stream st = job_stream(4);
+    std::ostringstream sync;
+    unitable::render(st, jobs(8, -1), sync);
+    std::cout << sync.str();
+
+    // The same table to an asynchronous sink from a coroutine
+    event_loop loop;
+    async_sink sink{loop};
+    Stream ast = job_stream(4);
+    unitable::task t = report(ast, sink, 8, -1);
+    t.start();
+    loop.run();
+    t.get();
+    std::cout << "Async " << (sink.out == sync.str() + "Report done\n" ? "same" : "differs")
+              << ", " << sink.writes << " writes, largest " << sink.largest << " bytes\n";
+
+    // Rows as ranges
+    Stream rst(2, 1, TSTYLE_ASCII_V1);
+    std::vector<std::vector<std::string>> rows{{"key", "value"}, {"a", "1"}, {"longer key", "2"}};
+    unitable::render(rst, rows, std::cout);
+
+    // A failing query ends the task with its exception
+    async_sink fsink{loop};
+    Stream fst = job_stream(2);
+    unitable::task f = report(fst, fsink, 8, 3);
+    f.start();
+    loop.run();
+    try {
+      f.get();
+    } catch (const std::runtime_error &e) {
+      std::cout << fsink.out << "\nCaught: " << e.what() << "\n";
+    }
+
+    try {
+      rst.push(std::tuple{1, 2, 3});
+    } catch (const unitable::error &e) {
+      std::cout << "Caught: " << e.what() << "\n";
+    }
+  } catch (const std::exception &e) {
+    std::cout << "Failed! " << e.what() << "\n";
+  }
+}
+
+int
+main(int argc, char **argv) {
+  if (argc == 2 && std::strcmp(argv[1], "ut20") == 0)
+    ut20();
+  else
+    std::cerr << "Usage test_streamxx \"ut<20>\"\n";
+  std::cout << "\n\n";
+  return 0;
+}
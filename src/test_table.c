@@ -4,8 +4,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <syslog.h>
 #include <string.h>
+#include <pthread.h>
 #include <sys/param.h> // To get MIN/MAX
 
 #include "libunitbl/unicode_tbl.h"
@@ -296,6 +298,1162 @@ ut4(void) {
     
 }
 
+void
+ut5(void) {
+
+  char *data[] = {
+		  "Name", "Text", "Cut",
+		  "Chinese", "\u4e2d\u6587\u8868\u683c", "\u4e2d\u6587\u8868\u683c",
+		  "Emoji", "\U0001F600 ok", "\U0001F600\U0001F600\U0001F600",
+		  "Combining", "Cafe\u0301 nai\u0308ve", "e\u0301e\u0301e\u0301e\u0301e\u0301e\u0301",
+		  "Fullwidth", "\uff21\uff22\uff23", "\uff21\uff22\uff23"
+  };
+
+  table_t *tbl = utable_create_set(5, 3, data);
+
+  if (NULL == tbl) {
+    printf("Cannot create table\n");
+    exit(EXIT_FAILURE);
+  }
+
+  utable_set_interior(tbl, TRUE, FALSE);
+  utable_set_colwidth(tbl, 2, 5);
+  utable_set_title(tbl, "Wide \u8868", TITLESTYLE_LINE);
+  utable_stroke(tbl, STDOUT_FILENO, TSTYLE_SINGLE_V2);
+  utable_free(tbl);
+}
+
+void
+ut6(void) {
+
+  char *data[] = {
+		  "Name", "Value", "Note",
+		  "comma", "1,5", "say \"hi\"",
+		  "tab", "a\tb", "back\\slash",
+		  "newline", "two\nlines", "pipe | char",
+		  "span", "", "",
+		  "wide", "\u4e2d\u6587", ""
+  };
+
+  table_t *tbl = utable_create_set(6, 3, data);
+
+  if (NULL == tbl) {
+    printf("Cannot create table\n");
+    exit(EXIT_FAILURE);
+  }
+
+  utable_set_cell_colspan(tbl, 4, 1, 2);
+  utable_set_col_halign(tbl, 1, RIGHTALIGN);
+  utable_set_col_halign(tbl, 2, CENTERALIGN);
+
+  exportfmt_t fmts[] = {EXPORT_CSV, EXPORT_TSV, EXPORT_JSON_ARRAY,
+                        EXPORT_JSON_OBJECT, EXPORT_MARKDOWN};
+  for (size_t i = 0; i < sizeof(fmts) / sizeof(fmts[0]); i++) {
+    utable_export(tbl, STDOUT_FILENO, fmts[i]);
+    printf("\n");
+    fflush(stdout);
+  }
+
+  // The number of bytes written is the length of the exported string
+  char buff[4096];
+  size_t n = 0;
+  const int devnull = open("/dev/null", O_WRONLY);
+  utable_strexport(tbl, buff, sizeof(buff), EXPORT_JSON_OBJECT);
+  printf("Export count %s\n",
+         0 == utable_export_count(tbl, devnull, EXPORT_JSON_OBJECT, &n) &&
+         n == strlen(buff) ? "matches" : "differs");
+  close(devnull);
+  utable_free(tbl);
+}
+
+void
+ut7(void) {
+
+  table_t *tbl = utable_load("ut7_data.csv", EXPORT_CSV, 0);
+
+  if (NULL == tbl) {
+    printf("Cannot load table\n");
+    exit(EXIT_FAILURE);
+  }
+
+  utable_export(tbl, STDOUT_FILENO, EXPORT_JSON_ARRAY);
+  utable_export(tbl, STDOUT_FILENO, EXPORT_TSV);
+  printf("%s\n", utable_get_cell(tbl, 2, 2));
+  fflush(stdout);
+  utable_free(tbl);
+}
+
+void
+ut8(void) {
+  char buff[256];
+
+  char *data[] = {
+		  "File", "Size", "Owner",
+		  "file10.txt", "2.5", "bob",
+		  "file2.txt", "10", "alice",
+		  "File1.txt", "n/a", "bob",
+		  "file1.txt", "-3", "alice",
+		  "file02.txt", "10", "bob"
+  };
+
+  table_t *tbl = utable_create_set(6, 3, data);
+
+  if (NULL == tbl) {
+    printf("Cannot create table\n");
+    exit(EXIT_FAILURE);
+  }
+
+  utable_set_col_halign(tbl, 1, RIGHTALIGN);
+  utable_set_interior(tbl, TRUE, FALSE);
+
+  sortkey_t bynat[] = {{0, SORT_NATURAL, FALSE}};
+  sortkey_t bysize[] = {{1, SORT_NUMERIC, TRUE}, {0, SORT_STRING, FALSE}};
+  sortkey_t byowner[] = {{2, SORT_STRING, FALSE}, {1, SORT_NUMERIC, FALSE}};
+
+  utable_sort_by_col(tbl, bynat, 1, 1);
+  utable_set_title(tbl, "Natural", TITLESTYLE_LINE);
+  utable_stroke(tbl, STDOUT_FILENO, TSTYLE_SINGLE_V2);
+  utable_sort_by_col(tbl, bysize, 2, 1);
+  utable_set_title(tbl, "Size descending", TITLESTYLE_LINE);
+  utable_stroke(tbl, STDOUT_FILENO, TSTYLE_SINGLE_V2);
+  utable_sort_by_col(tbl, byowner, 2, 1);
+  utable_set_title(tbl, "Owner, size", TITLESTYLE_LINE);
+  utable_stroke(tbl, STDOUT_FILENO, TSTYLE_SINGLE_V2);
+  utable_unsort(tbl);
+  utable_set_title(tbl, "Unsorted", TITLESTYLE_LINE);
+  utable_stroke(tbl, STDOUT_FILENO, TSTYLE_SINGLE_V2);
+  utable_free(tbl);
+
+  // Negative and positive zero are equal and keep the order they were
+  // created in
+  char *zeros[] = {"Name", "Value",
+		   "a", "0", "b", "-0", "c", "1", "d", "0.0", "e", "-0.0", "f", "-1"};
+  tbl = utable_create_set(7, 2, zeros);
+  sortkey_t byvalue[] = {{1, SORT_NUMERIC, FALSE}};
+  utable_sort_by_col(tbl, byvalue, 1, 1);
+  utable_strexport(tbl, buff, sizeof(buff), EXPORT_TSV);
+  printf("%s", buff);
+  utable_free(tbl);
+
+  // A table with only header rows has nothing to sort
+  tbl = utable_create_set(1, 2, zeros);
+  printf("Header only sort: %d\n", utable_sort_by_col(tbl, byvalue, 1, 1));
+  utable_free(tbl);
+}
+
+static _Bool
+level_is(table_t *t, size_t row, void *arg) {
+  return 0 == strcmp(utable_get_cell(t, row, 1), (char *)arg);
+}
+
+void
+ut9(void) {
+
+  char *data[] = {
+		  "Host", "Level", "Message",
+		  "web1", "info", "Started",
+		  "db1", "error", "Connection refused by the remote server",
+		  "web2", "info", "Started",
+		  "cache01", "error", "Out of memory",
+		  "web1", "warning", "Slow response"
+  };
+
+  table_t *tbl = utable_create_set(6, 3, data);
+
+  if (NULL == tbl) {
+    printf("Cannot create table\n");
+    exit(EXIT_FAILURE);
+  }
+
+  utable_set_title(tbl, "Errors", TITLESTYLE_LINE);
+
+  // The header row is always kept, the widths only depend on the visible rows
+  tview_t *errors = utable_view_create(tbl, level_is, "error", 1);
+  utable_view_stroke(errors, STDOUT_FILENO, TSTYLE_SINGLE_V2);
+
+  // The view follows the sort order of the table at the time it is created
+  sortkey_t byhost[] = {{0, SORT_STRING, FALSE}};
+  utable_sort_by_col(tbl, byhost, 1, 1);
+  tview_t *info = utable_view_create(tbl, level_is, "info", 1);
+  utable_view_set_colwidth(info, 2, 12);
+  utable_set_interior(tbl, TRUE, TRUE);
+  utable_view_stroke(info, STDOUT_FILENO, TSTYLE_ASCII_V2);
+
+  // An explicit list of rows
+  size_t rows[] = {0, 5, 1};
+  tview_t *list = utable_view_create_rows(tbl, rows, 3);
+  utable_set_title(tbl, "Rows 0, 5, 1", TITLESTYLE_NOLINE);
+  utable_view_stroke(list, STDOUT_FILENO, TSTYLE_DOUBLE_V2);
+
+  // The base table is not affected by the views
+  utable_set_title(tbl, "All", TITLESTYLE_LINE);
+  utable_stroke(tbl, STDOUT_FILENO, TSTYLE_SINGLE_V2);
+
+  utable_view_free(errors);
+  utable_view_free(info);
+  utable_view_free(list);
+  utable_free(tbl);
+}
+
+void
+ut10(void) {
+
+  char *data[] = {
+		  "Id", "Name", "Region", "CPU", "Memory", "Disk", "Status",
+		  "1", "web1", "eu-north", "12%", "1.2G", "40%", "ok",
+		  "2", "db1", "us-east", "87%", "31.0G", "91%", "degraded",
+		  "3", "cache01", "eu-north", "3%", "7.8G", "12%", "ok"
+  };
+
+  table_t *tbl = utable_create_set(4, 7, data);
+
+  if (NULL == tbl) {
+    printf("Cannot create table\n");
+    exit(EXIT_FAILURE);
+  }
+
+  utable_set_cell_colspan(tbl, 3, 1, 2);
+  utable_set_interior(tbl, TRUE, FALSE);
+  utable_set_col_halign(tbl, 3, RIGHTALIGN);
+  utable_set_title(tbl, "Hosts", TITLESTYLE_LINE);
+
+  // Projection and reordering, the span is kept when its columns follow it
+  tview_t *v = utable_view_create(tbl, NULL, NULL, 0);
+  size_t keep[] = {0, 1, 2, 6};
+  utable_view_set_cols(v, keep, 4);
+  utable_view_stroke(v, STDOUT_FILENO, TSTYLE_SINGLE_V2);
+  size_t reorder[] = {6, 3, 2, 1};
+  utable_view_set_cols(v, reorder, 4);
+  utable_view_stroke(v, STDOUT_FILENO, TSTYLE_SINGLE_V2);
+
+  // A transposed view of a single record
+  size_t record[] = {0, 2};
+  tview_t *detail = utable_view_create_rows(tbl, record, 2);
+  utable_view_transpose(detail);
+  utable_set_title(tbl, "Host 2", TITLESTYLE_LINE);
+  utable_set_headerline(tbl, FALSE);
+  utable_view_stroke(detail, STDOUT_FILENO, TSTYLE_SINGLE_V2);
+
+  // Only some of the fields of the transposed record
+  size_t fields[] = {1, 3, 6};
+  utable_view_transpose(detail);
+  utable_view_set_cols(detail, fields, 3);
+  utable_view_transpose(detail);
+  utable_view_stroke(detail, STDOUT_FILENO, TSTYLE_SINGLE_V2);
+
+  utable_view_free(v);
+  utable_view_free(detail);
+  utable_free(tbl);
+}
+
+void
+ut11(void) {
+
+  char *data[] = {
+		  "Service", "Latency ms", "Errors",
+		  "auth", "12.5", "0",
+		  "billing", "250", "14",
+		  "search", "87", "3",
+		  "cart", "250", "2",
+		  "profile", "n/a", "1",
+		  "checkout", "1430", "27",
+		  "images", "5", "0",
+		  "api", "99.9", "9"
+  };
+
+  table_t *tbl = utable_create_set(9, 3, data);
+
+  if (NULL == tbl) {
+    printf("Cannot create table\n");
+    exit(EXIT_FAILURE);
+  }
+
+  utable_set_col_halign(tbl, 1, RIGHTALIGN);
+  utable_set_col_halign(tbl, 2, RIGHTALIGN);
+  utable_set_interior(tbl, TRUE, FALSE);
+
+  // Equal values keep the order the rows were created in
+  sortkey_t slowest = {1, SORT_NUMERIC, TRUE};
+  tview_t *v = utable_view_top(tbl, &slowest, 4, 1);
+  utable_set_title(tbl, "Slowest 4", TITLESTYLE_LINE);
+  utable_view_stroke(v, STDOUT_FILENO, TSTYLE_SINGLE_V2);
+  utable_view_free(v);
+
+  sortkey_t byname = {0, SORT_STRING, FALSE};
+  v = utable_view_top(tbl, &byname, 3, 1);
+  utable_set_title(tbl, "First 3", TITLESTYLE_LINE);
+  utable_view_stroke(v, STDOUT_FILENO, TSTYLE_SINGLE_V2);
+  utable_view_free(v);
+
+  // Asking for more rows than there are gives all rows sorted
+  sortkey_t errors = {2, SORT_NUMERIC, FALSE};
+  v = utable_view_top(tbl, &errors, 100, 1);
+  utable_set_title(tbl, "Fewest errors", TITLESTYLE_LINE);
+  utable_view_stroke(v, STDOUT_FILENO, TSTYLE_SINGLE_V2);
+  utable_view_free(v);
+
+  // Selecting no rows gives only the header rows
+  v = utable_view_top(tbl, &errors, 0, 1);
+  printf("None: %zu rows\n", v->nRow);
+  fflush(stdout);
+  utable_view_free(v);
+
+  utable_free(tbl);
+}
+
+static _Bool
+in_region(table_t *t, size_t row, void *arg) {
+  return 0 == strcmp(utable_get_cell(t, row, 1), (char *)arg);
+}
+
+void
+ut12(void) {
+
+  char *data[] = {
+		  "Item", "Region", "Units", "Price", "Amount",
+		  "Widget", "north", "12", "2.50", "30.00",
+		  "Gadget", "south", "3", "19.99", "59.97",
+		  "Doohickey", "north", "n/a", "7.25", "",
+		  "Gizmo", "south", "40", "0.99", "39.60",
+		  "Thingamajig", "north", "1", "120.00", "120.00"
+  };
+
+  table_t *tbl = utable_create_set(6, 5, data);
+
+  if (NULL == tbl) {
+    printf("Cannot create table\n");
+    exit(EXIT_FAILURE);
+  }
+
+  utable_set_interior(tbl, TRUE, FALSE);
+  for (size_t c = 2; c < 5; c++) utable_set_col_halign(tbl, c, RIGHTALIGN);
+  utable_set_footer_label(tbl, 0, "Total");
+  utable_set_col_aggregate(tbl, 2, AGG_SUM, NULL);
+  utable_set_col_aggregate(tbl, 3, AGG_MAX, "max %.2f");
+  utable_set_col_aggregate(tbl, 4, AGG_SUM, "%.2f");
+  utable_set_title(tbl, "Sales", TITLESTYLE_LINE);
+  utable_stroke(tbl, STDOUT_FILENO, TSTYLE_SINGLE_V2);
+
+  // Changing a cell updates the footer of its column
+  utable_set_cell(tbl, 3, 4, "1234567.89");
+  utable_set_col_aggregate(tbl, 2, AGG_COUNT, "%.0f values");
+  utable_set_col_aggregate(tbl, 3, AGG_MEAN, "avg %.3f");
+  utable_reset_table_colwidth(tbl);
+  utable_stroke(tbl, STDOUT_FILENO, TSTYLE_ASCII_V2);
+
+  // A view only aggregates its own rows
+  tview_t *v = utable_view_create(tbl, in_region, "south", 1);
+  utable_set_title(tbl, "South", TITLESTYLE_LINE);
+  utable_view_stroke(v, STDOUT_FILENO, TSTYLE_DOUBLE_V2);
+  utable_view_free(v);
+
+  utable_free(tbl);
+}
+
+#define UT13_ROWS 130
+#define UT13_GENS 2000
+
+static tpub_t *ut13_pub;
+static int ut13_done;
+
+// Reader thread, every snapshot must have the same generation in all rows
+// and the generations must never go backwards
+static void *
+ut13_reader(void *arg) {
+  char *buff = malloc(UT13_ROWS * 128);
+  long last = 0, ok = 1;
+  (void)arg;
+  while (!__atomic_load_n(&ut13_done, __ATOMIC_ACQUIRE)) {
+    table_t *s = utable_pub_acquire(ut13_pub);
+    if (NULL == s) continue;
+    const long gen = atol(utable_get_cell(s, 1, 1));
+    for (size_t r = 2; r < UT13_ROWS; r++)
+      if (atol(utable_get_cell(s, r, 1)) != gen) ok = 0;
+    if (gen < last || utable_strstroke(s, buff, UT13_ROWS * 128, TSTYLE_SIMPLE_V1))
+      ok = 0;
+    last = gen;
+    utable_snapshot_release(s);
+  }
+  free(buff);
+  return (void *)ok;
+}
+
+void
+ut13(void) {
+  char buff[32];
+  size_t ntables;
+  utable_memory_global(&ntables, NULL);
+
+  table_t *tbl = utable_create(UT13_ROWS, 3);
+  if (NULL == tbl) {
+    printf("Cannot create table\n");
+    exit(EXIT_FAILURE);
+  }
+  utable_set_cell(tbl, 0, 0, "Host");
+  utable_set_cell(tbl, 0, 1, "Gen");
+  utable_set_cell(tbl, 0, 2, "State");
+  for (size_t r = 1; r < UT13_ROWS; r++) {
+    snprintf(buff, sizeof(buff), "host%03zu", r);
+    utable_set_cell(tbl, r, 0, buff);
+    utable_set_cell(tbl, r, 1, "0");
+    utable_set_cell(tbl, r, 2, "up");
+  }
+  utable_set_col_halign(tbl, 1, RIGHTALIGN);
+  utable_set_interior(tbl, TRUE, FALSE);
+
+  // A snapshot keeps its contents when the table is changed and only the
+  // changed chunk is copied by the next snapshot
+  table_t *s1 = utable_snapshot(tbl);
+  utable_set_cell(tbl, 100, 2, "down");
+  table_t *s2 = utable_snapshot(tbl);
+  for (size_t k = 0; k * 64 < UT13_ROWS; k++)
+    printf("Chunk %zu: %s\n", k, s1->chunks[k] == s2->chunks[k] ? "shared" : "copied");
+  printf("Row 0 cells shared: %s, row 100 cells shared: %s\n",
+         s1->row[0] == s2->row[0] ? "yes" : "no",
+         s1->row[100] == s2->row[100] ? "yes" : "no");
+
+  fflush(stdout);
+  size_t rows[] = {0, 99, 100, 101};
+  tview_t *v = utable_view_create_rows(s1, rows, 4);
+  utable_view_stroke(v, STDOUT_FILENO, TSTYLE_SINGLE_V2);
+  utable_view_free(v);
+  v = utable_view_create_rows(s2, rows, 4);
+  utable_view_stroke(v, STDOUT_FILENO, TSTYLE_SINGLE_V2);
+  utable_view_free(v);
+  utable_snapshot_release(s1);
+  utable_snapshot_release(s2);
+
+  // One writer publishes while two readers stroke the latest snapshot
+  ut13_pub = utable_pub_create();
+  pthread_t th[2];
+  for (int i = 0; i < 2; i++) pthread_create(&th[i], NULL, ut13_reader, NULL);
+  for (int g = 1; g <= UT13_GENS; g++) {
+    snprintf(buff, sizeof(buff), "%d", g);
+    for (size_t r = 1; r < UT13_ROWS; r++) utable_set_cell(tbl, r, 1, buff);
+    utable_pub_publish(ut13_pub, tbl);
+  }
+  __atomic_store_n(&ut13_done, 1, __ATOMIC_RELEASE);
+  long ok = 1;
+  for (int i = 0; i < 2; i++) {
+    void *res;
+    pthread_join(th[i], &res);
+    ok &= (long)res;
+  }
+  printf("Readers saw consistent snapshots: %s\n", ok ? "yes" : "no");
+
+  table_t *last = utable_pub_acquire(ut13_pub);
+  printf("Last published generation: %s\n", utable_get_cell(last, 1, 1));
+  utable_snapshot_release(last);
+
+  // A reader is always in acquire, but each one leaves after the next one
+  // has come, so the replaced snapshots are still released
+  size_t prev = ut13_pub->epoch & 1;
+  __atomic_add_fetch(&ut13_pub->readers[prev], 1, __ATOMIC_SEQ_CST);
+  for (int g = 0; g < 100; g++) {
+    const size_t e = __atomic_load_n(&ut13_pub->epoch, __ATOMIC_SEQ_CST) & 1;
+    __atomic_add_fetch(&ut13_pub->readers[e], 1, __ATOMIC_SEQ_CST);
+    __atomic_sub_fetch(&ut13_pub->readers[prev], 1, __ATOMIC_SEQ_CST);
+    utable_pub_publish(ut13_pub, tbl);
+    prev = e;
+  }
+  printf("Retired with readers always present: %zu\n",
+         ut13_pub->nRetired[0] + ut13_pub->nRetired[1]);
+  __atomic_sub_fetch(&ut13_pub->readers[prev], 1, __ATOMIC_SEQ_CST);
+  fflush(stdout);
+  utable_pub_free(ut13_pub);
+  utable_free(tbl);
+
+  size_t left;
+  utable_memory_global(&left, NULL);
+  printf("Tables left: %zu\n", left - ntables);
+}
+
+#define UT14_ROWS 400
+
+void
+ut14(void) {
+  char buff[32];
+  table_t *tbl = utable_create(UT14_ROWS, 3);
+  if (NULL == tbl) {
+    printf("Cannot create table\n");
+    exit(EXIT_FAILURE);
+  }
+  utable_set_cell(tbl, 0, 0, "Host");
+  utable_set_cell(tbl, 0, 1, "Requests");
+  utable_set_cell(tbl, 0, 2, "State");
+  for (size_t r = 1; r < UT14_ROWS; r++) {
+    snprintf(buff, sizeof(buff), "host%03zu", r);
+    utable_set_cell(tbl, r, 0, buff);
+    snprintf(buff, sizeof(buff), "%zu", r * 37 % 1000);
+    utable_set_cell(tbl, r, 1, buff);
+    utable_set_cell(tbl, r, 2, r % 7 ? "up" : "down");
+  }
+  utable_set_col_halign(tbl, 1, RIGHTALIGN);
+  utable_set_interior(tbl, TRUE, TRUE);
+  utable_set_title(tbl, "Hosts", TITLESTYLE_LINE);
+
+  const size_t size = UT14_ROWS * 256;
+  char *expect = malloc(size);
+  char *got = malloc(size);
+  if (NULL == expect || NULL == got ||
+      utable_strstroke(tbl, expect, size, TSTYLE_SINGLE_V2)) {
+    printf("Cannot stroke table\n");
+    exit(EXIT_FAILURE);
+  }
+
+  // The table is written to a small non-blocking pipe that is drained
+  // every time the stroke would block
+  int fd[2];
+  if (pipe(fd)) {
+    printf("Cannot create pipe\n");
+    exit(EXIT_FAILURE);
+  }
+  fcntl(fd[1], F_SETPIPE_SZ, 4096);
+  fcntl(fd[1], F_SETFL, fcntl(fd[1], F_GETFL) | O_NONBLOCK);
+  fcntl(fd[0], F_SETFL, fcntl(fd[0], F_GETFL) | O_NONBLOCK);
+
+  size_t len = 0, blocked = 0;
+  tstroke_t *st = utable_stroke_begin(tbl, fd[1], TSTYLE_SINGLE_V2);
+  int ret;
+  while ((ret = utable_stroke_continue(st)) == 1) {
+    blocked++;
+    ssize_t n;
+    while ((n = read(fd[0], got + len, size - 1 - len)) > 0) len += n;
+  }
+  printf("Stroke result: %d\n", ret);
+  printf("Stroke would block: %s\n", blocked > 1 ? "yes" : "no");
+  printf("Bytes written: %s\n",
+         utable_stroke_written(st) == strlen(expect) ? "all" : "missing");
+  utable_stroke_end(st);
+  ssize_t n;
+  while ((n = read(fd[0], got + len, size - 1 - len)) > 0) len += n;
+  got[len] = '\0';
+  printf("Same as a blocking stroke: %s\n", strcmp(expect, got) ? "no" : "yes");
+
+  // A stroke can be abandoned before it is complete
+  st = utable_stroke_begin(tbl, fd[1], TSTYLE_SINGLE_V2);
+  printf("Abandoned stroke result: %d\n", utable_stroke_continue(st));
+  utable_stroke_end(st);
+  close(fd[0]);
+  close(fd[1]);
+  free(expect);
+  free(got);
+
+  // A view on a blocking descriptor is written in a single call
+  size_t rows[] = {0, 1, 7, 14};
+  tview_t *v = utable_view_create_rows(tbl, rows, 4);
+  fflush(stdout);
+  st = utable_view_stroke_begin(v, STDOUT_FILENO, TSTYLE_SINGLE_V2);
+  ret = utable_stroke_continue(st);
+  utable_stroke_end(st);
+  printf("View stroke result: %d\n", ret);
+  utable_view_free(v);
+  utable_free(tbl);
+}
+
+// The text gets longer every time the cell is drawn
+char *
+ut15_cell_cb(int r, int c, void *tag) {
+  static char buff[64];
+  static int n = 0;
+  (void)r; (void)c; (void)tag;
+  n = n % 9 + 1;
+  memset(buff, '0' + n, 4 * n);
+  buff[4 * n] = '\0';
+  return buff;
+}
+
+// Print a file and check that it is the same as a string
+static void
+ut15_check(const char *path, const char *expect, _Bool print) {
+  FILE *fp = fopen(path, "r");
+  if (NULL == fp) {
+    printf("Cannot open file\n");
+    return;
+  }
+  fseek(fp, 0, SEEK_END);
+  const size_t n = ftell(fp);
+  rewind(fp);
+  char *got = malloc(n + 1);
+  got[fread(got, 1, n, fp)] = '\0';
+  fclose(fp);
+  if (print) printf("%s", got);
+  if (expect)
+    printf("File size: %zu, same as string stroke: %s\n", n,
+           strcmp(got, expect) ? "no" : "yes");
+  free(got);
+}
+
+void
+ut15(void) {
+  char buff[32];
+  char path[] = "/tmp/ut15_XXXXXX";
+  const int fd = mkstemp(path);
+  if (fd < 0) {
+    printf("Cannot create file\n");
+    exit(EXIT_FAILURE);
+  }
+  close(fd);
+
+  // A table larger than the buffer used by the counting pass
+  table_t *tbl = utable_create(2000, 4);
+  if (NULL == tbl) {
+    printf("Cannot create table\n");
+    exit(EXIT_FAILURE);
+  }
+  for (size_t r = 0; r < 2000; r++) {
+    for (size_t c = 0; c < 4; c++) {
+      snprintf(buff, sizeof(buff), "r%zu c%zu", r, c * r);
+      utable_set_cell(tbl, r, c, buff);
+    }
+  }
+  utable_set_interior(tbl, TRUE, TRUE);
+  utable_set_title(tbl, "Report", TITLESTYLE_LINE);
+  const size_t size = 2000 * 256;
+  char *expect = malloc(size);
+  utable_strstroke(tbl, expect, size, TSTYLE_DOUBLE_V2);
+  printf("Stroke to file: %d\n", utable_stroke_file(tbl, path, TSTYLE_DOUBLE_V2));
+  ut15_check(path, expect, FALSE);
+
+  // A shorter view truncates the file
+  size_t rows[] = {0, 1, 1999};
+  tview_t *v = utable_view_create_rows(tbl, rows, 3);
+  utable_view_strstroke(v, expect, size, TSTYLE_ASCII_V1);
+  printf("Stroke view to file: %d\n", utable_view_stroke_file(v, path, TSTYLE_ASCII_V1));
+  ut15_check(path, expect, TRUE);
+  utable_view_free(v);
+  utable_free(tbl);
+
+  // A callback that gives a text of another length every time it is called
+  // is only called once, and the stroke is only counted once
+  tbl = utable_create(2, 2);
+  utable_set_cell(tbl, 0, 0, "Name");
+  utable_set_cell(tbl, 0, 1, "Value");
+  utable_set_cell(tbl, 1, 0, "grows");
+  utable_set_cellcallback(tbl, 1, 1, ut15_cell_cb);
+  utable_enable_stats(tbl, TRUE);
+  v = utable_view_create_rows(tbl, rows, 2);
+  printf("Stroke view to file: %d\n", utable_view_stroke_file(v, path, TSTYLE_SINGLE_V2));
+  ut15_check(path, NULL, TRUE);
+  utable_stats_t stats;
+  utable_get_stats(tbl, &stats);
+  printf("Strokes: %llu, callbacks: %llu, bytes: %llu\n", stats.strokes,
+         stats.callbacks, stats.bytes);
+  utable_view_free(v);
+  printf("Stroke to missing directory: %d\n",
+         utable_stroke_file(tbl, "/nonexistent/dir/file.txt", TSTYLE_SINGLE_V2));
+  utable_free(tbl);
+
+  unlink(path);
+  free(expect);
+}
+
+void
+ut16(void) {
+  char buff[32];
+  table_t *tbl = utable_create(4, 12);
+  if (NULL == tbl) {
+    printf("Cannot create table\n");
+    exit(EXIT_FAILURE);
+  }
+  for (size_t c = 0; c < 12; c++) {
+    snprintf(buff, sizeof(buff), "Col %zu", c);
+    utable_set_cell(tbl, 0, c, buff);
+    for (size_t r = 1; r < 4; r++) {
+      snprintf(buff, sizeof(buff), "%zu", r * 1000 + c);
+      utable_set_cell(tbl, r, c, buff);
+    }
+  }
+  utable_set_cell(tbl, 2, 3, "A cell spanning four columns");
+  utable_set_cell_colspan(tbl, 2, 3, 4);
+  utable_set_cell(tbl, 3, 9, "日本語");
+  utable_set_col_aggregate(tbl, 11, AGG_SUM, NULL);
+  utable_set_interior(tbl, TRUE, TRUE);
+  utable_set_headerline(tbl, TRUE);
+  utable_set_title(tbl, "A wide table viewed through a window", TITLESTYLE_LINE);
+
+  utable_stroke(tbl, STDOUT_FILENO, TSTYLE_SINGLE_V2);
+
+  // The window starts on a border, inside a column, inside the span and
+  // past the end of the table
+  size_t off[] = {0, 14, 31, 40, 62, 200};
+  for (size_t i = 0; i < sizeof(off) / sizeof(off[0]); i++) {
+    printf("Window at %zu:\n", off[i]);
+    fflush(stdout);
+    utable_stroke_window(tbl, STDOUT_FILENO, TSTYLE_SINGLE_V2, off[i], 25);
+  }
+
+  // A view with the columns in another order
+  size_t cols[] = {11, 0, 3, 4, 5, 6, 1};
+  tview_t *v = utable_view_create(tbl, NULL, NULL, 0);
+  utable_view_set_cols(v, cols, 7);
+  printf("View window:\n");
+  fflush(stdout);
+  utable_view_stroke_window(v, STDOUT_FILENO, TSTYLE_DOUBLE_V2, 10, 30);
+  utable_view_free(v);
+
+  printf("Empty window: %d\n", utable_stroke_window(tbl, STDOUT_FILENO, TSTYLE_SINGLE_V2, 0, 0));
+  utable_free(tbl);
+}
+
+// Rows of the table drawn by ut19
+static const char *ut19_rows[][3] = {
+  {"Name", "Size", "Note"},
+  {"alpha", "1024", "first"},
+  {"beta", "4096", NULL},
+  {"gamma", "17", "日本語"},
+  {"a much longer name", "123456789", "wider than the window"}};
+
+// Stream the rows of ut19 and write the output as it is drawn. The stream
+// output is also collected in the buffer.
+static int
+ut19_stream(size_t nrows, size_t lookahead, tblstyle_t style, _Bool lines,
+            _Bool fast, _Bool print, char *buff, size_t size) {
+  size_t pos = 0, len;
+  const char *p;
+  tstream_t *ts = utable_stream_create(3, lookahead, style);
+  if (NULL == ts)
+    return -1;
+  table_t *t = utable_stream_table(ts);
+  utable_set_fast_render(t, fast);
+  utable_set_title(t, "Streamed", TITLESTYLE_LINE);
+  utable_set_headerline(t, TRUE);
+  utable_set_interior(t, lines, lines);
+  utable_set_col_halign(t, 1, RIGHTALIGN);
+  for (size_t r = 0; r <= nrows; r++) {
+    if ((r < nrows ? utable_stream_row(ts, ut19_rows[r], NULL) : utable_stream_end(ts)) < 0) {
+      utable_stream_free(ts);
+      return -1;
+    }
+    p = utable_stream_pending(ts, &len);
+    if (print && len) {
+      printf("After row %zu:\n", r);
+      fflush(stdout);
+      if (write(STDOUT_FILENO, p, len) != (ssize_t)len)
+        len = 0;
+    }
+    len = MIN(len, size - pos - 1);
+    memcpy(buff + pos, p, len);
+    pos += len;
+    utable_stream_consume(ts, len);
+  }
+  buff[pos] = '\0';
+  utable_stream_free(ts);
+  return 0;
+}
+
+// The same rows in a table that is stroked at once
+static void
+ut19_table(size_t nrows, tblstyle_t style, _Bool lines, _Bool fast, char *buff,
+           size_t size) {
+  table_t *t = utable_create(nrows, 3);
+  for (size_t r = 0; r < nrows; r++)
+    for (size_t c = 0; c < 3; c++)
+      if (ut19_rows[r][c])
+        utable_set_cell(t, r, c, (char *)ut19_rows[r][c]);
+  utable_set_fast_render(t, fast);
+  utable_set_title(t, "Streamed", TITLESTYLE_LINE);
+  utable_set_headerline(t, TRUE);
+  utable_set_interior(t, lines, lines);
+  utable_set_col_halign(t, 1, RIGHTALIGN);
+  utable_strstroke(t, buff, size, style);
+  utable_free(t);
+}
+
+void
+ut19(void) {
+  char buff[4096], expect[4096];
+
+  // Rows after the look-ahead window are truncated to the fixed widths
+  ut19_stream(5, 2, TSTYLE_SINGLE_V2, TRUE, TRUE, TRUE, buff, sizeof(buff));
+
+  // With all rows in the window the stream draws the same table as a
+  // stroke, both with the row kernel and the generic drawing
+  tblstyle_t styles[] = {TSTYLE_SINGLE_V2, TSTYLE_DOUBLE_V4, TSTYLE_ASCII_V1};
+  for (int fast = 1; fast >= 0; fast--) {
+    for (size_t i = 0; i < sizeof(styles) / sizeof(styles[0]); i++) {
+      for (size_t n = 0; n <= 5; n++) {
+        for (int lines = 0; lines <= 1; lines++) {
+          ut19_stream(n, 5, styles[i], lines, fast, FALSE, buff, sizeof(buff));
+          ut19_table(n, styles[i], lines, fast, expect, sizeof(expect));
+          if (strcmp(buff, expect))
+            printf("Style %zu, %zu rows, lines %d, fast %d differs\n", i, n, lines, fast);
+        }
+      }
+    }
+  }
+  printf("Compared streams with strokes\n");
+
+  printf("Stream without columns: %p\n", (void *)utable_stream_create(0, 5, TSTYLE_SINGLE_V2));
+}
+
+void
+ut21(void) {
+  char buff[2048], expect[2048];
+  utable_mem_t mem;
+
+  // Row-major with lengths, the texts are slices of one string
+  const char *src = "NameSizeNotealpha1024firstbeta4096gamma17日本語";
+  const char *rm[] = {src, src + 4, src + 8, src + 12, src + 17, src + 21,
+                      src + 26, src + 30, NULL, src + 34, src + 39, src + 41};
+  const size_t rml[] = {4, 4, 4, 5, 4, 5, 4, 4, 0, 5, 2, 9};
+  table_t *tbl = utable_create(4, 3);
+  if (NULL == tbl || utable_set_n(tbl, rm, rml, ROW_MAJOR)) {
+    printf("Cannot set table\n");
+    exit(EXIT_FAILURE);
+  }
+  utable_set_col_halign(tbl, 1, RIGHTALIGN);
+  utable_memory_usage(tbl, &mem);
+  printf("Texts %zu bytes, cell (3,2)=\"%s\"\n", mem.texts, utable_get_cell(tbl, 3, 2));
+  fflush(stdout);
+  utable_stroke(tbl, STDOUT_FILENO, TSTYLE_SINGLE_V2);
+
+  // The same table from NULL terminated texts in column-major order
+  const char *cm[] = {"Name", "alpha", "beta", "gamma", "Size", "1024", "4096",
+                      "17", "Note", "first", NULL, "日本語"};
+  table_t *ctbl = utable_create_set_n(4, 3, cm, NULL, COL_MAJOR);
+  utable_set_col_halign(ctbl, 1, RIGHTALIGN);
+  utable_strstroke(tbl, expect, sizeof(expect), TSTYLE_SINGLE_V2);
+  utable_strstroke(ctbl, buff, sizeof(buff), TSTYLE_SINGLE_V2);
+  printf("Column-major %s\n", strcmp(buff, expect) ? "differs" : "same");
+
+  // A cell given a new text and the table set again
+  fflush(stdout);
+  utable_set_cell(tbl, 1, 0, "a new text");
+  utable_reset_table_colwidth(tbl);
+  utable_stroke(tbl, STDOUT_FILENO, TSTYLE_ASCII_V1);
+  const char *again[] = {"a", "b", "c", "d", "e", "f", "g", "h", "i", "j", "k", "l"};
+  printf("Set again: %d\n", utable_set_n(tbl, again, NULL, COL_MAJOR));
+  utable_memory_usage(tbl, &mem);
+  printf("Texts %zu bytes\n", mem.texts);
+  fflush(stdout);
+  utable_reset_table_colwidth(tbl);
+  utable_stroke(tbl, STDOUT_FILENO, TSTYLE_ASCII_V1);
+
+  // A text for a cell covered by a span leaves the table unchanged
+  utable_set_cell_colspan(ctbl, 2, 1, 2);
+  cm[2 + 8] = "covered";
+  printf("Set covered cell: %d\n", utable_set_n(ctbl, cm, NULL, COL_MAJOR));
+  cm[2 + 4] = "4096 spans two columns";
+  cm[2 + 8] = NULL;
+  printf("Set with span: %d\n", utable_set_n(ctbl, cm, NULL, COL_MAJOR));
+  fflush(stdout);
+  utable_reset_table_colwidth(ctbl);
+  utable_stroke(ctbl, STDOUT_FILENO, TSTYLE_ASCII_V1);
+
+  utable_free(tbl);
+  utable_free(ctbl);
+
+  // Each category for a known shape, 3 rows in the block and 2 rows that
+  // are allocated on their own with one cell more, a row directory with
+  // room for 7 rows and one more entry, and a snapshot with one chunk
+  table_t *shape = utable_create(3, 4);
+  utable_set_cell(shape, 0, 0, "abc");
+  utable_set_title(shape, "Shape", TITLESTYLE_NOLINE);
+  utable_insert_rows(shape, 1, 2);
+  table_t *snap = utable_snapshot(shape);
+  const size_t cols = 5 * (2 * sizeof(size_t) + sizeof(tfmt_t));
+  const size_t chunks = 2 * sizeof(void *);
+  utable_memory_usage(shape, &mem);
+  printf("Table %s, cells %s, columns %s, texts %s, title %s, total %s\n",
+         mem.table == sizeof(table_t) ? "ok" : "wrong",
+         mem.cells == 23 * sizeof(tcell_t) + 8 * sizeof(tcell_t *) + chunks + 2 ? "ok" : "wrong",
+         mem.columns == cols ? "ok" : "wrong", mem.texts == 4 ? "ok" : "wrong",
+         mem.title == 6 ? "ok" : "wrong",
+         mem.total == mem.table + mem.cells + mem.columns + 10 ? "ok" : "wrong");
+  utable_memory_usage(snap, &mem);
+  printf("Snapshot cells %s, texts %s\n",
+         mem.cells == sizeof(tcell_t) + 6 * sizeof(tcell_t *) + chunks ? "ok" : "wrong",
+         mem.texts == 0 ? "ok" : "wrong");
+  utable_snapshot_release(snap);
+  utable_free(shape);
+}
+
+// Print the memory still held by tables since a test started, negative if
+// the test freed more than it allocated
+static void
+ut_memory_left(size_t before) {
+  size_t after;
+  utable_memory_global(NULL, &after);
+  printf("Memory left: %lld bytes\n", (long long)after - (long long)before);
+}
+
+void
+ut22(void) {
+  size_t before;
+  utable_memory_global(NULL, &before);
+
+  char *data[] = {"Item", "Qty", "Price", "Note",
+                  "apple", "3", "1.50", "red",
+                  "pear", "", "", "",
+                  "plum", "7", "0.25", "sweet"};
+  table_t *tbl = utable_create_set(4, 4, data);
+  utable_set_title(tbl, "Insert and delete", TITLESTYLE_LINE);
+  utable_set_col_halign(tbl, 1, RIGHTALIGN);
+  utable_set_col_aggregate(tbl, 1, AGG_SUM, "%.0f");
+  utable_set_footer_label(tbl, 0, "Total");
+  utable_set_cell(tbl, 2, 1, "out of season");
+  utable_set_cell_colspan(tbl, 2, 1, 3);
+  utable_set_cell_halign(tbl, 3, 3, RIGHTALIGN);
+  utable_stroke(tbl, STDOUT_FILENO, TSTYLE_SIMPLE_V1);
+
+  // Rows inserted in the middle and at the end keep the spans, formats and
+  // footer of the rows that move
+  utable_insert_rows(tbl, 2, 2);
+  utable_set_cell(tbl, 2, 0, "fig");
+  utable_set_cell(tbl, 2, 1, "12");
+  utable_set_cell(tbl, 3, 0, "kiwi");
+  utable_set_cell(tbl, 3, 1, "5");
+  for (int i = 0; i < 100; i++) {
+    char buff[16];
+    utable_insert_rows(tbl, tbl->nRow, 1);
+    snprintf(buff, sizeof(buff), "%d", i);
+    utable_set_cell(tbl, tbl->nRow - 1, 1, buff);
+  }
+  utable_delete_rows(tbl, 6, 100);
+  utable_stroke(tbl, STDOUT_FILENO, TSTYLE_SIMPLE_V1);
+
+  // A column inserted inside a span widens it, a deleted column moves the
+  // widths and formats of the columns to the right
+  utable_set_colwidth(tbl, 3, 9);
+  utable_insert_cols(tbl, 2, 1);
+  utable_set_cell(tbl, 0, 2, "Unit");
+  utable_set_cell(tbl, 1, 2, "kg");
+  utable_delete_cols(tbl, 0, 1);
+  utable_stroke(tbl, STDOUT_FILENO, TSTYLE_SIMPLE_V1);
+
+  // Deleting the first column of a span draws the cells it covered again
+  utable_delete_cols(tbl, 0, 1);
+  utable_set_cell(tbl, 4, 0, "kg");
+  utable_stroke(tbl, STDOUT_FILENO, TSTYLE_SIMPLE_V1);
+
+  // In a sorted table a new row is drawn where the row it is inserted
+  // before is drawn
+  sortkey_t key[] = {{1, SORT_STRING, FALSE}};
+  utable_sort_by_col(tbl, key, 1, 1);
+  utable_insert_rows(tbl, 1, 1);
+  utable_set_cell(tbl, 1, 1, "before 1.50");
+  utable_delete_rows(tbl, 3, 1);
+  utable_reset_table_colwidth(tbl);
+  utable_stroke(tbl, STDOUT_FILENO, TSTYLE_SIMPLE_V1);
+
+  // A snapshot keeps the rows it was made from
+  table_t *snap = utable_snapshot(tbl);
+  utable_insert_rows(tbl, tbl->nRow, 1);
+  utable_set_cell(tbl, tbl->nRow - 1, 0, "New");
+  table_t *snap2 = utable_snapshot(tbl);
+  utable_stroke(snap, STDOUT_FILENO, TSTYLE_ASCII_V1);
+  utable_stroke(snap2, STDOUT_FILENO, TSTYLE_ASCII_V1);
+
+  // Views and strokes started before rows are deleted are not drawn
+  size_t rows[] = {0, tbl->nRow - 1};
+  tview_t *v = utable_view_create_rows(tbl, rows, 2);
+  tstroke_t *st = utable_stroke_begin(tbl, STDOUT_FILENO, TSTYLE_ASCII_V1);
+  utable_delete_rows(tbl, tbl->nRow - 1, 1);
+  printf("Stale view: %d, stale stroke: %d\n",
+         utable_view_stroke(v, STDOUT_FILENO, TSTYLE_ASCII_V1),
+         utable_stroke_continue(st));
+  fflush(stdout);
+  utable_stroke_end(st);
+  utable_view_free(v);
+  rows[1] = tbl->nRow - 1;
+  v = utable_view_create_rows(tbl, rows, 2);
+  utable_view_stroke(v, STDOUT_FILENO, TSTYLE_ASCII_V1);
+  utable_view_free(v);
+
+  printf("Out of range: %d %d %d %d, snapshot: %d\n",
+         utable_insert_rows(tbl, tbl->nRow + 1, 1),
+         utable_delete_rows(tbl, 1, tbl->nRow),
+         utable_insert_cols(tbl, tbl->nCol + 1, 1),
+         utable_delete_cols(tbl, 0, tbl->nCol + 1),
+         utable_insert_rows(snap, 0, 1));
+  utable_snapshot_release(snap);
+  utable_snapshot_release(snap2);
+  utable_free(tbl);
+  ut_memory_left(before);
+}
+
+void
+ut23(void) {
+  char buff[4096], expect[4096];
+  size_t before;
+  utable_memory_global(NULL, &before);
+
+  char *data[] = {"Day", "Time", "Room", "Course", "Teacher",
+                  "Monday", "08:00", "A1", "Algebra", "Smith",
+                  "", "10:00", "", "Lab session over two hours", "Jones",
+                  "", "", "", "", "",
+                  "Tuesday", "08:00", "B2", "Geometry", "Smith",
+                  "", "13:00", "Closed", "", ""};
+  table_t *tbl = utable_create_set(6, 5, data);
+  utable_set_title(tbl, "Row spans", TITLESTYLE_LINE);
+  utable_set_headerline(tbl, TRUE);
+  utable_set_interior(tbl, TRUE, TRUE);
+  utable_set_cell_rowspan(tbl, 1, 0, 3);
+  utable_set_cell_rowspan(tbl, 2, 1, 2);
+  utable_set_cell_rowspan(tbl, 2, 3, 2);
+  utable_set_cell_colspan(tbl, 2, 3, 2);
+  utable_set_cell_rowspan(tbl, 4, 0, 2);
+  utable_set_cell_colspan(tbl, 5, 2, 3);
+  utable_set_cell_halign(tbl, 2, 3, CENTERALIGN);
+  utable_stroke(tbl, STDOUT_FILENO, TSTYLE_SINGLE_V2);
+  utable_set_interior(tbl, FALSE, TRUE);
+  utable_stroke(tbl, STDOUT_FILENO, TSTYLE_ASCII_V2);
+  utable_set_interior(tbl, TRUE, TRUE);
+
+  // The generic drawing gives the same output as the row kernel
+  utable_strstroke(tbl, expect, sizeof(expect), TSTYLE_DOUBLE_V2);
+  utable_set_fast_render(tbl, FALSE);
+  utable_strstroke(tbl, buff, sizeof(buff), TSTYLE_DOUBLE_V2);
+  utable_set_fast_render(tbl, TRUE);
+  printf("Without the kernel: %s\n", strcmp(buff, expect) ? "differs" : "same");
+
+  // A window draws a span that crosses its edge in full
+  printf("Window:\n");
+  fflush(stdout);
+  utable_stroke_window(tbl, STDOUT_FILENO, TSTYLE_SINGLE_V2, 12, 30);
+
+  // Spans must not overlap and must fit in the table
+  printf("Overlap: %d %d %d, out of range: %d %d, covered: %d\n",
+         utable_set_cell_rowspan(tbl, 1, 1, 2),
+         utable_set_cell_colspan(tbl, 3, 0, 2),
+         utable_set_cell_rowspan(tbl, 0, 1, 3),
+         utable_set_cell_rowspan(tbl, 4, 4, 3),
+         utable_set_cell_rowspan(tbl, 1, 4, 0),
+         utable_set_cell_n(tbl, 3, 4, "x", 1));
+  fflush(stdout);
+
+  // A row inserted inside a span grows it and deleting the first row of a
+  // span draws the cells it covered on their own
+  utable_insert_rows(tbl, 3, 1);
+  utable_set_cell(tbl, 3, 2, "C3");
+  utable_delete_rows(tbl, 5, 1);
+  utable_set_cell(tbl, 5, 0, "Wed");
+  utable_stroke(tbl, STDOUT_FILENO, TSTYLE_SINGLE_V2);
+
+  // A span that shrinks gives back the cells it covered
+  utable_set_cell_rowspan(tbl, 1, 0, 1);
+  utable_set_cell(tbl, 2, 0, "Monday");
+  table_t *snap = utable_snapshot(tbl);
+  utable_stroke(snap, STDOUT_FILENO, TSTYLE_SINGLE_V2);
+
+  // In a sorted table a span is only drawn across the rows that are still
+  // drawn next to each other
+  sortkey_t key[] = {{1, SORT_STRING, FALSE}};
+  utable_sort_by_col(tbl, key, 1, 1);
+  utable_set_headerline(tbl, FALSE);
+  utable_stroke(tbl, STDOUT_FILENO, TSTYLE_SINGLE_V2);
+
+  utable_snapshot_release(snap);
+  utable_free(tbl);
+  ut_memory_left(before);
+}
+
+void
+ut24(void) {
+  size_t before;
+  utable_memory_global(NULL, &before);
+
+  // A quote inside an unquoted field is part of the field
+  table_t *tbl = utable_load("ut24_data.csv", EXPORT_CSV, 0);
+  if (NULL == tbl) {
+    printf("Cannot load table\n");
+    exit(EXIT_FAILURE);
+  }
+  printf("%zu rows, %zu columns\n", tbl->nRow, tbl->nCol);
+  fflush(stdout);
+  utable_export(tbl, STDOUT_FILENO, EXPORT_TSV);
+  utable_free(tbl);
+
+  // A file large enough to be split in chunks, with stray quotes before
+  // quoted fields that hold newlines
+  FILE *fp = fopen("ut24_big.csv", "w");
+  if (NULL == fp) {
+    printf("Cannot create file\n");
+    exit(EXIT_FAILURE);
+  }
+  for (int i = 0; i < 100000; i++)
+    fprintf(fp, "%d,%d\" screen,\"a\nb\"\n", i, i % 100);
+  fclose(fp);
+  table_t *one = utable_load("ut24_big.csv", EXPORT_CSV, 1);
+  table_t *many = utable_load("ut24_big.csv", EXPORT_CSV, 4);
+  unlink("ut24_big.csv");
+  if (NULL == one || NULL == many) {
+    printf("Cannot load table\n");
+    exit(EXIT_FAILURE);
+  }
+  int same = one->nRow == many->nRow && one->nCol == many->nCol;
+  for (size_t r = 0; same && r < one->nRow; r++) {
+    for (size_t c = 0; c < one->nCol; c++) {
+      const char *a = utable_get_cell(one, r, c), *b = utable_get_cell(many, r, c);
+      if (!!a != !!b || (a && strcmp(a, b))) same = 0;
+    }
+  }
+  printf("%zu rows, %zu columns, %s\n", many->nRow, many->nCol,
+         same ? "same in parallel" : "differs in parallel");
+  printf("%s|%s\n", utable_get_cell(many, 99999, 1), utable_get_cell(many, 99999, 2));
+  utable_free(one);
+  utable_free(many);
+
+  ut_memory_left(before);
+}
+
+static char *
+ut25_cell_cb(int r, int c, void *tag) {
+  static char buff[32];
+  (void)c; (void)tag;
+  snprintf(buff, sizeof(buff), "row %d", r);
+  return buff;
+}
+
+void
+ut25(void) {
+  size_t before;
+  utable_memory_global(NULL, &before);
+
+  char *data[] = {
+		  "Name", "Description",
+		  "alpha", "A description that is too wide",
+		  NULL, "Short"
+  };
+  table_t *tbl = utable_create_set(3, 2, data);
+  if (NULL == tbl) {
+    printf("Cannot create table\n");
+    exit(EXIT_FAILURE);
+  }
+  utable_set_cellcallback(tbl, 2, 0, ut25_cell_cb);
+  utable_set_colwidth(tbl, 1, 12);
+
+  // Statistics are off by default
+  utable_stats_t stats;
+  printf("Get disabled: %d\n", utable_get_stats(tbl, &stats));
+  fflush(stdout);
+
+  // Two strokes, each runs the callback once and cuts one cell
+  utable_enable_stats(tbl, TRUE);
+  const int devnull = open("/dev/null", O_WRONLY);
+  size_t n1 = 0, n2 = 0;
+  utable_stroke_count(tbl, devnull, TSTYLE_SINGLE_V2, &n1);
+  utable_stroke_count(tbl, STDOUT_FILENO, TSTYLE_SINGLE_V2, &n2);
+  close(devnull);
+  printf("Get enabled: %d\n", utable_get_stats(tbl, &stats));
+  printf("Strokes: %llu, bytes: %s, callbacks: %llu, truncated: %llu\n",
+         stats.strokes, stats.bytes == n1 + n2 ? "same as written" : "differ",
+         stats.callbacks, stats.truncated);
+
+  // Reset keeps collecting from zero
+  utable_reset_stats(tbl);
+  utable_get_stats(tbl, &stats);
+  const utable_stats_t zero = {0};
+  printf("Reset: %s\n", memcmp(&stats, &zero, sizeof(stats)) ? "not zero" : "zero");
+
+  utable_enable_stats(tbl, FALSE);
+  printf("Get disabled again: %d\n", utable_get_stats(tbl, &stats));
+  utable_free(tbl);
+
+  ut_memory_left(before);
+}
+
 // Some rudimentary unit-test
 // gcc -std=c99 -DTABLE_UNIT_TEST unicode_tbl.c 
 
@@ -313,8 +1471,44 @@ main(int argc, char **argv) {
       ut3();
     else if( strcmp(argv[1],"ut4") == 0)
       ut4();
+    else if( strcmp(argv[1],"ut5") == 0)
+      ut5();
+    else if( strcmp(argv[1],"ut6") == 0)
+      ut6();
+    else if( strcmp(argv[1],"ut7") == 0)
+      ut7();
+    else if( strcmp(argv[1],"ut8") == 0)
+      ut8();
+    else if( strcmp(argv[1],"ut9") == 0)
+      ut9();
+    else if( strcmp(argv[1],"ut10") == 0)
+      ut10();
+    else if( strcmp(argv[1],"ut11") == 0)
+      ut11();
+    else if( strcmp(argv[1],"ut12") == 0)
+      ut12();
+    else if( strcmp(argv[1],"ut13") == 0)
+      ut13();
+    else if( strcmp(argv[1],"ut14") == 0)
+      ut14();
+    else if( strcmp(argv[1],"ut15") == 0)
+      ut15();
+    else if( strcmp(argv[1],"ut16") == 0)
+      ut16();
+    else if( strcmp(argv[1],"ut19") == 0)
+      ut19();
+    else if( strcmp(argv[1],"ut21") == 0)
+      ut21();
+    else if( strcmp(argv[1],"ut22") == 0)
+      ut22();
+    else if( strcmp(argv[1],"ut23") == 0)
+      ut23();
+    else if( strcmp(argv[1],"ut24") == 0)
+      ut24();
+    else if( strcmp(argv[1],"ut25") == 0)
+      ut25();
     else {
-      char *errstr="Usage test_table \"ut<1|2|3|4>\"\n";
+      char *errstr="Usage test_table \"ut<1|2|3|4|5|6|7|8|9|10|11|12|13|14|15|16|19|21|22|23|24|25>\"\n";
       size_t n = write(STDERR_FILENO,errstr,strlen(errstr));
       if( n == strlen(errstr) )
 	n=0;
@@ -322,7 +1516,7 @@ main(int argc, char **argv) {
     }
   }
   else {
-    char *errstr="Usage test_table \"ut<1|2|3|4>\"\n";
+    char *errstr="Usage test_table \"ut<1|2|3|4|5|6|7|8|9|10|11|12|13|14|15|16|19|21|22|23|24|25>\"\n";
     size_t n = write(STDERR_FILENO,errstr,strlen(errstr));
     if( n == strlen(errstr) )
       n=0;
@@ -0,0 +1,170 @@
+// Unit tests for the C++ wrapper. Run the same way as test_table, i.e.
+// "test_tablexx ut17", and compared with the golden file by test/ut.sh
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+
+#include "libunitbl/unitable.hpp"
+
+using unitable::Table;
+
+void ut17() {
+  try {
+    Table tbl(5, 4);
+
+    // Bulk setters with views, literals and strings moved into the table
+    std::vector<std::string_view> head{"Name", "Kind", "Size", "Note"};
+    tbl.set_row(0, head);
+
+    std::vector<std::vector<std::string>> body{
+      {"alpha", "file", "1024"},
+      {"beta", "dir", "4096"},
+      {"gamma", "link", "17"}};
+    tbl.set_rows(std::move(body), 1);
+    tbl.set_col(3, std::vector<std::string>{"first", "", "日本語"}, 1);
+
+    // A view into a larger buffer, only the first word is used
+    const char txt[] = "deltaXXXXXXXX";
+    tbl.set(4, 0, std::string_view(txt, 5));
+    tbl.set(4, 1, std::string("pipe"));
+    tbl.set(4, 2, "0");
+    // Replace a moved string with a copy and the other way around
+    tbl.set(4, 1, "fifo");
+    tbl.set(4, 3, std::string(12, '-'));
+
+    tbl.title("C++ wrapper").headerline(true).halign(2, RIGHTALIGN);
+
+    std::cout << "Cell (1,0)=\"" << tbl.cell(1, 0) << "\" (4,0)=\""
+              << tbl.cell(4, 0) << "\" (4,1)=\"" << tbl.cell(4, 1) << "\"\n";
+
+    // The table as a string, to a stream and to a file descriptor must all
+    // be the same
+    std::string s = tbl.str(TSTYLE_SIMPLE_V1);
+    std::ostringstream os;
+    tbl.stroke(os, TSTYLE_SIMPLE_V1);
+    std::cout << s << "Stream " << (os.str() == s ? "same" : "differs") << "\n";
+    std::cout.flush();
+    const std::size_t n = tbl.stroke(STDOUT_FILENO, TSTYLE_DOUBLE_V2);
+    std::cout << "Wrote " << n << " bytes\n";
+
+    // Moving the table keeps the moved in strings alive
+    Table moved(std::move(tbl));
+    std::cout << "Moved (4,3)=\"" << moved.cell(4, 3) << "\"\n";
+
+    // An error from the stream is thrown after the stroke
+    std::ostringstream bad;
+    bad.setstate(std::ios::badbit);
+    try {
+      moved.stroke(bad, TSTYLE_ASCII_V1);
+      std::cout << "No error from bad stream\n";
+    } catch (const unitable::error &e) {
+      std::cout << "Caught: " << e.what() << "\n";
+    }
+
+    try {
+      moved.cell(5, 0);
+    } catch (const std::out_of_range &e) {
+      std::cout << "Caught: " << e.what() << "\n";
+    }
+
+    // Moved in strings follow their cells when rows and columns are
+    // inserted and deleted with the C API
+    Table edited(2, 2);
+    edited.set(0, 0, std::string("moved in"));
+    utable_insert_cols(edited.get(), 0, 2);
+    edited.set(1, 3, std::string("after insert"));
+    utable_insert_rows(edited.get(), 0, 1);
+    edited.set(1, 2, std::string("replaced"));
+    edited.set(1, 2, "copy");
+    utable_delete_rows(edited.get(), 0, 1);
+    utable_delete_cols(edited.get(), 0, 1);
+    edited.set(0, 0, std::string("again"));
+    std::cout << edited.str(TSTYLE_ASCII_V1);
+  } catch (const std::exception &e) {
+    std::cout << "Failed! " << e.what() << "\n";
+  }
+}
+
+struct job {
+  std::string name;
+  int runs;
+  double load;
+  std::chrono::milliseconds latency;
+  std::chrono::system_clock::time_point started;
+  bool done;
+};
+
+void ut18() {
+  using namespace std::chrono;
+  try {
+    const system_clock::time_point epoch{};
+    std::vector<job> jobs{
+      {"backup", 12, 0.25, milliseconds(1500), epoch + hours(24 * 365), true},
+      {"index", -3, 1e21, milliseconds(7), epoch + seconds(1620000000), false},
+      {"mail 日本", 123456, -2.5, milliseconds(0), epoch, true}};
+
+    // Structs with a column description for each column
+    Table t1 = unitable::make_table(
+        jobs,
+        unitable::column("Job", &job::name),
+        unitable::column("Runs", &job::runs),
+        unitable::column("Load", &job::load),
+        unitable::column("Latency", &job::latency),
+        unitable::column("Started", &job::started),
+        unitable::column("Done", &job::done),
+        unitable::column("Runs/s", [](const job &j) {
+          return duration<double>(j.latency).count() > 0
+                     ? j.runs / duration<double>(j.latency).count()
+                     : 0.0;
+        }));
+    t1.title("Jobs");
+    std::cout << t1.str(TSTYLE_SIMPLE_V1);
+
+    // Tuples and pairs, with and without a header
+    std::vector<std::tuple<unsigned long, const char *, seconds, float>> tup{
+      {18446744073709551615UL, "max", seconds(90), 0.5f},
+      {0, nullptr, seconds(-1), 3.25f}};
+    std::cout << unitable::make_table(tup, {"Value", "Name", "Time", "F"})
+                     .str(TSTYLE_ASCII_V1);
+    std::vector<std::pair<std::string_view, minutes>> pairs{
+      {"short", minutes(5)}, {"long", minutes(600)}};
+    std::cout << unitable::make_table(pairs).str(TSTYLE_ASCII_V1);
+
+    // Arrays and a cell changed after the widths were set
+    std::array<std::array<short, 3>, 2> arr{{{1, 22, 333}, {-4, 5, 6}}};
+    Table t2 = unitable::make_table(arr);
+    t2.set(0, 0, "wider text");
+    std::cout << t2.str(TSTYLE_ASCII_V1);
+    t2.autowidth();
+    std::cout << t2.str(TSTYLE_ASCII_V1);
+
+    try {
+      unitable::make_table(pairs, {"Only one"});
+    } catch (const unitable::error &e) {
+      std::cout << "Caught: " << e.what() << "\n";
+    }
+  } catch (const std::exception &e) {
+    std::cout << "Failed! " << e.what() << "\n";
+  }
+}
+
+int
+main(int argc, char **argv) {
+  if (argc == 2 && std::strcmp(argv[1], "ut17") == 0)
+    ut17();
+  else if (argc == 2 && std::strcmp(argv[1], "ut18") == 0)
+    ut18();
+  else
+    std::cerr << "Usage test_tablexx \"ut<17|18>\"\n";
+  std::cout << "\n\n";
+  return 0;
+}